@@ -0,0 +1,384 @@
+/*
+ * Throughput benchmarks.
+ *
+ * Measures validate, decode, encode and round trip throughput over a fixed
+ * corpus and writes the results to bench_output.txt in the current
+ * directory. Build and run from the top of the tree:
+ *
+ *	c++ -std=c++20 -O2 -DNDEBUG -Iinclude bench/bench.cpp -o bench
+ *	./bench
+ *
+ * Each measurement is the best of several batches, each batch running for
+ * at least min_batch. Throughput is input bytes and items (tokens returned
+ * by a cursor) per second of wall time.
+ */
+
+#include <cbor++/document.h>
+#include <cbor++/encoder.h>
+#include <cbor++/sink.h>
+#include <cbor++/validate.h>
+
+#include <chrono>
+#include <cstdio>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr auto min_batch = std::chrono::milliseconds{100};
+constexpr int batches = 5;
+
+struct corpus {
+	const char *name;
+	std::vector<std::byte> data;
+	std::size_t items;
+};
+
+/* keeps results from being optimised away */
+volatile std::size_t sink_value;
+
+/*
+ * Best time in seconds for one call of f.
+ */
+template<typename F>
+double
+measure(F &&f)
+{
+	double best = 1e30;
+	for (int b = 0; b < batches; ++b) {
+		std::size_t n = 0;
+		const auto start = clock_type::now();
+		auto now = start;
+		do {
+			f();
+			++n;
+			now = clock_type::now();
+		} while (now - start < min_batch);
+		const double t = std::chrono::duration<double>(now - start)
+		    .count() / n;
+		best = std::min(best, t);
+	}
+	return best;
+}
+
+std::vector<std::byte>
+from_hex(const char *s)
+{
+	const auto nibble = [](char c) {
+		return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+	};
+	std::vector<std::byte> v;
+	for (; s[0] && s[1]; s += 2)
+		v.push_back(static_cast<std::byte>(nibble(s[0]) << 4 |
+		    nibble(s[1])));
+	return v;
+}
+
+/*
+ * Count the items in in with a cursor.
+ */
+cbor::errc
+count_items(std::span<const std::byte> in, std::size_t &n)
+{
+	cbor::cursor c{in};
+	cbor::event ev;
+	n = 0;
+	for (;;) {
+		if (auto r = c.next(ev); r != cbor::errc::ok)
+			return r;
+		if (ev.type == cbor::token::eof)
+			return cbor::errc::ok;
+		++n;
+	}
+}
+
+/*
+ * RFC 8949 Appendix A examples, wrapped in one array.
+ */
+std::vector<std::byte>
+appendix_a()
+{
+	static const char *const examples[] = {
+		"00", "01", "0a", "17", "1818", "1819", "1864", "1903e8",
+		"1a000f4240", "1b000000e8d4a51000", "1bffffffffffffffff",
+		"c249010000000000000000", "3bffffffffffffffff",
+		"c349010000000000000000", "20", "29", "3863", "3903e7",
+		"f90000", "f98000", "f93c00", "fb3ff199999999999a", "f93e00",
+		"f97bff", "fa47c35000", "fa7f7fffff", "fb7e37e43c8800759c",
+		"f90001", "f90400", "f9c400", "fbc010666666666666", "f97c00",
+		"f97e00", "f9fc00", "fa7f800000", "fa7fc00000", "faff800000",
+		"fb7ff0000000000000", "fb7ff8000000000000",
+		"fbfff0000000000000", "f4", "f5", "f6", "f7", "f0", "f8ff",
+		"c074323031332d30332d32315432303a30343a30305a",
+		"c11a514b67b0", "c1fb41d452d9ec200000", "d74401020304",
+		"d818456449455446",
+		"d82076687474703a2f2f7777772e6578616d706c652e636f6d",
+		"40", "4401020304", "60", "6161", "6449455446", "62225c",
+		"62c3bc", "63e6b0b4", "64f0908591", "80", "83010203",
+		"8301820203820405",
+		"98190102030405060708090a0b0c0d0e0f101112131415161718181819",
+		"a0", "a201020304", "a26161016162820203", "826161a161626163",
+		"a56161614161626142616361436164614461656145",
+		"5f42010243030405ff", "7f657374726561646d696e67ff", "9fff",
+		"9f018202039f0405ffff", "9f01820203820405ff",
+		"83018202039f0405ff", "83019f0203ff820405",
+		"9f0102030405060708090a0b0c0d0e0f101112131415161718181819ff",
+		"bf61610161629f0203ffff", "826161bf61626163ff",
+		"bf6346756ef563416d7421ff",
+	};
+	constexpr std::size_t n = std::size(examples);
+	std::vector<std::byte> v(cbor::head_size(n));
+	cbor::write_head(v.data(), cbor::major::array, n);
+	for (const char *e : examples) {
+		const auto b = from_hex(e);
+		v.insert(v.end(), b.begin(), b.end());
+	}
+	return v;
+}
+
+/*
+ * Device readings: small maps of integers, short text, floats and a tagged
+ * timestamp.
+ */
+std::vector<std::byte>
+telemetry()
+{
+	constexpr unsigned records = 50000;
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	cbor::encoder enc{s};
+	enc.array(records);
+	char name[32];
+	for (unsigned i = 0; i < records; ++i) {
+		std::snprintf(name, sizeof name, "sensor-%04u", i % 1000);
+		enc.map(7);
+		enc.text("ts");
+		enc.tag(1);
+		enc.uint(1700000000 + i);
+		enc.text("device");
+		enc.text(name);
+		enc.text("temp");
+		enc.floating(20.0 + (i % 100) * 0.25);
+		enc.text("humidity");
+		enc.floating(0.5 + (i % 50) * 0.0078125);
+		enc.text("ok");
+		enc.boolean(i % 17 != 0);
+		enc.text("seq");
+		enc.integer(static_cast<std::int64_t>(i) - 25000);
+		enc.text("samples");
+		enc.array(8);
+		for (unsigned j = 0; j < 8; ++j)
+			enc.uint((i * 31 + j * 7) % 4096);
+	}
+	s.finish();
+	return v;
+}
+
+/*
+ * Items nested close to the depth limit, alternating arrays and maps.
+ */
+std::vector<std::byte>
+deep_nesting()
+{
+	constexpr unsigned records = 5000;
+	constexpr unsigned depth = cbor::max_depth - 2;
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	cbor::encoder enc{s};
+	enc.array(records);
+	for (unsigned i = 0; i < records; ++i) {
+		for (unsigned d = 0; d < depth; ++d) {
+			if (d & 1) {
+				enc.map(1);
+				enc.text("k");
+			} else {
+				enc.array(2);
+				enc.uint(d);
+			}
+		}
+		enc.uint(i);
+	}
+	s.finish();
+	return v;
+}
+
+/*
+ * Large byte strings.
+ */
+std::vector<std::byte>
+large_bytes()
+{
+	constexpr unsigned count = 16;
+	constexpr std::size_t size = 1 << 20;
+	std::vector<std::byte> payload(size);
+	std::uint32_t x = 1;
+	for (auto &b : payload) {
+		x = x * 1664525 + 1013904223;
+		b = static_cast<std::byte>(x >> 24);
+	}
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	cbor::encoder enc{s};
+	enc.array(count);
+	for (unsigned i = 0; i < count; ++i)
+		enc.bytes(payload);
+	s.finish();
+	return v;
+}
+
+void
+report(std::FILE *f, const corpus &c, const char *op, double t)
+{
+	const double mb = c.data.size() / t / 1e6;
+	const double mitems = c.items / t / 1e6;
+	std::fprintf(f, "%-14s %-12s %12zu %12.1f %12.2f\n", c.name, op,
+	    c.data.size(), mb, mitems);
+	std::fflush(f);
+}
+
+/*
+ * Print an error and return false unless r is ok.
+ */
+bool
+ok(const corpus &c, const char *op, cbor::errc r)
+{
+	if (r == cbor::errc::ok)
+		return true;
+	std::fprintf(stderr, "%s: %s: %s\n", c.name, op,
+	    make_error_code(r).message().c_str());
+	return false;
+}
+
+/*
+ * Measure every operation on c. Each is run once first, and on failure
+ * nothing more is measured and false is returned.
+ */
+bool
+run(std::FILE *f, const corpus &c)
+{
+	std::vector<std::byte> out;
+	out.reserve(c.data.size());
+	std::pmr::monotonic_buffer_resource arena;
+
+	const auto scan = [&] {
+		std::size_t end;
+		const auto r = cbor::validate(c.data, end);
+		sink_value = end;
+		return r;
+	};
+	if (!ok(c, "validate", scan()))
+		return false;
+	report(f, c, "validate", measure(scan));
+
+	const auto walk = [&] {
+		std::size_t n;
+		const auto r = count_items(c.data, n);
+		sink_value = n;
+		return r;
+	};
+	if (!ok(c, "cursor", walk()))
+		return false;
+	report(f, c, "cursor", measure(walk));
+
+	const auto build = [&] {
+		arena.release();
+		cbor::document doc{&arena};
+		const auto r = doc.parse(c.data, false);
+		sink_value = doc.root().size();
+		return r;
+	};
+	if (!ok(c, "document", build()))
+		return false;
+	report(f, c, "document", measure(build));
+
+	cbor::document doc;
+	if (!ok(c, "parse", doc.parse(c.data)))
+		return false;
+
+	const auto encode = [&] {
+		out.clear();
+		cbor::vector_sink s{out};
+		cbor::encoder enc{s};
+		cbor::encode(enc, doc.root());
+		s.finish();
+		sink_value = out.size();
+		return enc.status();
+	};
+	if (!ok(c, "encode", encode()))
+		return false;
+	report(f, c, "encode", measure(encode));
+
+	const auto encode_det = [&] {
+		out.clear();
+		cbor::vector_sink s{out};
+		cbor::encoder enc{s, cbor::deterministic};
+		cbor::encode(enc, doc.root());
+		s.finish();
+		sink_value = out.size();
+		return enc.status();
+	};
+	if (!ok(c, "encode det", encode_det()))
+		return false;
+	report(f, c, "encode det", measure(encode_det));
+
+	const auto round_trip = [&] {
+		arena.release();
+		cbor::document d{&arena};
+		if (auto r = d.parse(c.data, false); r != cbor::errc::ok)
+			return r;
+		out.clear();
+		cbor::vector_sink s{out};
+		cbor::encoder enc{s};
+		cbor::encode(enc, d.root());
+		s.finish();
+		sink_value = out.size();
+		return enc.status();
+	};
+	if (!ok(c, "round trip", round_trip()))
+		return false;
+	report(f, c, "round trip", measure(round_trip));
+	return true;
+}
+
+}
+
+int
+main()
+{
+	std::vector<corpus> corpora;
+	corpora.push_back({"appendix_a", appendix_a(), 0});
+	corpora.push_back({"telemetry", telemetry(), 0});
+	corpora.push_back({"deep_nesting", deep_nesting(), 0});
+	corpora.push_back({"large_bytes", large_bytes(), 0});
+
+	std::FILE *f = std::fopen("bench_output.txt", "w");
+	if (!f) {
+		std::perror("bench_output.txt");
+		return 1;
+	}
+
+	for (auto &c : corpora) {
+		std::size_t end;
+		if (cbor::validate(c.data, end) != cbor::errc::ok ||
+		    end != c.data.size() ||
+		    count_items(c.data, c.items) != cbor::errc::ok) {
+			std::fprintf(stderr, "%s: corpus is not well-formed\n",
+			    c.name);
+			return 1;
+		}
+	}
+
+	std::fprintf(f, "# cbor++ benchmark, %s\n", __VERSION__);
+	std::fprintf(f, "%-14s %-12s %12s %12s %12s\n", "corpus", "operation",
+	    "bytes", "MB/s", "Mitems/s");
+	for (const auto &c : corpora)
+		if (!run(f, c)) {
+			std::fclose(f);
+			return 1;
+		}
+	std::fclose(f);
+	return 0;
+}
@@ -0,0 +1,552 @@
+#pragma once
+
+/*
+ * Bignums, decimal fractions and bigfloats (RFC 8949 sections 3.4.3 and
+ * 3.4.4).
+ *
+ * Tags 2 and 3 wrap the big endian magnitude of an unsigned or negative
+ * integer in a byte string. Tags 4 and 5 hold [exponent, mantissa] for
+ * mantissa * 10^exponent and mantissa * 2^exponent, where the mantissa is
+ * an integer or a bignum.
+ *
+ * integer_view and decimal_view describe such values without decoding
+ * them: a sign, the magnitude bytes in the input and the exponent. Plain
+ * integers are described the same way, so a field may hold either. The
+ * conversions only do work proportional to the significant bytes and
+ * report whether the value fits instead of building a general bignum:
+ * to_int64 and to_int128 are exact, to_double rounds to nearest, and
+ * decimal_view::to_fixed and to_decimal produce scaled integers and
+ * user decimal types only when the value is represented exactly.
+ *
+ * Example:
+ *
+ *	cbor::decimal_view price;
+ *	std::int64_t cents;
+ *	if (cbor::decode_decimal(c, price) != cbor::errc::ok ||
+ *	    !price.to_fixed(cents, 2))
+ *		...
+ */
+
+#include "codec.h"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace cbor {
+
+namespace detail {
+
+/* magnitudes of integers encoded in the initial byte */
+inline constexpr std::byte small_magnitude[24] = {
+	std::byte{0}, std::byte{1}, std::byte{2}, std::byte{3},
+	std::byte{4}, std::byte{5}, std::byte{6}, std::byte{7},
+	std::byte{8}, std::byte{9}, std::byte{10}, std::byte{11},
+	std::byte{12}, std::byte{13}, std::byte{14}, std::byte{15},
+	std::byte{16}, std::byte{17}, std::byte{18}, std::byte{19},
+	std::byte{20}, std::byte{21}, std::byte{22}, std::byte{23},
+};
+
+inline constexpr std::int64_t pow10_int[19] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+	1000000000, 10000000000, 100000000000, 1000000000000,
+	10000000000000, 100000000000000, 1000000000000000,
+	10000000000000000, 100000000000000000, 1000000000000000000,
+};
+
+/* powers of ten exactly representable as doubles */
+inline constexpr double pow10_double[23] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+inline std::uint64_t
+load_be_bytes(std::span<const std::byte> s) noexcept
+{
+	std::uint64_t v = 0;
+	for (std::byte b : s)
+		v = v << 8 | static_cast<std::uint8_t>(b);
+	return v;
+}
+
+/*
+ * Split the significant magnitude s, plus one if add_one, into top *
+ * 2^shift, where top holds its first 64 bits and sticky tells whether any
+ * later bit is set. top is at least 2^56 if sticky is set.
+ */
+inline void
+top_bits(std::span<const std::byte> s, bool add_one, std::uint64_t &top,
+    bool &sticky, std::int64_t &shift) noexcept
+{
+	const std::size_t n = std::min<std::size_t>(s.size(), 8);
+	const auto rest = s.subspan(n);
+	top = load_be_bytes(s.first(n));
+	shift = 8 * static_cast<std::int64_t>(rest.size());
+	sticky = false;
+	bool carry = add_one;
+	for (std::byte b : rest) {
+		sticky |= b != std::byte{0};
+		carry &= b == std::byte{0xff};
+	}
+	if (!carry) {
+		sticky |= add_one;
+		return;
+	}
+	/* rest + 1 carries into top, leaving zeros behind */
+	sticky = false;
+	if (++top == 0) {
+		top = std::uint64_t{1} << 63;
+		++shift;
+	}
+}
+
+/*
+ * Nearest double to top * 2^e, or to a little more than that if sticky is
+ * set. A sticky bit is at least three places below the last bit a normal
+ * double keeps, so converting top | sticky rounds correctly; subnormal
+ * results are rounded here, as ldexp would round a second time.
+ */
+inline double
+scale_bits(std::uint64_t top, bool sticky, std::int64_t e) noexcept
+{
+	if (!top)
+		return 0.0;
+	const int width = std::bit_width(top);
+	if (e > 1024 - width)
+		return std::numeric_limits<double>::infinity();
+	if (e > -1022 - width)
+		return std::ldexp(static_cast<double>(top | sticky),
+		    static_cast<int>(e));
+
+	/* below 2^-1022: round to a multiple of 2^-1074 */
+	const std::int64_t k = -1074 - e;
+	if (k <= 0)
+		return std::ldexp(static_cast<double>(top), static_cast<int>(e));
+	if (k > 64)
+		return 0.0;
+	const std::uint64_t q = k == 64 ? 0 : top >> k;
+	const std::uint64_t rem = k == 64 ? top
+	    : top & ((std::uint64_t{1} << k) - 1);
+	const std::uint64_t half = std::uint64_t{1} << (k - 1);
+	const bool up = rem > half || (rem == half && (sticky || q & 1));
+	return std::ldexp(static_cast<double>(q + up), -1074);
+}
+
+/* mantissas up to this size are converted to decimal digits exactly */
+inline constexpr std::size_t max_decimal_bytes = 1024;
+
+/*
+ * Write the decimal digits of the significant magnitude s, plus one if
+ * add_one, to out and return their end. s has at most max_decimal_bytes
+ * bytes, and out room for 2.5 digits per byte and 10 more.
+ */
+inline char *
+decimal_digits(std::span<const std::byte> s, bool add_one, char *out)
+    noexcept
+{
+	constexpr std::uint32_t base = 1000000000;
+
+	/* little endian 32 bit limbs */
+	std::uint32_t limb[max_decimal_bytes / 4 + 1];
+	std::size_t n = 0;
+	for (std::size_t i = s.size(); i;) {
+		const std::size_t lo = i >= 4 ? i - 4 : 0;
+		limb[n++] = static_cast<std::uint32_t>(
+		    load_be_bytes(s.subspan(lo, i - lo)));
+		i = lo;
+	}
+	if (add_one) {
+		std::size_t i = 0;
+		while (i < n && ++limb[i] == 0)
+			++i;
+		if (i == n)
+			limb[n++] = 1;
+	}
+
+	/* nine digits at a time, least significant first */
+	std::uint32_t chunk[max_decimal_bytes / 3 + 2];
+	std::size_t k = 0;
+	while (n) {
+		std::uint64_t r = 0;
+		for (std::size_t i = n; i--;) {
+			const std::uint64_t x = r << 32 | limb[i];
+			limb[i] = static_cast<std::uint32_t>(x / base);
+			r = x % base;
+		}
+		chunk[k++] = static_cast<std::uint32_t>(r);
+		while (n && !limb[n - 1])
+			--n;
+	}
+	if (!k)
+		chunk[k++] = 0;
+
+	out = std::to_chars(out, out + 10, chunk[--k]).ptr;
+	while (k--) {
+		std::uint32_t c = chunk[k];
+		for (int j = 8; j >= 0; --j, c /= 10)
+			out[j] = static_cast<char>('0' + c % 10);
+		out += 9;
+	}
+	return out;
+}
+
+}
+
+struct integer_view {
+	bool negative = false;			/* value is -1 - magnitude */
+	std::span<const std::byte> magnitude;	/* big endian */
+
+	/*
+	 * Magnitude without leading zero bytes.
+	 */
+	std::span<const std::byte> significant() const noexcept
+	{
+		std::size_t i = 0;
+		while (i < magnitude.size() && magnitude[i] == std::byte{0})
+			++i;
+		return magnitude.subspan(i);
+	}
+
+	/*
+	 * Exact conversions. Return false if the value does not fit.
+	 */
+	bool to_int64(std::int64_t &v) const noexcept
+	{
+		const auto s = significant();
+		if (s.size() > 8)
+			return false;
+		const std::uint64_t m = detail::load_be_bytes(s);
+		if (m > static_cast<std::uint64_t>(INT64_MAX))
+			return false;
+		v = negative ? -1 - static_cast<std::int64_t>(m)
+		    : static_cast<std::int64_t>(m);
+		return true;
+	}
+
+#if defined(__SIZEOF_INT128__)
+	bool to_int128(__int128 &v) const noexcept
+	{
+		const auto s = significant();
+		if (s.size() > 16 || (s.size() == 16 &&
+		    static_cast<std::uint8_t>(s[0]) & 0x80))
+			return false;
+		unsigned __int128 m = 0;
+		for (std::byte b : s)
+			m = m << 8 | static_cast<std::uint8_t>(b);
+		v = negative ? -1 - static_cast<__int128>(m)
+		    : static_cast<__int128>(m);
+		return true;
+	}
+#endif
+
+	/*
+	 * Nearest double, or an infinity if the value is out of range.
+	 */
+	double to_double() const noexcept;
+};
+
+/*
+ * Round to the nearest double. The first eight significant bytes hold at
+ * least 57 significant bits, so folding the remaining bytes into the
+ * lowest bit keeps ties and values just past them apart.
+ */
+inline double
+integer_view::to_double() const noexcept
+{
+	std::uint64_t top;
+	bool sticky;
+	std::int64_t shift;
+	detail::top_bits(significant(), negative, top, sticky, shift);
+	const double d = detail::scale_bits(top, sticky, shift);
+	return negative ? -d : d;
+}
+
+struct decimal_view {
+	std::int64_t exponent = 0;
+	integer_view mantissa;
+	bool binary = false;		/* bigfloat: base 2 rather than 10 */
+
+	/*
+	 * Nearest double to the value, or a signed infinity or zero if it is
+	 * out of range. Decimal fractions whose mantissa has more than
+	 * detail::max_decimal_bytes significant bytes are instead scaled in
+	 * logarithms, which keeps about nine significant digits.
+	 */
+	double to_double() const noexcept;
+
+	/*
+	 * The value as a count of units of 10^-scale, e.g. cents for scale
+	 * 2. Returns false unless that count is an integer which fits.
+	 */
+	bool to_fixed(std::int64_t &units, unsigned scale) const noexcept;
+
+	/*
+	 * Construct d as D{mantissa, exponent} from a std::int64_t mantissa
+	 * and std::int32_t decimal exponent. Returns false for bigfloats and
+	 * for decimal fractions whose parts do not fit those types.
+	 */
+	template<typename D>
+	requires requires (std::int64_t m, std::int32_t e) { D{m, e}; }
+	bool to_decimal(D &d) const
+	{
+		std::int64_t m;
+		if (binary || !mantissa.to_int64(m) ||
+		    exponent < INT32_MIN || exponent > INT32_MAX)
+			return false;
+		d = D{m, static_cast<std::int32_t>(exponent)};
+		return true;
+	}
+};
+
+inline double
+decimal_view::to_double() const noexcept
+{
+	constexpr double inf = std::numeric_limits<double>::infinity();
+	const auto s = mantissa.significant();
+	std::uint64_t top;
+	bool sticky;
+	std::int64_t shift;
+
+	if (binary) {
+		/* beyond this the result is out of range either way */
+		constexpr std::int64_t limit = std::int64_t{1} << 60;
+		detail::top_bits(s, mantissa.negative, top, sticky, shift);
+		const double d = detail::scale_bits(top, sticky, shift +
+		    std::clamp(exponent, -limit, limit));
+		return mantissa.negative ? -d : d;
+	}
+
+	/* exact operands give a correctly rounded result */
+	if (s.size() <= 8 && exponent >= -22 && exponent <= 22) {
+		const std::uint64_t m = detail::load_be_bytes(s);
+		if (m < (std::uint64_t{1} << 53)) {
+			const double v = static_cast<double>(
+			    mantissa.negative ? m + 1 : m);
+			const double r = exponent < 0
+			    ? v / detail::pow10_double[-exponent]
+			    : v * detail::pow10_double[exponent];
+			return mantissa.negative ? -r : r;
+		}
+	}
+
+	if (s.size() > detail::max_decimal_bytes) {
+		detail::top_bits(s, mantissa.negative, top, sticky, shift);
+		const double l = std::log10(static_cast<double>(top)) +
+		    static_cast<double>(shift) * 0.30102999566398120 +
+		    static_cast<double>(exponent);
+		const double v = l > 309 ? inf : l < -325 ? 0.0
+		    : std::pow(10.0, l);
+		return mantissa.negative ? -v : v;
+	}
+
+	/* let from_chars round the decimal form */
+	char buf[detail::max_decimal_bytes * 5 / 2 + 40];
+	char *p = buf;
+	if (mantissa.negative)
+		*p++ = '-';
+	char *const digits = p;
+	p = detail::decimal_digits(s, mantissa.negative, p);
+	const std::int64_t n = p - digits;
+	*p++ = 'e';
+	const auto e = std::to_chars(p, buf + sizeof buf, exponent);
+	double v;
+	if (e.ec == std::errc{} && std::from_chars(buf, e.ptr, v).ec ==
+	    std::errc{})
+		return v;
+	/* the value is at least 10^(n - 1 + exponent) */
+	v = exponent > -n ? inf : 0.0;
+	return mantissa.negative ? -v : v;
+}
+
+inline bool
+decimal_view::to_fixed(std::int64_t &units, unsigned scale) const noexcept
+{
+	std::int64_t m;
+	if (!mantissa.to_int64(m))
+		return false;
+	if (!m) {
+		units = 0;
+		return true;
+	}
+	if (scale > 18 || exponent < -INT32_MAX || exponent > INT32_MAX)
+		return false;
+
+	std::int64_t e = exponent + scale;
+	if (binary) {
+		/*
+		 * m * 2^exponent * 10^scale = m * 5^scale * 2^e. Divide by a
+		 * negative power of two first, so that the product only
+		 * overflows if the result does.
+		 */
+		if (e < 0) {
+			if (e < -63 || std::countr_zero(
+			    static_cast<std::uint64_t>(m)) < -e)
+				return false;
+			m >>= -e;
+			e = 0;
+		}
+		for (unsigned i = 0; i < scale; ++i)
+			if (__builtin_mul_overflow(m, 5, &m))
+				return false;
+		return e <= 62 && !__builtin_mul_overflow(m,
+		    std::int64_t{1} << e, &units);
+	}
+
+	if (e < 0) {
+		if (e < -18 || m % detail::pow10_int[-e])
+			return false;
+		units = m / detail::pow10_int[-e];
+		return true;
+	}
+	return e <= 18 && !__builtin_mul_overflow(m, detail::pow10_int[e],
+	    &units);
+}
+
+namespace detail {
+
+/*
+ * Describe the integer or bignum whose first token is in ev.
+ */
+inline errc
+decode_integer(cursor &c, event &ev, integer_view &v)
+{
+	if (ev.type == token::tag) {
+		if (ev.value != 2 && ev.value != 3)
+			return errc::type_mismatch;
+		v.negative = ev.value == 3;
+		if (auto r = c.next(ev); r != errc::ok)
+			return r;
+		if (ev.type != token::bytes)
+			return ev.type == token::eof ? errc::truncated
+			    : errc::type_mismatch;
+		v.magnitude = ev.bytes();
+		return errc::ok;
+	}
+	if (ev.type != token::uint && ev.type != token::nint)
+		return ev.type == token::eof ? errc::truncated
+		    : errc::type_mismatch;
+	v.negative = ev.type == token::nint;
+	if (ev.ai < ai_1byte)
+		v.magnitude = {&small_magnitude[ev.ai], 1};
+	else
+		v.magnitude = c.input().subspan(ev.offset + 1,
+		    std::size_t{1} << (ev.ai - ai_1byte));
+	return errc::ok;
+}
+
+}
+
+/*
+ * Read an integer or bignum. The bytes of a bignum must be a definite
+ * length string; other tags are errc::type_mismatch. The view refers to
+ * the input.
+ */
+inline errc
+decode_integer(cursor &c, integer_view &v)
+{
+	event ev;
+	if (auto r = c.next(ev); r != errc::ok)
+		return r;
+	return detail::decode_integer(c, ev, v);
+}
+
+/*
+ * Read a decimal fraction (tag 4) or bigfloat (tag 5) as a definite length
+ * array of its exponent and mantissa. Integers and bignums are read as
+ * decimal fractions with exponent 0. Exponents which do not fit 64 bits
+ * are errc::overflow.
+ */
+inline errc
+decode_decimal(cursor &c, decimal_view &v)
+{
+	event ev;
+	if (auto r = c.next(ev); r != errc::ok)
+		return r;
+	v.exponent = 0;
+	v.binary = false;
+	if (ev.type != token::tag || (ev.value != 4 && ev.value != 5))
+		return detail::decode_integer(c, ev, v.mantissa);
+
+	v.binary = ev.value == 5;
+	if (auto r = c.next(ev); r != errc::ok)
+		return r;
+	if (ev.type != token::array_begin || ev.value != 2)
+		return ev.type == token::eof ? errc::truncated
+		    : errc::type_mismatch;
+	if (auto r = c.next(ev); r != errc::ok)
+		return r;
+	if (ev.type != token::uint && ev.type != token::nint)
+		return errc::type_mismatch;
+	if (ev.value > static_cast<std::uint64_t>(INT64_MAX))
+		return errc::overflow;
+	v.exponent = ev.type == token::nint
+	    ? -1 - static_cast<std::int64_t>(ev.value)
+	    : static_cast<std::int64_t>(ev.value);
+	if (auto r = decode_integer(c, v.mantissa); r != errc::ok)
+		return r;
+	return c.leave(ev);
+}
+
+/*
+ * Write v as an integer if its magnitude fits 64 bits, as the RFC's
+ * preferred serialization requires, and as a bignum otherwise.
+ */
+template<typename Sink>
+inline void
+encode_integer(encoder<Sink> &enc, const integer_view &v)
+{
+	const auto s = v.significant();
+	if (s.size() <= 8) {
+		const std::uint64_t m = detail::load_be_bytes(s);
+		if (v.negative)
+			enc.nint(m);
+		else
+			enc.uint(m);
+		return;
+	}
+	enc.tag(v.negative ? 3 : 2);
+	enc.bytes(s);
+}
+
+#if defined(__SIZEOF_INT128__)
+template<typename Sink>
+inline void
+encode_integer(encoder<Sink> &enc, __int128 v)
+{
+	const bool negative = v < 0;
+	auto m = static_cast<unsigned __int128>(negative ? -1 - v : v);
+	std::byte be[16];
+	for (int i = 15; i >= 0; --i, m >>= 8)
+		be[i] = static_cast<std::byte>(m);
+	encode_integer(enc, integer_view{negative, be});
+}
+#endif
+
+template<typename Sink>
+inline void
+encode_decimal(encoder<Sink> &enc, const decimal_view &v)
+{
+	enc.tag(v.binary ? 5 : 4);
+	enc.array(2);
+	enc.integer(v.exponent);
+	encode_integer(enc, v.mantissa);
+}
+
+/*
+ * Write mantissa * 10^exponent as a decimal fraction.
+ */
+template<typename Sink>
+inline void
+encode_decimal(encoder<Sink> &enc, std::int64_t mantissa,
+    std::int64_t exponent)
+{
+	enc.tag(4);
+	enc.array(2);
+	enc.integer(exponent);
+	enc.integer(mantissa);
+}
+
+}
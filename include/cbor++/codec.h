@@ -0,0 +1,371 @@
+#pragma once
+
+/*
+ * Typed encoding and decoding.
+ *
+ * cbor::codec<T> describes how a C++ type maps to CBOR:
+ *
+ *	template<typename Sink>
+ *	static void encode(encoder<Sink> &enc, const T &v);
+ *	static errc decode(cursor &c, const event &ev, T &v);
+ *
+ * decode is called with the first token of the item already read into ev
+ * and must consume the rest of the item. Codecs are provided for integers,
+ * bool, floating point, enums, strings, byte strings, std::vector,
+ * std::array and std::optional. See reflect.h for aggregates.
+ *
+ * Tags preceding an item are ignored when decoding.
+ */
+
+#include "cursor.h"
+#include "encoder.h"
+
+#include <array>
+#include <concepts>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace cbor {
+
+template<typename T>
+struct codec;
+
+/*
+ * Read the next token which is not a tag.
+ */
+inline errc
+next_untagged(cursor &c, event &ev) noexcept
+{
+	errc r;
+	do {
+		r = c.next(ev);
+	} while (r == errc::ok && ev.type == token::tag);
+	if (r == errc::ok && ev.type == token::eof)
+		return errc::truncated;
+	return r;
+}
+
+template<typename Sink, typename T>
+inline void
+encode(encoder<Sink> &enc, const T &v)
+{
+	codec<T>::encode(enc, v);
+}
+
+template<typename T>
+inline errc
+decode(cursor &c, T &v)
+{
+	event ev;
+	if (auto r = next_untagged(c, ev); r != errc::ok)
+		return r;
+	return codec<T>::decode(c, ev, v);
+}
+
+/*
+ * Decode input, which must hold exactly one item, to v. See cursor for the
+ * meaning of trusted.
+ */
+template<typename T>
+inline errc
+decode(std::span<const std::byte> input, T &v, bool trusted = false)
+{
+	cursor c{input, trusted};
+	if (auto r = decode(c, v); r != errc::ok)
+		return r;
+	return c.offset() == input.size() ? errc::ok : errc::trailing_data;
+}
+
+template<typename T>
+requires std::unsigned_integral<T> && (!std::same_as<T, bool>)
+struct codec<T> {
+	template<typename Sink>
+	static void encode(encoder<Sink> &enc, T v)
+	{
+		enc.uint(v);
+	}
+
+	static errc decode(cursor &, const event &ev, T &v) noexcept
+	{
+		if (ev.type != token::uint)
+			return errc::type_mismatch;
+		if (ev.value > std::numeric_limits<T>::max())
+			return errc::overflow;
+		v = static_cast<T>(ev.value);
+		return errc::ok;
+	}
+};
+
+template<typename T>
+requires std::signed_integral<T>
+struct codec<T> {
+	template<typename Sink>
+	static void encode(encoder<Sink> &enc, T v)
+	{
+		enc.integer(v);
+	}
+
+	static errc decode(cursor &, const event &ev, T &v) noexcept
+	{
+		constexpr auto max = static_cast<std::uint64_t>(
+		    std::numeric_limits<T>::max());
+		if (ev.type != token::uint && ev.type != token::nint)
+			return errc::type_mismatch;
+		if (ev.value > max)
+			return errc::overflow;
+		v = static_cast<T>(ev.value);
+		if (ev.type == token::nint)
+			v = -1 - v;
+		return errc::ok;
+	}
+};
+
+template<>
+struct codec<bool> {
+	template<typename Sink>
+	static void encode(encoder<Sink> &enc, bool v)
+	{
+		enc.boolean(v);
+	}
+
+	static errc decode(cursor &, const event &ev, bool &v) noexcept
+	{
+		if (ev.type != token::boolean)
+			return errc::type_mismatch;
+		v = ev.value;
+		return errc::ok;
+	}
+};
+
+template<typename T>
+requires std::floating_point<T>
+struct codec<T> {
+	template<typename Sink>
+	static void encode(encoder<Sink> &enc, T v)
+	{
+		enc.floating(v);
+	}
+
+	static errc decode(cursor &, const event &ev, T &v) noexcept
+	{
+		switch (ev.type) {
+		case token::floating:
+			v = static_cast<T>(ev.floating());
+			return errc::ok;
+		case token::uint:
+			v = static_cast<T>(ev.value);
+			return errc::ok;
+		case token::nint:
+			v = -1 - static_cast<T>(ev.value);
+			return errc::ok;
+		default:
+			return errc::type_mismatch;
+		}
+	}
+};
+
+template<typename T>
+requires std::is_enum_v<T>
+struct codec<T> {
+	using U = std::underlying_type_t<T>;
+
+	template<typename Sink>
+	static void encode(encoder<Sink> &enc, T v)
+	{
+		codec<U>::encode(enc, static_cast<U>(v));
+	}
+
+	static errc decode(cursor &c, const event &ev, T &v) noexcept
+	{
+		U u;
+		if (auto r = codec<U>::decode(c, ev, u); r != errc::ok)
+			return r;
+		v = static_cast<T>(u);
+		return errc::ok;
+	}
+};
+
+/*
+ * Decoded string_views and byte spans refer to the input and require
+ * definite length strings.
+ */
+template<>
+struct codec<std::string_view> {
+	template<typename Sink>
+	static void encode(encoder<Sink> &enc, std::string_view v)
+	{
+		enc.text(v);
+	}
+
+	static errc decode(cursor &, const event &ev,
+	    std::string_view &v) noexcept
+	{
+		if (ev.type != token::text)
+			return errc::type_mismatch;
+		v = ev.text();
+		return errc::ok;
+	}
+};
+
+template<>
+struct codec<std::span<const std::byte>> {
+	template<typename Sink>
+	static void encode(encoder<Sink> &enc, std::span<const std::byte> v)
+	{
+		enc.bytes(v);
+	}
+
+	static errc decode(cursor &, const event &ev,
+	    std::span<const std::byte> &v) noexcept
+	{
+		if (ev.type != token::bytes)
+			return errc::type_mismatch;
+		v = ev.bytes();
+		return errc::ok;
+	}
+};
+
+namespace detail {
+
+/*
+ * Decode a definite or indefinite length string by appending to s.
+ */
+template<typename S>
+inline errc
+decode_string(cursor &c, const event &ev, token type, S &s)
+{
+	const auto append = [&s](const event &e) {
+		const auto *p = reinterpret_cast<const typename S::value_type *>(
+		    e.data);
+		s.insert(s.end(), p, p + e.value);
+	};
+	const token begin = type == token::bytes
+	    ? token::bytes_begin : token::text_begin;
+	s.clear();
+	if (ev.type == type) {
+		append(ev);
+		return errc::ok;
+	}
+	if (ev.type != begin)
+		return errc::type_mismatch;
+	event e;
+	for (;;) {
+		if (auto r = c.next(e); r != errc::ok)
+			return r;
+		if (e.type != type)
+			return errc::ok;
+		append(e);
+	}
+}
+
+}
+
+template<>
+struct codec<std::string> {
+	template<typename Sink>
+	static void encode(encoder<Sink> &enc, const std::string &v)
+	{
+		enc.text(v);
+	}
+
+	static errc decode(cursor &c, const event &ev, std::string &v)
+	{
+		return detail::decode_string(c, ev, token::text, v);
+	}
+};
+
+template<>
+struct codec<std::vector<std::byte>> {
+	template<typename Sink>
+	static void encode(encoder<Sink> &enc, const std::vector<std::byte> &v)
+	{
+		enc.bytes(v);
+	}
+
+	static errc decode(cursor &c, const event &ev,
+	    std::vector<std::byte> &v)
+	{
+		return detail::decode_string(c, ev, token::bytes, v);
+	}
+};
+
+template<typename T>
+struct codec<std::vector<T>> {
+	template<typename Sink>
+	static void encode(encoder<Sink> &enc, const std::vector<T> &v)
+	{
+		enc.array(v.size());
+		for (const auto &i : v)
+			codec<T>::encode(enc, i);
+	}
+
+	static errc decode(cursor &c, const event &ev, std::vector<T> &v)
+	{
+		if (ev.type != token::array_begin)
+			return errc::type_mismatch;
+		v.clear();
+		if (!ev.is_indefinite())
+			v.reserve(ev.value);
+		event e;
+		for (;;) {
+			if (auto r = next_untagged(c, e); r != errc::ok)
+				return r;
+			if (e.type == token::array_end)
+				return errc::ok;
+			if (auto r = codec<T>::decode(c, e, v.emplace_back());
+			    r != errc::ok)
+				return r;
+		}
+	}
+};
+
+template<typename T, std::size_t N>
+struct codec<std::array<T, N>> {
+	template<typename Sink>
+	static void encode(encoder<Sink> &enc, const std::array<T, N> &v)
+	{
+		enc.array(N);
+		for (const auto &i : v)
+			codec<T>::encode(enc, i);
+	}
+
+	static errc decode(cursor &c, const event &ev, std::array<T, N> &v)
+	{
+		if (ev.type != token::array_begin ||
+		    (!ev.is_indefinite() && ev.value != N))
+			return errc::type_mismatch;
+		for (auto &i : v)
+			if (auto r = cbor::decode(c, i); r != errc::ok)
+				return r;
+		event e;
+		if (auto r = c.next(e); r != errc::ok)
+			return r;
+		return e.type == token::array_end ? errc::ok
+		    : errc::type_mismatch;
+	}
+};
+
+template<typename T>
+struct codec<std::optional<T>> {
+	template<typename Sink>
+	static void encode(encoder<Sink> &enc, const std::optional<T> &v)
+	{
+		if (v)
+			codec<T>::encode(enc, *v);
+		else
+			enc.null();
+	}
+
+	static errc decode(cursor &c, const event &ev, std::optional<T> &v)
+	{
+		if (ev.type == token::null || ev.type == token::undefined) {
+			v.reset();
+			return errc::ok;
+		}
+		return codec<T>::decode(c, ev, v.emplace());
+	}
+};
+
+}
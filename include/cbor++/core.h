@@ -0,0 +1,309 @@
+#pragma once
+
+/*
+ * Core definitions shared by the cbor++ decoders and encoders.
+ */
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+namespace cbor {
+
+/*
+ * Major types (RFC 8949 section 3.1).
+ */
+enum class major : std::uint8_t {
+	uint = 0,
+	nint = 1,
+	bytes = 2,
+	text = 3,
+	array = 4,
+	map = 5,
+	tag = 6,
+	simple = 7,
+};
+
+/*
+ * Additional information values with special meaning (RFC 8949 section 3).
+ */
+inline constexpr std::uint8_t ai_1byte = 24;
+inline constexpr std::uint8_t ai_2byte = 25;
+inline constexpr std::uint8_t ai_4byte = 26;
+inline constexpr std::uint8_t ai_8byte = 27;
+inline constexpr std::uint8_t ai_indefinite = 31;
+
+/*
+ * Argument value used to represent an indefinite length.
+ */
+inline constexpr std::uint64_t indefinite = UINT64_MAX;
+
+/*
+ * Maximum nesting depth accepted by the decoders. Indefinite length strings
+ * count as a level.
+ */
+inline constexpr unsigned max_depth = 64;
+
+/*
+ * Error codes.
+ */
+enum class errc {
+	ok = 0,
+	truncated,		/* input ends in the middle of an item */
+	malformed,		/* input is not well-formed CBOR */
+	unexpected_break,	/* break outside of indefinite length item */
+	invalid_chunk,		/* bad chunk in indefinite length string */
+	depth_exceeded,		/* nesting exceeds implementation limit */
+	trailing_data,		/* input continues after item */
+	overflow,		/* value exceeds implementation limits */
+	no_space,		/* output sink is full */
+	type_mismatch,		/* item has unexpected type */
+	invalid_utf8,		/* text string is not valid UTF-8 */
+	not_deterministic,	/* item has no deterministic encoding */
+	duplicate_key,		/* map has the same key twice */
+	invalid_path,		/* path expression cannot be parsed */
+	invalid_json,		/* input is not valid JSON text */
+	invalid_diag,		/* input is not valid diagnostic notation */
+	invalid_stringref,	/* string reference cannot be resolved */
+	invalid_packed,		/* packed CBOR reference cannot be resolved */
+	invalid_datetime,	/* date/time string cannot be parsed */
+};
+
+namespace detail {
+
+class error_category_impl final : public std::error_category {
+public:
+	const char *name() const noexcept override
+	{
+		return "cbor";
+	}
+
+	std::string message(int ev) const override
+	{
+		switch (static_cast<errc>(ev)) {
+		case errc::ok:
+			return "success";
+		case errc::truncated:
+			return "truncated input";
+		case errc::malformed:
+			return "malformed input";
+		case errc::unexpected_break:
+			return "unexpected break";
+		case errc::invalid_chunk:
+			return "invalid indefinite length string chunk";
+		case errc::depth_exceeded:
+			return "nesting depth exceeded";
+		case errc::trailing_data:
+			return "trailing data after item";
+		case errc::overflow:
+			return "value too large";
+		case errc::no_space:
+			return "insufficient output space";
+		case errc::type_mismatch:
+			return "unexpected item type";
+		case errc::invalid_utf8:
+			return "invalid UTF-8 in text string";
+		case errc::not_deterministic:
+			return "item cannot be encoded deterministically";
+		case errc::duplicate_key:
+			return "duplicate map key";
+		case errc::invalid_path:
+			return "invalid path expression";
+		case errc::invalid_json:
+			return "invalid JSON text";
+		case errc::invalid_diag:
+			return "invalid diagnostic notation";
+		case errc::invalid_stringref:
+			return "unresolvable string reference";
+		case errc::invalid_packed:
+			return "unresolvable packed CBOR reference";
+		case errc::invalid_datetime:
+			return "invalid date/time string";
+		}
+		return "unknown error";
+	}
+};
+
+}
+
+inline const std::error_category &
+error_category() noexcept
+{
+	static const detail::error_category_impl cat;
+	return cat;
+}
+
+inline std::error_code
+make_error_code(errc e) noexcept
+{
+	return {static_cast<int>(e), error_category()};
+}
+
+namespace detail {
+
+/*
+ * Big endian loads and stores.
+ */
+template<typename T>
+inline T
+load_be(const std::byte *p) noexcept
+{
+	static_assert(std::is_unsigned_v<T>);
+	T v;
+	std::memcpy(&v, p, sizeof v);
+	if constexpr (std::endian::native == std::endian::little && sizeof v > 1) {
+		if constexpr (sizeof v == 2)
+			v = __builtin_bswap16(v);
+		else if constexpr (sizeof v == 4)
+			v = __builtin_bswap32(v);
+		else
+			v = __builtin_bswap64(v);
+	}
+	return v;
+}
+
+template<typename T>
+inline void
+store_be(std::byte *p, T v) noexcept
+{
+	static_assert(std::is_unsigned_v<T>);
+	if constexpr (std::endian::native == std::endian::little && sizeof v > 1) {
+		if constexpr (sizeof v == 2)
+			v = __builtin_bswap16(v);
+		else if constexpr (sizeof v == 4)
+			v = __builtin_bswap32(v);
+		else
+			v = __builtin_bswap64(v);
+	}
+	std::memcpy(p, &v, sizeof v);
+}
+
+}
+
+/*
+ * Decoded item head.
+ */
+struct head {
+	major type;
+	std::uint8_t ai;	/* additional information */
+	std::uint64_t arg;	/* argument, or indefinite if ai is 31 */
+};
+
+/*
+ * Decode the item head at p. On success p is advanced past the head.
+ *
+ * A break (major type 7, additional information 31) is returned as a head
+ * with an indefinite argument; interpreting it is up to the caller.
+ */
+inline errc
+read_head(const std::byte *&p, const std::byte *end, head &h) noexcept
+{
+	if (p == end)
+		return errc::truncated;
+	const auto ib = static_cast<std::uint8_t>(*p);
+	h.type = static_cast<major>(ib >> 5);
+	h.ai = ib & 0x1f;
+	if (h.ai < ai_1byte) {
+		h.arg = h.ai;
+		++p;
+		return errc::ok;
+	}
+	const std::size_t avail = end - p - 1;
+	switch (h.ai) {
+	case ai_1byte:
+		if (avail < 1)
+			return errc::truncated;
+		h.arg = static_cast<std::uint8_t>(p[1]);
+		p += 2;
+		return errc::ok;
+	case ai_2byte:
+		if (avail < 2)
+			return errc::truncated;
+		h.arg = detail::load_be<std::uint16_t>(p + 1);
+		p += 3;
+		return errc::ok;
+	case ai_4byte:
+		if (avail < 4)
+			return errc::truncated;
+		h.arg = detail::load_be<std::uint32_t>(p + 1);
+		p += 5;
+		return errc::ok;
+	case ai_8byte:
+		if (avail < 8)
+			return errc::truncated;
+		h.arg = detail::load_be<std::uint64_t>(p + 1);
+		p += 9;
+		return errc::ok;
+	case ai_indefinite:
+		switch (h.type) {
+		case major::uint:
+		case major::nint:
+		case major::tag:
+			return errc::malformed;
+		default:
+			h.arg = indefinite;
+			++p;
+			return errc::ok;
+		}
+	default:
+		return errc::malformed;
+	}
+}
+
+/*
+ * Number of bytes required to encode a head with argument arg.
+ */
+constexpr std::size_t
+head_size(std::uint64_t arg) noexcept
+{
+	if (arg < ai_1byte)
+		return 1;
+	if (arg <= UINT8_MAX)
+		return 2;
+	if (arg <= UINT16_MAX)
+		return 3;
+	if (arg <= UINT32_MAX)
+		return 5;
+	return 9;
+}
+
+/*
+ * Encode the shortest head for type and arg to out, which must have room for
+ * at least 9 bytes. Returns the number of bytes written.
+ */
+inline std::size_t
+write_head(std::byte *out, major type, std::uint64_t arg) noexcept
+{
+	const auto mt = static_cast<std::uint8_t>(type) << 5;
+	if (arg < ai_1byte) {
+		out[0] = std::byte(mt | arg);
+		return 1;
+	}
+	if (arg <= UINT8_MAX) {
+		out[0] = std::byte(mt | ai_1byte);
+		out[1] = std::byte(arg);
+		return 2;
+	}
+	if (arg <= UINT16_MAX) {
+		out[0] = std::byte(mt | ai_2byte);
+		detail::store_be(out + 1, static_cast<std::uint16_t>(arg));
+		return 3;
+	}
+	if (arg <= UINT32_MAX) {
+		out[0] = std::byte(mt | ai_4byte);
+		detail::store_be(out + 1, static_cast<std::uint32_t>(arg));
+		return 5;
+	}
+	out[0] = std::byte(mt | ai_8byte);
+	detail::store_be(out + 1, arg);
+	return 9;
+}
+
+}
+
+template<>
+struct std::is_error_code_enum<cbor::errc> : std::true_type { };
@@ -0,0 +1,608 @@
+#pragma once
+
+/*
+ * Zero-copy pull parser over a contiguous buffer.
+ *
+ * A cursor walks a buffer one item head at a time. Strings are returned as
+ * views into the buffer and the cursor never allocates; nesting is tracked
+ * with a fixed size stack held inside the cursor itself.
+ *
+ * Example:
+ *
+ *	cbor::cursor c{buf};
+ *	cbor::event ev;
+ *	while (c.next(ev) == cbor::errc::ok && ev.type != cbor::token::eof) {
+ *		if (ev.type == cbor::token::text)
+ *			use(ev.text());
+ *	}
+ *
+ * skip() passes over a whole item without producing tokens. For repeated
+ * random access into a large buffer an extent_index records where every
+ * container ends, after which a cursor given the index skips any item in
+ * constant time:
+ *
+ *	cbor::extent_index ix;
+ *	ix.build(buf);
+ *	cbor::cursor c{buf, ix};
+ *	c.next(ev);			// outer array_begin
+ *	for (int i = 0; i < 6; ++i)
+ *		c.skip();		// O(1) per item
+ *	c.next(ev);			// 7th element
+ */
+
+#include "core.h"
+#include "half.h"
+#include "utf8.h"
+#include "validate.h"
+
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace cbor {
+
+/*
+ * Item tokens returned by cursor::next.
+ *
+ * Definite length strings are returned as a single bytes or text token.
+ * Indefinite length strings are returned as bytes_begin/text_begin, followed
+ * by one bytes/text token per chunk, followed by bytes_end/text_end.
+ *
+ * Arrays and maps of both definite and indefinite length are returned as a
+ * *_begin token, the contained items, and a matching *_end token.
+ */
+enum class token : std::uint8_t {
+	eof,		/* end of input */
+	uint,		/* unsigned integer: value */
+	nint,		/* negative integer: -1 - value */
+	bytes,		/* byte string */
+	text,		/* text string */
+	bytes_begin,	/* start of indefinite length byte string */
+	text_begin,	/* start of indefinite length text string */
+	bytes_end,	/* end of indefinite length byte string */
+	text_end,	/* end of indefinite length text string */
+	array_begin,	/* start of array: value is size or indefinite */
+	map_begin,	/* start of map: value is pair count or indefinite */
+	array_end,	/* end of array */
+	map_end,	/* end of map */
+	tag,		/* tag: value is tag number, tagged item follows */
+	simple,		/* unassigned simple value: value */
+	boolean,	/* value is 0 or 1 */
+	null,
+	undefined,
+	floating,	/* floating point: value holds binary64 bits */
+};
+
+/*
+ * A single decoded item head.
+ */
+struct event {
+	token type = token::eof;
+	std::uint8_t ai = 0;		/* additional information from head */
+	std::uint64_t value = 0;	/* integer, length, count, tag, ... */
+	const std::byte *data = nullptr;	/* string payload */
+	std::size_t offset = 0;		/* offset of head in input */
+
+	std::span<const std::byte> bytes() const noexcept
+	{
+		return {data, static_cast<std::size_t>(value)};
+	}
+
+	std::string_view text() const noexcept
+	{
+		return {reinterpret_cast<const char *>(data),
+		    static_cast<std::size_t>(value)};
+	}
+
+	double floating() const noexcept
+	{
+		return std::bit_cast<double>(value);
+	}
+
+	bool is_indefinite() const noexcept
+	{
+		return ai == ai_indefinite;
+	}
+};
+
+/*
+ * Byte extents of the containers in a buffer.
+ *
+ * build records where each array, map and indefinite length string ends, in
+ * the order their heads appear. The index is only meaningful for a cursor
+ * over the same buffer, starting from its beginning.
+ */
+class extent_index {
+public:
+	/*
+	 * Index input, which is walked as a CBOR sequence. On error the index
+	 * is left empty. See cursor for the meaning of trusted.
+	 */
+	errc build(std::span<const std::byte> input, bool trusted = false);
+
+	/*
+	 * Number of indexed containers.
+	 */
+	std::size_t size() const noexcept
+	{
+		return ext_.size();
+	}
+
+	void clear() noexcept
+	{
+		ext_.clear();
+	}
+
+private:
+	friend class cursor;
+
+	struct extent {
+		std::uint64_t end;	/* offset just past the item */
+		std::uint64_t next;	/* ordinal of the next container after it */
+	};
+
+	std::vector<extent> ext_;
+};
+
+class cursor {
+public:
+	static constexpr unsigned max_depth = cbor::max_depth;
+
+	cursor() noexcept = default;
+
+	/*
+	 * Text strings are checked to be valid UTF-8 unless trusted is set,
+	 * which should only be done for input produced by a known encoder.
+	 */
+	explicit cursor(std::span<const std::byte> in, bool trusted = false)
+	    noexcept
+	: begin_{in.data()}
+	, pos_{in.data()}
+	, end_{in.data() + in.size()}
+	, trusted_{trusted}
+	{ }
+
+	/*
+	 * Cursor using an index built over in. Items skipped through the
+	 * index are not checked again.
+	 */
+	cursor(std::span<const std::byte> in, const extent_index &index,
+	    bool trusted = false) noexcept
+	: cursor{in, trusted}
+	{
+		index_ = &index;
+	}
+
+	/*
+	 * Decode the next token into ev.
+	 *
+	 * Returns errc::ok on success. At the end of input ev.type is set to
+	 * token::eof; a buffer holding a CBOR sequence (RFC 8742) is walked
+	 * item by item until then. On error the cursor is left unchanged.
+	 */
+	errc next(event &ev) noexcept;
+
+	/*
+	 * Skip the next item, including the contents of a container and the
+	 * item following a tag, after checking it as next would. Inside an
+	 * indefinite length string this skips one chunk.
+	 *
+	 * Returns errc::unexpected_break if the innermost container has no
+	 * more items. On error the cursor is left unchanged.
+	 */
+	errc skip() noexcept;
+
+	/*
+	 * Skip the remaining items of the innermost container or indefinite
+	 * length string, and decode its end token into ev.
+	 */
+	errc leave(event &ev) noexcept;
+
+	/*
+	 * Current nesting depth. Top level items are at depth 0.
+	 */
+	unsigned depth() const noexcept
+	{
+		return depth_;
+	}
+
+	/*
+	 * True if the next item is a map key.
+	 */
+	bool at_key() const noexcept
+	{
+		return depth_ && stack_[depth_ - 1].type == token::map_begin &&
+		    !stack_[depth_ - 1].value;
+	}
+
+	/*
+	 * Offset of the next head in the input.
+	 */
+	std::size_t offset() const noexcept
+	{
+		return pos_ - begin_;
+	}
+
+	std::span<const std::byte> input() const noexcept
+	{
+		return {begin_, end_};
+	}
+
+private:
+	friend class incremental_decoder;
+
+	struct frame {
+		std::uint64_t remaining;	/* items left, or indefinite */
+		token type;			/* *_begin token of container */
+		bool value;			/* maps: next item is a value */
+	};
+
+	errc push(token type, std::uint64_t remaining) noexcept
+	{
+		if (depth_ == max_depth)
+			return errc::depth_exceeded;
+		stack_[depth_++] = {remaining, type, false};
+		++ordinal_;
+		return errc::ok;
+	}
+
+	/* innermost container has no more items */
+	bool at_end() const noexcept
+	{
+		if (!depth_)
+			return false;
+		const std::uint64_t n = stack_[depth_ - 1].remaining;
+		return n == 0 || (n == indefinite && pos_ != end_ &&
+		    *pos_ == std::byte{0xff} && !tagged_);
+	}
+
+	errc skip_indexed() noexcept;
+
+	void complete() noexcept
+	{
+		if (!depth_)
+			return;
+		frame &f = stack_[depth_ - 1];
+		if (f.remaining != indefinite)
+			--f.remaining;
+		f.value = !f.value;
+	}
+
+	const std::byte *begin_ = nullptr;
+	const std::byte *pos_ = nullptr;
+	const std::byte *end_ = nullptr;
+	unsigned depth_ = 0;
+	bool tagged_ = false;	/* last token was a tag */
+	bool stream_ = false;	/* input is a window of a larger stream */
+	bool trusted_ = false;	/* skip UTF-8 validation */
+	const extent_index *index_ = nullptr;
+	std::uint64_t ordinal_ = 0;	/* containers opened so far */
+	frame stack_[max_depth];
+};
+
+inline errc
+cursor::next(event &ev) noexcept
+{
+	ev.offset = pos_ - begin_;
+	ev.data = nullptr;
+
+	/* end of definite length container */
+	if (depth_ && stack_[depth_ - 1].remaining == 0) {
+		ev.type = stack_[depth_ - 1].type == token::array_begin
+		    ? token::array_end : token::map_end;
+		ev.ai = 0;
+		ev.value = 0;
+		--depth_;
+		complete();
+		return errc::ok;
+	}
+
+	if (pos_ == end_) {
+		if (depth_ || tagged_)
+			return errc::truncated;
+		ev.type = token::eof;
+		ev.ai = 0;
+		ev.value = 0;
+		return errc::ok;
+	}
+
+	const std::byte *p = pos_;
+	head h;
+	if (auto r = read_head(p, end_, h); r != errc::ok)
+		return r;
+
+	/* indefinite length strings may only contain definite chunks */
+	if (depth_) {
+		const token ft = stack_[depth_ - 1].type;
+		if (ft == token::bytes_begin || ft == token::text_begin) {
+			const bool brk = h.type == major::simple &&
+			    h.ai == ai_indefinite;
+			const major want = ft == token::bytes_begin
+			    ? major::bytes : major::text;
+			if (!brk && (h.type != want || h.ai == ai_indefinite))
+				return errc::invalid_chunk;
+		}
+	}
+
+	ev.ai = h.ai;
+	ev.value = h.arg;
+
+	switch (h.type) {
+	case major::uint:
+		ev.type = token::uint;
+		break;
+	case major::nint:
+		ev.type = token::nint;
+		break;
+	case major::bytes:
+	case major::text:
+		if (h.ai == ai_indefinite) {
+			ev.type = h.type == major::bytes
+			    ? token::bytes_begin : token::text_begin;
+			if (auto r = push(ev.type, indefinite); r != errc::ok)
+				return r;
+			pos_ = p;
+			tagged_ = false;
+			return errc::ok;
+		}
+		if (h.arg > static_cast<std::uint64_t>(end_ - p))
+			return errc::truncated;
+		if (h.type == major::text && !trusted_ && !utf8_valid(p, h.arg))
+			return errc::invalid_utf8;
+		ev.type = h.type == major::bytes ? token::bytes : token::text;
+		ev.data = p;
+		p += h.arg;
+		break;
+	case major::array:
+	case major::map: {
+		std::uint64_t n = h.arg;
+		if (n != indefinite) {
+			/* every item occupies at least one byte */
+			const std::uint64_t avail = end_ - p;
+			if (!stream_ && (n > avail ||
+			    (h.type == major::map && n > avail / 2)))
+				return errc::truncated;
+			if (h.type == major::map) {
+				if (n > (indefinite - 1) / 2)
+					return errc::overflow;
+				n *= 2;
+			}
+		}
+		ev.type = h.type == major::array
+		    ? token::array_begin : token::map_begin;
+		if (auto r = push(ev.type, n); r != errc::ok)
+			return r;
+		pos_ = p;
+		tagged_ = false;
+		return errc::ok;
+	}
+	case major::tag:
+		ev.type = token::tag;
+		pos_ = p;
+		tagged_ = true;
+		return errc::ok;
+	case major::simple:
+		switch (h.ai) {
+		case 20:
+		case 21:
+			ev.type = token::boolean;
+			ev.value = h.ai - 20;
+			break;
+		case 22:
+			ev.type = token::null;
+			break;
+		case 23:
+			ev.type = token::undefined;
+			break;
+		case ai_1byte:
+			if (h.arg < 32)
+				return errc::malformed;
+			ev.type = token::simple;
+			break;
+		case ai_2byte:
+			ev.type = token::floating;
+			ev.value = std::bit_cast<std::uint64_t>(
+			    detail::half_to_double(h.arg));
+			break;
+		case ai_4byte:
+			ev.type = token::floating;
+			ev.value = std::bit_cast<std::uint64_t>(
+			    static_cast<double>(std::bit_cast<float>(
+			    static_cast<std::uint32_t>(h.arg))));
+			break;
+		case ai_8byte:
+			ev.type = token::floating;
+			break;
+		case ai_indefinite: {
+			if (tagged_ || !depth_)
+				return errc::unexpected_break;
+			const frame &f = stack_[depth_ - 1];
+			if (f.remaining != indefinite)
+				return errc::unexpected_break;
+			if (f.type == token::map_begin && f.value)
+				return errc::malformed;
+			switch (f.type) {
+			case token::bytes_begin:
+				ev.type = token::bytes_end;
+				break;
+			case token::text_begin:
+				ev.type = token::text_end;
+				break;
+			case token::array_begin:
+				ev.type = token::array_end;
+				break;
+			default:
+				ev.type = token::map_end;
+				break;
+			}
+			ev.value = 0;
+			--depth_;
+			break;
+		}
+		default:
+			ev.type = token::simple;
+			break;
+		}
+		break;
+	}
+
+	pos_ = p;
+	tagged_ = false;
+	complete();
+	return errc::ok;
+}
+
+inline errc
+cursor::skip() noexcept
+{
+	if (at_end())
+		return errc::unexpected_break;
+	if (depth_) {
+		const token ft = stack_[depth_ - 1].type;
+		if (ft == token::bytes_begin || ft == token::text_begin) {
+			event ev;
+			return next(ev);
+		}
+	}
+	if (index_)
+		return skip_indexed();
+
+	const std::byte *p = pos_;
+	if (auto r = detail::scan(p, end_, max_depth - depth_, trusted_);
+	    r != errc::ok)
+		return r;
+	pos_ = p;
+	tagged_ = false;
+	complete();
+	return errc::ok;
+}
+
+/*
+ * Skip using the extent index: heads are read up to the first which is not
+ * a tag, and a container is jumped over whole.
+ */
+inline errc
+cursor::skip_indexed() noexcept
+{
+	const std::byte *p = pos_;
+	std::uint64_t ordinal = ordinal_;
+	head h;
+	do {
+		if (auto r = read_head(p, end_, h); r != errc::ok)
+			return r;
+	} while (h.type == major::tag);
+
+	switch (h.type) {
+	case major::bytes:
+	case major::text:
+		if (h.ai != ai_indefinite) {
+			if (h.arg > static_cast<std::uint64_t>(end_ - p))
+				return errc::truncated;
+			p += h.arg;
+			break;
+		}
+		[[fallthrough]];
+	case major::array:
+	case major::map: {
+		/* index does not describe this input */
+		if (ordinal >= index_->ext_.size())
+			return errc::malformed;
+		const auto &x = index_->ext_[ordinal];
+		if (x.end > static_cast<std::uint64_t>(end_ - begin_) ||
+		    x.end < static_cast<std::uint64_t>(p - begin_))
+			return errc::malformed;
+		p = begin_ + x.end;
+		ordinal = x.next;
+		break;
+	}
+	case major::simple:
+		if (h.ai == ai_indefinite)
+			return errc::unexpected_break;
+		if (h.ai == ai_1byte && h.arg < 32)
+			return errc::malformed;
+		break;
+	default:
+		break;
+	}
+
+	pos_ = p;
+	ordinal_ = ordinal;
+	tagged_ = false;
+	complete();
+	return errc::ok;
+}
+
+inline errc
+cursor::leave(event &ev) noexcept
+{
+	if (!depth_)
+		return errc::unexpected_break;
+	while (!at_end())
+		if (auto r = skip(); r != errc::ok)
+			return r;
+	return next(ev);
+}
+
+inline errc
+extent_index::build(std::span<const std::byte> input, bool trusted)
+{
+	ext_.clear();
+	cursor c{input, trusted};
+	std::uint64_t open[max_depth];
+	event ev;
+	for (;;) {
+		if (auto r = c.next(ev); r != errc::ok) {
+			ext_.clear();
+			return r;
+		}
+		switch (ev.type) {
+		case token::eof:
+			return errc::ok;
+		case token::bytes_begin:
+		case token::text_begin:
+		case token::array_begin:
+		case token::map_begin:
+			open[c.depth() - 1] = ext_.size();
+			ext_.push_back({0, 0});
+			break;
+		case token::bytes_end:
+		case token::text_end:
+		case token::array_end:
+		case token::map_end: {
+			extent &x = ext_[open[c.depth()]];
+			x.end = c.offset();
+			x.next = ext_.size();
+			break;
+		}
+		default:
+			break;
+		}
+	}
+}
+
+namespace detail {
+
+/*
+ * Skip the remainder of an item. ev is the token which started it.
+ */
+inline errc
+skip_rest(cursor &c, const event &ev) noexcept
+{
+	switch (ev.type) {
+	case token::tag:
+		return c.skip();
+	case token::bytes_begin:
+	case token::text_begin:
+	case token::array_begin:
+	case token::map_begin: {
+		event e;
+		return c.leave(e);
+	}
+	default:
+		return errc::ok;
+	}
+}
+
+}
+
+}
@@ -0,0 +1,550 @@
+#pragma once
+
+/*
+ * Date and time (RFC 8949 sections 3.4.1 and 3.4.2, RFC 9581).
+ *
+ * decode_time reads tag 0 (an RFC 3339 date/time string), tag 1 (seconds
+ * since the epoch, integer or floating point) and tag 1001 (extended time:
+ * a map of seconds and a fraction) directly into a
+ * std::chrono::sys_time, without going through a calendar library. Tag 0
+ * strings almost always have the fixed form "2024-05-06T07:08:09", with an
+ * optional fraction and "Z" or an offset after it; the first 16 bytes of
+ * that form are checked with one SIMD comparison (SSE2 or NEON) and the
+ * fields read directly from their positions. Lowercase separators are
+ * accepted by a scalar fallback.
+ *
+ * encode_time writes tag 0 strings with the fraction digits the duration
+ * needs, formatted in place without std::format or streams.
+ * encode_epoch writes tag 1 and encode_extended_time writes tag 1001,
+ * which keeps fractions exact.
+ *
+ * Times are floored to the duration of the sys_time. A leap second
+ * (seconds 60) reads as the first second of the next minute, as in POSIX
+ * time. Tag 0 covers the years 0000 to 9999 only; encode_time writes
+ * other times as tag 1, or tag 1001 if they have a fraction.
+ *
+ * Example:
+ *
+ *	std::chrono::sys_time<std::chrono::microseconds> ts;
+ *	if (cbor::decode_time(c, ts) != cbor::errc::ok)
+ *		...
+ *	cbor::encode_time(enc, std::chrono::system_clock::now());
+ */
+
+#include "cursor.h"
+#include "encoder.h"
+
+#include <chrono>
+#include <cmath>
+#include <concepts>
+#include <cstring>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace cbor {
+
+namespace detail {
+
+inline constexpr std::uint64_t pow10_u64[19] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+	1000000000, 10000000000, 100000000000, 1000000000000,
+	10000000000000, 100000000000000, 1000000000000000,
+	10000000000000000, 100000000000000000, 1000000000000000000,
+};
+
+/*
+ * True if the 16 bytes at p have the form "dddd-dd-ddTdd:dd".
+ */
+inline bool
+rfc3339_prefix(const char *p) noexcept
+{
+	static constexpr char pattern[] = "0000-00-00T00:00";
+#if defined(__SSE2__)
+	const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+	const __m128i digits = _mm_setr_epi8(-1, -1, -1, -1, 0, -1, -1, 0,
+	    -1, -1, 0, -1, -1, 0, -1, -1);
+	const __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+	const __m128i is_digit = _mm_cmpeq_epi8(
+	    _mm_min_epu8(d, _mm_set1_epi8(9)), d);
+	const __m128i is_sep = _mm_cmpeq_epi8(v, _mm_loadu_si128(
+	    reinterpret_cast<const __m128i *>(pattern)));
+	const __m128i ok = _mm_or_si128(_mm_and_si128(digits, is_digit),
+	    _mm_andnot_si128(digits, is_sep));
+	return _mm_movemask_epi8(ok) == 0xffff;
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	static constexpr std::uint8_t digits[16] = {
+		0xff, 0xff, 0xff, 0xff, 0, 0xff, 0xff, 0,
+		0xff, 0xff, 0, 0xff, 0xff, 0, 0xff, 0xff,
+	};
+	const uint8x16_t v = vld1q_u8(reinterpret_cast<const std::uint8_t *>(p));
+	const uint8x16_t is_digit = vcleq_u8(vsubq_u8(v, vdupq_n_u8('0')),
+	    vdupq_n_u8(9));
+	const uint8x16_t is_sep = vceqq_u8(v, vld1q_u8(
+	    reinterpret_cast<const std::uint8_t *>(pattern)));
+	return vminvq_u8(vbslq_u8(vld1q_u8(digits), is_digit, is_sep)) == 0xff;
+#else
+	for (unsigned i = 0; i < 16; ++i)
+		if (pattern[i] == '0' ? static_cast<unsigned char>(p[i] - '0') > 9
+		    : p[i] != pattern[i])
+			return false;
+	return true;
+#endif
+}
+
+inline unsigned
+rfc3339_2digits(const char *p) noexcept
+{
+	return (p[0] - '0') * 10 + (p[1] - '0');
+}
+
+/*
+ * Parse an RFC 3339 date-time to seconds since the epoch and nanoseconds.
+ * Fraction digits past nanoseconds are dropped.
+ */
+inline errc
+parse_rfc3339(std::string_view s, std::int64_t &sec, std::uint32_t &ns)
+    noexcept
+{
+	if (s.size() < 20)
+		return errc::invalid_datetime;
+	const char *p = s.data();
+	if (!rfc3339_prefix(p)) {
+		/* "t" is allowed too, and rare enough to copy for */
+		char buf[16];
+		std::memcpy(buf, p, 16);
+		if (buf[10] != 't')
+			return errc::invalid_datetime;
+		buf[10] = 'T';
+		if (!rfc3339_prefix(buf))
+			return errc::invalid_datetime;
+	}
+	if (p[16] != ':' || static_cast<unsigned char>(p[17] - '0') > 9 ||
+	    static_cast<unsigned char>(p[18] - '0') > 9)
+		return errc::invalid_datetime;
+
+	using namespace std::chrono;
+	const int y = rfc3339_2digits(p) * 100 + rfc3339_2digits(p + 2);
+	const unsigned mo = rfc3339_2digits(p + 5);
+	const unsigned d = rfc3339_2digits(p + 8);
+	const unsigned h = rfc3339_2digits(p + 11);
+	const unsigned mi = rfc3339_2digits(p + 14);
+	const unsigned se = rfc3339_2digits(p + 17);
+	const year_month_day ymd{year{y}, month{mo}, day{d}};
+	if (!ymd.ok() || h > 23 || mi > 59 || se > 60)
+		return errc::invalid_datetime;
+
+	std::size_t i = 19;
+	ns = 0;
+	if (s[i] == '.') {
+		const std::size_t first = ++i;
+		for (; i < s.size() && static_cast<unsigned char>(s[i] - '0') <= 9;
+		    ++i)
+			if (i - first < 9)
+				ns = ns * 10 + (s[i] - '0');
+		if (i == first)
+			return errc::invalid_datetime;
+		if (i - first < 9)
+			ns *= static_cast<std::uint32_t>(pow10_u64[9 - (i - first)]);
+	}
+
+	int offset = 0;
+	if (i < s.size() && (s[i] == 'Z' || s[i] == 'z'))
+		++i;
+	else if (i + 6 == s.size() && (s[i] == '+' || s[i] == '-') &&
+	    s[i + 3] == ':') {
+		const char *o = p + i + 1;
+		for (const char *q : {o, o + 3})
+			if (static_cast<unsigned char>(q[0] - '0') > 9 ||
+			    static_cast<unsigned char>(q[1] - '0') > 9)
+				return errc::invalid_datetime;
+		const unsigned oh = rfc3339_2digits(o);
+		const unsigned om = rfc3339_2digits(o + 3);
+		if (oh > 23 || om > 59)
+			return errc::invalid_datetime;
+		offset = static_cast<int>(oh * 3600 + om * 60);
+		if (s[i] == '-')
+			offset = -offset;
+		i += 6;
+	}
+	if (i != s.size())
+		return errc::invalid_datetime;
+
+	sec = static_cast<std::int64_t>(sys_days{ymd}.time_since_epoch()
+	    .count()) * 86400 + h * 3600 + mi * 60 + se - offset;
+	return errc::ok;
+}
+
+inline void
+rfc3339_put(char *p, unsigned v, unsigned n) noexcept
+{
+	while (n--) {
+		p[n] = static_cast<char>('0' + v % 10);
+		v /= 10;
+	}
+}
+
+/*
+ * Format seconds since the epoch, which must fall in the years 0000 to
+ * 9999, and nanoseconds with the given number of fraction digits. Returns
+ * the length, at most 30.
+ */
+inline std::size_t
+format_rfc3339(char *out, std::int64_t sec, std::uint32_t ns,
+    unsigned digits) noexcept
+{
+	using namespace std::chrono;
+	std::int64_t days = sec / 86400;
+	std::int64_t tod = sec % 86400;
+	if (tod < 0) {
+		tod += 86400;
+		--days;
+	}
+	const year_month_day ymd{sys_days{std::chrono::days{days}}};
+	rfc3339_put(out, static_cast<unsigned>(static_cast<int>(ymd.year())),
+	    4);
+	out[4] = '-';
+	rfc3339_put(out + 5, static_cast<unsigned>(ymd.month()), 2);
+	out[7] = '-';
+	rfc3339_put(out + 8, static_cast<unsigned>(ymd.day()), 2);
+	out[10] = 'T';
+	rfc3339_put(out + 11, static_cast<unsigned>(tod / 3600), 2);
+	out[13] = ':';
+	rfc3339_put(out + 14, static_cast<unsigned>(tod / 60 % 60), 2);
+	out[16] = ':';
+	rfc3339_put(out + 17, static_cast<unsigned>(tod % 60), 2);
+	std::size_t n = 19;
+	if (digits) {
+		out[n++] = '.';
+		rfc3339_put(out + n, static_cast<unsigned>(ns /
+		    pow10_u64[9 - digits]), digits);
+		n += digits;
+	}
+	out[n++] = 'Z';
+	return n;
+}
+
+/* 0000-01-01T00:00:00Z and 10000-01-01T00:00:00Z */
+inline constexpr std::int64_t rfc3339_min = -62167219200;
+inline constexpr std::int64_t rfc3339_end = 253402300800;
+
+/*
+ * Fraction digits needed for the period of a duration, at most 9.
+ */
+template<typename Period>
+constexpr unsigned
+time_digits() noexcept
+{
+	unsigned d = 0;
+	while (d < 9 && pow10_u64[d] % Period::den)
+		++d;
+	return d;
+}
+
+inline errc
+epoch_from_double(double v, std::int64_t &sec, std::uint32_t &ns) noexcept
+{
+	if (!(v >= -0x1p63 && v < 0x1p63))
+		return errc::overflow;
+	const double f = std::floor(v);
+	sec = static_cast<std::int64_t>(f);
+	ns = static_cast<std::uint32_t>(std::llround((v - f) * 1e9));
+	if (ns >= 1000000000) {
+		ns -= 1000000000;
+		if (sec == INT64_MAX)
+			return errc::overflow;
+		++sec;
+	}
+	return errc::ok;
+}
+
+inline errc
+epoch_from_event(const event &ev, std::int64_t &sec, std::uint32_t &ns)
+    noexcept
+{
+	ns = 0;
+	switch (ev.type) {
+	case token::uint:
+	case token::nint:
+		if (ev.value > static_cast<std::uint64_t>(INT64_MAX))
+			return errc::overflow;
+		sec = static_cast<std::int64_t>(ev.value);
+		if (ev.type == token::nint)
+			sec = -1 - sec;
+		return errc::ok;
+	case token::floating:
+		return epoch_from_double(ev.floating(), sec, ns);
+	default:
+		return ev.type == token::eof ? errc::truncated
+		    : errc::type_mismatch;
+	}
+}
+
+/*
+ * Read the map of an extended time (tag 1001), whose head is in ev. Key 1
+ * holds the seconds and keys -3 to -18 a fraction in milli- to
+ * attoseconds. Time scale -1 must be UTC. Other negative keys are critical
+ * and unknown ones are errc::type_mismatch; other keys are ignored.
+ */
+inline errc
+extended_time(cursor &c, event &ev, std::int64_t &sec, std::uint32_t &ns)
+{
+	if (ev.type != token::map_begin)
+		return ev.type == token::eof ? errc::truncated
+		    : errc::type_mismatch;
+	const auto in = c.input();
+	const bool indef = ev.is_indefinite();
+	const std::uint64_t n = ev.value;
+	bool base = false;
+	std::uint64_t frac = 0;
+	ns = 0;
+	for (std::uint64_t i = 0;; ++i) {
+		if (indef ? c.offset() < in.size() &&
+		    in[c.offset()] == std::byte{0xff} : i == n)
+			break;
+		event k, v;
+		if (auto r = c.next(k); r != errc::ok)
+			return r;
+		if (k.type != token::uint && k.type != token::nint) {
+			if (auto r = detail::skip_rest(c, k); r != errc::ok)
+				return r;
+			if (auto r = c.skip(); r != errc::ok)
+				return r;
+			continue;
+		}
+		if (k.type == token::uint && k.value != 1) {
+			if (auto r = c.skip(); r != errc::ok)
+				return r;
+			continue;
+		}
+		if (auto r = c.next(v); r != errc::ok)
+			return r;
+		if (k.type == token::uint) {
+			std::uint32_t f;
+			if (auto r = epoch_from_event(v, sec, f); r != errc::ok)
+				return r;
+			ns += f;
+			base = true;
+			continue;
+		}
+		/* key -1 - k.value */
+		if (k.value == 0) {
+			if (v.type != token::uint || v.value != 0)
+				return errc::type_mismatch;
+			continue;
+		}
+		if (k.value >= 18 || (k.value + 1) % 3 ||
+		    v.type != token::uint)
+			return errc::type_mismatch;
+		const std::uint64_t p = k.value + 1;
+		if (v.value >= pow10_u64[p])
+			return errc::type_mismatch;
+		frac = p <= 9 ? v.value * pow10_u64[9 - p]
+		    : v.value / pow10_u64[p - 9];
+	}
+	if (auto r = c.leave(ev); r != errc::ok)
+		return r;
+	if (!base)
+		return errc::type_mismatch;
+	frac += ns;
+	ns = static_cast<std::uint32_t>(frac % 1000000000);
+	if (frac >= 1000000000) {
+		if (sec == INT64_MAX)
+			return errc::overflow;
+		++sec;
+	}
+	return errc::ok;
+}
+
+template<typename Duration>
+inline errc
+make_time(std::int64_t sec, std::uint32_t ns,
+    std::chrono::sys_time<Duration> &t) noexcept
+{
+	using namespace std::chrono;
+	using rep = typename Duration::rep;
+	if constexpr (std::ratio_less_equal_v<typename Duration::period,
+	    std::ratio<1>>) {
+		constexpr rep per = duration_cast<Duration>(seconds{1}).count();
+		rep v;
+		if (__builtin_mul_overflow(sec, per, &v) ||
+		    __builtin_add_overflow(v,
+		    floor<Duration>(nanoseconds{ns}).count(), &v))
+			return errc::overflow;
+		t = sys_time<Duration>{Duration{v}};
+	} else
+		t = sys_time<Duration>{floor<Duration>(seconds{sec})};
+	return errc::ok;
+}
+
+template<typename Duration>
+inline void
+split_time(std::chrono::sys_time<Duration> t, std::int64_t &sec,
+    std::uint32_t &ns) noexcept
+{
+	using namespace std::chrono;
+	const auto s = floor<seconds>(t);
+	sec = s.time_since_epoch().count();
+	ns = static_cast<std::uint32_t>(duration_cast<nanoseconds>(t - s)
+	    .count());
+}
+
+}
+
+/*
+ * Parse an RFC 3339 date-time, e.g. "2024-05-06T07:08:09.5+02:00".
+ */
+template<typename Duration>
+requires std::integral<typename Duration::rep>
+inline errc
+parse_time(std::string_view s, std::chrono::sys_time<Duration> &t) noexcept
+{
+	std::int64_t sec;
+	std::uint32_t ns;
+	if (auto r = detail::parse_rfc3339(s, sec, ns); r != errc::ok)
+		return r;
+	return detail::make_time(sec, ns, t);
+}
+
+/*
+ * Read a time tagged 0, 1 or 1001. Other items are errc::type_mismatch,
+ * and times outside the range of the sys_time errc::overflow.
+ */
+template<typename Duration>
+requires std::integral<typename Duration::rep>
+inline errc
+decode_time(cursor &c, std::chrono::sys_time<Duration> &t)
+{
+	event ev;
+	if (auto r = c.next(ev); r != errc::ok)
+		return r;
+	if (ev.type != token::tag)
+		return ev.type == token::eof ? errc::truncated
+		    : errc::type_mismatch;
+	const std::uint64_t tag = ev.value;
+	if (auto r = c.next(ev); r != errc::ok)
+		return r;
+
+	std::int64_t sec;
+	std::uint32_t ns;
+	errc r;
+	switch (tag) {
+	case 0:
+		if (ev.type == token::text) {
+			r = detail::parse_rfc3339(ev.text(), sec, ns);
+			break;
+		}
+		if (ev.type == token::text_begin) {
+			/* longer than any date-time */
+			char buf[64];
+			std::size_t n = 0;
+			for (;;) {
+				if (auto e = c.next(ev); e != errc::ok)
+					return e;
+				if (ev.type == token::text_end)
+					break;
+				if (ev.value > sizeof buf - n)
+					return errc::invalid_datetime;
+				if (ev.value)
+					std::memcpy(buf + n, ev.data, ev.value);
+				n += ev.value;
+			}
+			r = detail::parse_rfc3339({buf, n}, sec, ns);
+			break;
+		}
+		return ev.type == token::eof ? errc::truncated
+		    : errc::type_mismatch;
+	case 1:
+		r = detail::epoch_from_event(ev, sec, ns);
+		break;
+	case 1001:
+		r = detail::extended_time(c, ev, sec, ns);
+		break;
+	default:
+		return errc::type_mismatch;
+	}
+	if (r != errc::ok)
+		return r;
+	return detail::make_time(sec, ns, t);
+}
+
+/*
+ * Write t as tag 1: an integer if it is a whole number of seconds and
+ * floating point otherwise, which keeps about microseconds for current
+ * dates.
+ */
+template<typename Sink, typename Duration>
+requires std::integral<typename Duration::rep>
+inline void
+encode_epoch(encoder<Sink> &enc, std::chrono::sys_time<Duration> t)
+{
+	std::int64_t sec;
+	std::uint32_t ns;
+	detail::split_time(t, sec, ns);
+	enc.tag(1);
+	if (!ns)
+		enc.integer(sec);
+	else
+		enc.floating(static_cast<double>(sec) + ns * 1e-9);
+}
+
+/*
+ * Write t as tag 1001 with integer seconds and, unless it is a whole
+ * number of seconds, the fraction in milli-, micro- or nanoseconds,
+ * whichever Duration needs.
+ */
+template<typename Sink, typename Duration>
+requires std::integral<typename Duration::rep>
+inline void
+encode_extended_time(encoder<Sink> &enc, std::chrono::sys_time<Duration> t)
+{
+	constexpr unsigned digits =
+	    (detail::time_digits<typename Duration::period>() + 2) / 3 * 3;
+	std::int64_t sec;
+	std::uint32_t ns;
+	detail::split_time(t, sec, ns);
+	enc.tag(1001);
+	enc.map(ns ? 2 : 1);
+	enc.uint(1);
+	enc.integer(sec);
+	if (ns) {
+		enc.integer(-static_cast<std::int64_t>(digits));
+		enc.uint(ns / detail::pow10_u64[9 - digits]);
+	}
+}
+
+/*
+ * Write t as tag 0 with as many fraction digits as Duration needs (none
+ * for seconds, 3 for milliseconds, up to 9). Times outside the years 0000
+ * to 9999 are written as tag 1 if they are whole seconds and as tag 1001
+ * otherwise, so that the fraction is kept.
+ */
+template<typename Sink, typename Duration>
+requires std::integral<typename Duration::rep>
+inline void
+encode_time(encoder<Sink> &enc, std::chrono::sys_time<Duration> t)
+{
+	std::int64_t sec;
+	std::uint32_t ns;
+	detail::split_time(t, sec, ns);
+	if (sec < detail::rfc3339_min || sec >= detail::rfc3339_end) {
+		if (ns) {
+			encode_extended_time(enc, t);
+			return;
+		}
+		enc.tag(1);
+		enc.integer(sec);
+		return;
+	}
+	char buf[32];
+	const std::size_t n = detail::format_rfc3339(buf, sec, ns,
+	    detail::time_digits<typename Duration::period>());
+	enc.tag(0);
+	enc.text({buf, n});
+}
+
+}
@@ -0,0 +1,602 @@
+#pragma once
+
+/*
+ * Diagnostic notation (RFC 8949 section 8).
+ *
+ * to_diag walks an item with a cursor and writes its diagnostic notation
+ * to a sink as it goes. It allocates nothing, so with a span_sink over a
+ * stack buffer it is cheap enough to leave on in production logging; if the
+ * buffer fills, errc::no_space is returned and the buffer holds a prefix of
+ * the text.
+ *
+ * from_diag parses diagnostic notation and writes the item through an
+ * encoder, e.g. for test fixtures. It accepts what to_diag prints:
+ *
+ *	1, -1, 1.5, 1e+300, Infinity, -Infinity, NaN, 1.5_3, float'7e01'
+ *	"text" with JSON escapes, h'0102', b64'AQI'
+ *	[1, 2], [_ 1, 2], {1: 2}, {_ 1: 2}, (_ h'01', h'02'), (_ "a", "b")
+ *	0("2013-03-21T20:04:00Z"), true, false, null, undefined, simple(16)
+ *
+ * Floating point values are printed as the shortest decimal which reads back
+ * as the same binary64 value, with a fraction or exponent so they read back
+ * as floating point. A value not encoded at the width the encoder picks for
+ * it gets an encoding indicator (RFC 8949 section 8.1): _1, _2 or _3 for
+ * 2, 4 or 8 bytes. NaN stands for the NaN the encoder writes for NAN; other
+ * NaNs are printed as float'' around the hex digits of their encoding, so
+ * that payload and sign read back too.
+ *
+ * Example:
+ *
+ *	char buf[512];
+ *	cbor::span_sink sink{std::as_writable_bytes(std::span{buf})};
+ *	cbor::to_diag(msg, sink);
+ *	log("%.*s", int(sink.size()), buf);
+ */
+
+#include "json.h"
+
+#include <vector>
+
+namespace cbor {
+
+namespace detail {
+
+/*
+ * Additional information of the width the encoder writes binary64 bits d
+ * at.
+ */
+inline std::uint8_t
+diag_float_width(std::uint64_t d) noexcept
+{
+	std::uint32_t f;
+	std::uint16_t h;
+	if (!double_to_float(d, f))
+		return ai_8byte;
+	return float_to_half(f, h) ? ai_2byte : ai_4byte;
+}
+
+/*
+ * Whether the n byte float at bits is the NaN the encoder writes for NAN,
+ * at that width.
+ */
+inline bool
+diag_quiet_nan(const std::byte *bits, std::size_t n) noexcept
+{
+	std::uint32_t f;
+	std::uint16_t h;
+	const auto d = std::bit_cast<std::uint64_t>(static_cast<double>(NAN));
+	if (n == 8)
+		return load_be<std::uint64_t>(bits) == d;
+	double_to_float(d, f);
+	if (n == 4)
+		return load_be<std::uint32_t>(bits) == f;
+	float_to_half(f, h);
+	return load_be<std::uint16_t>(bits) == h;
+}
+
+}
+
+/*
+ * Write the diagnostic notation of the single item in input to sink. See
+ * cursor for the meaning of trusted.
+ */
+template<typename Sink>
+inline errc
+to_diag(std::span<const std::byte> input, Sink &sink, bool trusted = false)
+{
+	struct frame {
+		token type;		/* *_begin token */
+		unsigned tags;		/* tags around the container to close */
+		std::uint64_t n = 0;	/* items written */
+	};
+	frame stack[max_depth];
+	unsigned depth = 0;
+	unsigned tags = 0;	/* tags around the current item to close */
+	bool done = false;
+
+	detail::json_writer<Sink> w{sink};
+	cursor c{input, trusted};
+	event ev;
+	for (;;) {
+		if (done && !depth)
+			return w.status() != errc::ok ? w.status()
+			    : c.offset() == input.size() ? errc::ok
+			    : errc::trailing_data;
+		if (auto r = c.next(ev); r != errc::ok)
+			return r;
+		if (w.status() != errc::ok)
+			return w.status();
+		if (ev.type == token::eof)
+			return errc::truncated;
+
+		const bool end = ev.type == token::array_end ||
+		    ev.type == token::map_end || ev.type == token::bytes_end ||
+		    ev.type == token::text_end;
+
+		/* separator before the item */
+		if (!end && !tags && depth) {
+			frame &f = stack[depth - 1];
+			if (f.type == token::map_begin && (f.n & 1))
+				w.put(": ");
+			else if (f.n)
+				w.put(", ");
+			++f.n;
+		}
+
+		switch (ev.type) {
+		case token::uint:
+			w.uint(ev.value);
+			break;
+		case token::nint:
+			w.nint(ev.value);
+			break;
+		case token::bytes: {
+			static constexpr char hex[] = "0123456789abcdef";
+			w.put("h'");
+			const std::byte *p = ev.data;
+			for (std::size_t n = ev.value; n;) {
+				char buf[128];
+				const std::size_t k = std::min(n, sizeof buf / 2);
+				for (std::size_t i = 0; i < k; ++i) {
+					const auto b = static_cast<unsigned>(p[i]);
+					buf[2 * i] = hex[b >> 4];
+					buf[2 * i + 1] = hex[b & 15];
+				}
+				w.put(buf, 2 * k);
+				p += k;
+				n -= k;
+			}
+			w.put('\'');
+			break;
+		}
+		case token::text:
+			w.put('"');
+			w.text(reinterpret_cast<const char *>(ev.data), ev.value);
+			w.put('"');
+			break;
+		case token::bytes_begin:
+		case token::text_begin:
+		case token::array_begin:
+		case token::map_begin:
+			if (depth == max_depth)
+				return errc::depth_exceeded;
+			stack[depth++] = {ev.type, tags};
+			tags = 0;
+			w.put(ev.type == token::array_begin ? "["
+			    : ev.type == token::map_begin ? "{" : "(");
+			if (ev.is_indefinite())
+				w.put("_ ");
+			continue;
+		case token::bytes_end:
+		case token::text_end:
+		case token::array_end:
+		case token::map_end:
+			tags = stack[--depth].tags;
+			w.put(ev.type == token::array_end ? ']'
+			    : ev.type == token::map_end ? '}' : ')');
+			break;
+		case token::tag:
+			w.uint(ev.value);
+			w.put('(');
+			++tags;
+			continue;
+		case token::simple:
+			w.put("simple(");
+			w.uint(ev.value);
+			w.put(')');
+			break;
+		case token::boolean:
+			w.put(ev.value ? "true" : "false");
+			break;
+		case token::null:
+			w.put("null");
+			break;
+		case token::undefined:
+			w.put("undefined");
+			break;
+		case token::floating: {
+			const double v = ev.floating();
+			const std::size_t n = std::size_t{1} << (ev.ai - ai_1byte);
+			const std::byte *bits = input.data() + ev.offset + 1;
+			if (v != v && !detail::diag_quiet_nan(bits, n)) {
+				static constexpr char hex[] = "0123456789abcdef";
+				char buf[24] = "float'";
+				for (std::size_t i = 0; i < n; ++i) {
+					const auto b = static_cast<unsigned>(bits[i]);
+					buf[6 + 2 * i] = hex[b >> 4];
+					buf[7 + 2 * i] = hex[b & 15];
+				}
+				buf[6 + 2 * n] = '\'';
+				w.put(buf, 7 + 2 * n);
+				break;
+			}
+			if (v != v)
+				w.put("NaN");
+			else if (v - v != 0)
+				w.put(v < 0 ? "-Infinity" : "Infinity");
+			else {
+				char buf[40];
+				char *e = std::to_chars(buf, buf + 32, v).ptr;
+				if (std::find_if(buf, e, [](char ch) {
+					return ch == '.' || ch == 'e';
+				    }) == e) {
+					*e++ = '.';
+					*e++ = '0';
+				}
+				w.put(buf, e - buf);
+			}
+			if (const std::uint8_t ai = detail::diag_float_width(ev.value);
+			    ai != ev.ai) {
+				const char ind[] = {'_',
+				    static_cast<char>('0' + ev.ai - ai_1byte)};
+				w.put(ind, 2);
+			}
+			break;
+		}
+		default:
+			break;
+		}
+		for (; tags; --tags)
+			w.put(')');
+		done = true;
+	}
+}
+
+namespace detail {
+
+inline void
+diag_space(const char *&p, const char *e) noexcept
+{
+	while (p != e && json_space(*p))
+		++p;
+}
+
+/*
+ * Number of items in the definite length container whose contents start
+ * at p, counting map entries as one.
+ */
+inline std::uint64_t
+diag_count(const char *p, const char *e) noexcept
+{
+	std::uint64_t n = 0;
+	unsigned depth = 0;
+	bool item = false;
+	for (; p != e; ++p) {
+		switch (*p) {
+		case '"':
+		case '\'': {
+			const char q = *p;
+			while (++p != e && *p != q)
+				if (*p == '\\' && p + 1 != e)
+					++p;
+			if (p == e)
+				return n;
+			break;
+		}
+		case '[':
+		case '{':
+		case '(':
+			++depth;
+			break;
+		case ']':
+		case '}':
+		case ')':
+			if (!depth--)
+				return n + item;
+			break;
+		case ',':
+			if (!depth) {
+				n += item;
+				item = false;
+				continue;
+			}
+			break;
+		default:
+			if (json_space(*p))
+				continue;
+			break;
+		}
+		item = true;
+	}
+	return n + item;
+}
+
+/*
+ * Decode the contents of h'' or b64'' starting at p into out.
+ */
+inline errc
+diag_binary(const char *&p, const char *e, bool base64,
+    std::vector<std::byte> &out)
+{
+	out.clear();
+	unsigned acc = 0;
+	unsigned bits = 0;
+	for (; p != e && *p != '\''; ++p) {
+		const char c = *p;
+		int v;
+		if (json_space(c) || (base64 && c == '='))
+			continue;
+		if (!base64)
+			v = json_hex(c);
+		else if (c >= 'A' && c <= 'Z')
+			v = c - 'A';
+		else if (c >= 'a' && c <= 'z')
+			v = c - 'a' + 26;
+		else if (c >= '0' && c <= '9')
+			v = c - '0' + 52;
+		else if (c == '+' || c == '-')
+			v = 62;
+		else if (c == '/' || c == '_')
+			v = 63;
+		else
+			v = -1;
+		if (v < 0)
+			return errc::invalid_diag;
+		acc = acc << (base64 ? 6 : 4) | v;
+		bits += base64 ? 6 : 4;
+		if (bits >= 8) {
+			bits -= 8;
+			out.push_back(static_cast<std::byte>(acc >> bits));
+		}
+	}
+	if (p == e || (!base64 && bits))
+		return errc::invalid_diag;
+	++p;
+	return errc::ok;
+}
+
+/*
+ * Consume the encoding indicator _1, _2 or _3 at p and return the
+ * additional information it stands for, or 0 if there is none.
+ */
+inline std::uint8_t
+diag_indicator(const char *&p, const char *e) noexcept
+{
+	if (e - p < 2 || p[0] != '_' || p[1] < '1' || p[1] > '3')
+		return 0;
+	p += 2;
+	return static_cast<std::uint8_t>(ai_1byte + (p[-1] - '0'));
+}
+
+/*
+ * Write binary64 bits d as a float with additional information ai, or
+ * return errc::invalid_diag if that width cannot hold it exactly.
+ */
+template<typename Sink>
+inline errc
+diag_fixed(encoder<Sink> &enc, std::uint64_t d, std::uint8_t ai)
+{
+	std::byte out[9];
+	std::uint32_t f;
+	std::uint16_t h;
+	std::size_t n = 9;
+	if (ai == ai_8byte)
+		store_be(out + 1, d);
+	else if (!double_to_float(d, f))
+		return errc::invalid_diag;
+	else if (ai == ai_4byte) {
+		store_be(out + 1, f);
+		n = 5;
+	} else if (!float_to_half(f, h))
+		return errc::invalid_diag;
+	else {
+		store_be(out + 1, h);
+		n = 3;
+	}
+	out[0] = static_cast<std::byte>(0xe0 | ai);
+	enc.raw({out, n});
+	return enc.status();
+}
+
+template<typename Sink>
+inline errc
+diag_value(const char *&p, const char *e, encoder<Sink> &enc,
+    unsigned depth, std::string &scratch, std::vector<std::byte> &bin)
+{
+	const auto word = [&](std::string_view w) {
+		if (static_cast<std::size_t>(e - p) < w.size() ||
+		    std::memcmp(p, w.data(), w.size()))
+			return false;
+		p += w.size();
+		return true;
+	};
+	/* comma separated items up to close */
+	const auto items = [&](char close, auto &&item) {
+		for (bool first = true;; first = false) {
+			diag_space(p, e);
+			if (p != e && *p == close) {
+				++p;
+				return errc::ok;
+			}
+			if (!first) {
+				if (p == e || *p++ != ',')
+					return errc::invalid_diag;
+				diag_space(p, e);
+			}
+			if (p == e)
+				return errc::invalid_diag;
+			if (auto r = item(); r != errc::ok)
+				return r;
+		}
+	};
+	const auto value = [&] {
+		return diag_value(p, e, enc, depth + 1, scratch, bin);
+	};
+	/* Infinity, -Infinity or NaN, with an optional encoding indicator */
+	const auto special = [&](double v) {
+		if (const std::uint8_t ai = diag_indicator(p, e))
+			return diag_fixed(enc, std::bit_cast<std::uint64_t>(v), ai);
+		enc.floating(v);
+		return enc.status();
+	};
+
+	diag_space(p, e);
+	if (p == e)
+		return errc::invalid_diag;
+	if (depth == max_depth)
+		return errc::depth_exceeded;
+
+	switch (*p) {
+	case '[':
+	case '{': {
+		const bool map = *p++ == '{';
+		const char close = map ? '}' : ']';
+		const bool indef = p != e && *p == '_';
+		if (indef) {
+			++p;
+			map ? enc.map() : enc.array();
+		} else {
+			const std::uint64_t n = diag_count(p, e);
+			map ? enc.map(n) : enc.array(n);
+		}
+		if (auto r = items(close, [&] {
+			if (auto first = value(); first != errc::ok || !map)
+				return first;
+			diag_space(p, e);
+			if (p == e || *p++ != ':')
+				return errc::invalid_diag;
+			return value();
+		    }); r != errc::ok)
+			return r;
+		if (indef)
+			enc.end();
+		break;
+	}
+	case '(': {
+		++p;
+		if (p == e || *p++ != '_')
+			return errc::invalid_diag;
+		diag_space(p, e);
+		const bool text = p != e && *p == '"';
+		text ? enc.text_begin() : enc.bytes_begin();
+		if (auto r = items(')', [&] {
+			if (text ? *p != '"' : *p != 'h' && *p != 'b')
+				return errc::invalid_diag;
+			return value();
+		    }); r != errc::ok)
+			return r;
+		enc.end();
+		break;
+	}
+	case '"': {
+		std::string_view s;
+		++p;
+		if (auto r = json_string(p, e, scratch, s, false); r != errc::ok)
+			return r == errc::invalid_json ? errc::invalid_diag : r;
+		enc.text(s);
+		break;
+	}
+	case 'h':
+	case 'b': {
+		const bool base64 = *p == 'b';
+		if (!word(base64 ? "b64'" : "h'"))
+			return errc::invalid_diag;
+		if (auto r = diag_binary(p, e, base64, bin); r != errc::ok)
+			return r;
+		enc.bytes(bin);
+		break;
+	}
+	case 's': {
+		unsigned v;
+		if (!word("simple("))
+			return errc::invalid_diag;
+		const auto r = std::from_chars(p, e, v);
+		if (r.ec != std::errc{} || v > 255 || (v >= 24 && v < 32))
+			return errc::invalid_diag;
+		p = r.ptr;
+		if (!word(")"))
+			return errc::invalid_diag;
+		enc.simple(static_cast<std::uint8_t>(v));
+		break;
+	}
+	default:
+		if (word("true"))
+			enc.boolean(true);
+		else if (word("false"))
+			enc.boolean(false);
+		else if (word("null"))
+			enc.null();
+		else if (word("undefined"))
+			enc.undefined();
+		else if (word("Infinity"))
+			return special(HUGE_VAL);
+		else if (word("-Infinity"))
+			return special(-HUGE_VAL);
+		else if (word("NaN"))
+			return special(NAN);
+		else if (word("float'")) {
+			if (auto r = diag_binary(p, e, false, bin); r != errc::ok)
+				return r;
+			if (bin.size() != 2 && bin.size() != 4 && bin.size() != 8)
+				return errc::invalid_diag;
+			bin.insert(bin.begin(), static_cast<std::byte>(0xe0 |
+			    (ai_1byte + std::countr_zero(bin.size()))));
+			enc.raw(bin);
+		} else {
+			/* tag number followed by ( */
+			const char *d = p;
+			while (d != e && *d >= '0' && *d <= '9')
+				++d;
+			if (d != p && d != e && *d == '(') {
+				std::uint64_t tag;
+				if (std::from_chars(p, d, tag).ptr != d)
+					return errc::invalid_diag;
+				p = d + 1;
+				enc.tag(tag);
+				if (auto r = value(); r != errc::ok)
+					return r;
+				diag_space(p, e);
+				if (p == e || *p++ != ')')
+					return errc::invalid_diag;
+				break;
+			}
+			/* floating point with an encoding indicator */
+			const char *x = p;
+			while (x != e && ((*x >= '0' && *x <= '9') || *x == '-' ||
+			    *x == '+' || *x == '.' || *x == 'e' || *x == 'E'))
+				++x;
+			const char *q = x;
+			if (const std::uint8_t ai = diag_indicator(q, e)) {
+				double v;
+				const auto r = std::from_chars(p, x, v);
+				if (r.ptr != x || r.ec != std::errc{} ||
+				    std::find_if(p, x, [](char ch) {
+					return ch == '.' || ch == 'e' || ch == 'E';
+				    }) == x)
+					return errc::invalid_diag;
+				p = q;
+				return diag_fixed(enc, std::bit_cast<std::uint64_t>(v),
+				    ai);
+			}
+			if (auto r = json_number(p, e, enc); r != errc::ok)
+				return r == errc::invalid_json
+				    ? errc::invalid_diag : r;
+		}
+		break;
+	}
+	return enc.status();
+}
+
+}
+
+/*
+ * Parse the diagnostic notation of a single item in diag and write it to
+ * enc.
+ */
+template<typename Sink>
+inline errc
+from_diag(std::string_view diag, encoder<Sink> &enc)
+{
+	const char *p = diag.data();
+	const char *const e = p + diag.size();
+	std::string scratch;
+	std::vector<std::byte> bin;
+	if (auto r = detail::diag_value(p, e, enc, 0, scratch, bin);
+	    r != errc::ok)
+		return r;
+	while (p != e && detail::json_space(*p))
+		++p;
+	return p == e ? errc::ok : errc::trailing_data;
+}
+
+}
@@ -0,0 +1,601 @@
+#pragma once
+
+/*
+ * In-memory CBOR document tree.
+ *
+ * All nodes, strings and container storage are allocated from the
+ * std::pmr::memory_resource passed to the document. Values are trivially
+ * destructible and nothing is ever freed individually, so pairing a document
+ * with a std::pmr::monotonic_buffer_resource frees the whole tree in one
+ * shot when the resource is released or destroyed:
+ *
+ *	std::byte buf[4096];
+ *	std::pmr::monotonic_buffer_resource arena{buf, sizeof buf};
+ *	cbor::document doc{&arena};
+ *	if (doc.parse(msg) != cbor::errc::ok)
+ *		...
+ *	handle(doc.root());
+ *	arena.release();
+ *
+ * A default constructed document allocates from its own arena instead.
+ *
+ * Values are small handles. Copying a string, array or map value copies the
+ * handle, not the contents; modify containers in place through references
+ * obtained from the tree.
+ *
+ * Allocation failure is reported by the memory resource, usually by
+ * throwing std::bad_alloc.
+ */
+
+#include "cursor.h"
+#include "encoder.h"
+
+#include <algorithm>
+#include <memory_resource>
+
+namespace cbor {
+
+enum class kind : std::uint8_t {
+	uint,
+	nint,
+	bytes,
+	text,
+	array,
+	map,
+	tag,
+	simple,
+	boolean,
+	null,
+	undefined,
+	floating,
+};
+
+struct member;
+
+class value {
+public:
+	value() noexcept = default;
+
+	static value uint(std::uint64_t v) noexcept
+	{
+		return {kind::uint, v};
+	}
+
+	/* negative integer -1 - v */
+	static value nint(std::uint64_t v) noexcept
+	{
+		return {kind::nint, v};
+	}
+
+	static value integer(std::int64_t v) noexcept
+	{
+		if (v < 0)
+			return nint(static_cast<std::uint64_t>(-1 - v));
+		return uint(static_cast<std::uint64_t>(v));
+	}
+
+	static value boolean(bool v) noexcept
+	{
+		return {kind::boolean, v};
+	}
+
+	static value null() noexcept
+	{
+		return {kind::null, 0};
+	}
+
+	static value undefined() noexcept
+	{
+		return {kind::undefined, 0};
+	}
+
+	static value simple(std::uint8_t v) noexcept
+	{
+		return {kind::simple, v};
+	}
+
+	static value floating(double v) noexcept
+	{
+		return {kind::floating, std::bit_cast<std::uint64_t>(v)};
+	}
+
+	cbor::kind kind() const noexcept
+	{
+		return kind_;
+	}
+
+	bool is(cbor::kind k) const noexcept
+	{
+		return kind_ == k;
+	}
+
+	/*
+	 * Accessors. The value must be of the matching kind.
+	 */
+
+	/* uint, nint (-1 - v), simple, boolean */
+	std::uint64_t as_uint() const noexcept
+	{
+		return n_;
+	}
+
+	bool as_bool() const noexcept
+	{
+		return n_ != 0;
+	}
+
+	double as_double() const noexcept
+	{
+		return std::bit_cast<double>(n_);
+	}
+
+	std::span<const std::byte> as_bytes() const noexcept
+	{
+		return {str_, static_cast<std::size_t>(n_)};
+	}
+
+	std::string_view as_text() const noexcept
+	{
+		return {reinterpret_cast<const char *>(str_),
+		    static_cast<std::size_t>(n_)};
+	}
+
+	/* array or map size */
+	std::size_t size() const noexcept
+	{
+		return n_;
+	}
+
+	std::span<value> items() noexcept
+	{
+		return {items_, static_cast<std::size_t>(n_)};
+	}
+
+	std::span<const value> items() const noexcept
+	{
+		return {items_, static_cast<std::size_t>(n_)};
+	}
+
+	std::span<member> members() noexcept;
+	std::span<const member> members() const noexcept;
+
+	value &operator[](std::size_t i) noexcept
+	{
+		return items_[i];
+	}
+
+	const value &operator[](std::size_t i) const noexcept
+	{
+		return items_[i];
+	}
+
+	/*
+	 * Map lookup. Returns nullptr if the key is not present.
+	 */
+	value *find(std::string_view key) noexcept;
+	const value *find(std::string_view key) const noexcept;
+	value *find(std::int64_t key) noexcept;
+	const value *find(std::int64_t key) const noexcept;
+
+	std::uint64_t tag_number() const noexcept
+	{
+		return n_;
+	}
+
+	value &tagged() noexcept
+	{
+		return *tagged_;
+	}
+
+	const value &tagged() const noexcept
+	{
+		return *tagged_;
+	}
+
+private:
+	friend class document;
+
+	value(cbor::kind k, std::uint64_t n) noexcept
+	: kind_{k}
+	, n_{n}
+	{ }
+
+	cbor::kind kind_ = kind::null;
+	std::uint32_t cap_ = 0;		/* array and map capacity */
+	std::uint64_t n_ = 0;		/* value, length, size or tag number */
+	union {
+		const std::byte *str_ = nullptr;
+		value *items_;
+		member *members_;
+		value *tagged_;
+	};
+};
+
+struct member {
+	value key;
+	value val;
+};
+
+inline std::span<member>
+value::members() noexcept
+{
+	return {members_, static_cast<std::size_t>(n_)};
+}
+
+inline std::span<const member>
+value::members() const noexcept
+{
+	return {members_, static_cast<std::size_t>(n_)};
+}
+
+inline value *
+value::find(std::string_view key) noexcept
+{
+	for (auto &m : members())
+		if (m.key.kind_ == kind::text && m.key.as_text() == key)
+			return &m.val;
+	return nullptr;
+}
+
+inline const value *
+value::find(std::string_view key) const noexcept
+{
+	return const_cast<value *>(this)->find(key);
+}
+
+inline value *
+value::find(std::int64_t key) noexcept
+{
+	const value k = integer(key);
+	for (auto &m : members())
+		if (m.key.kind_ == k.kind_ && m.key.n_ == k.n_)
+			return &m.val;
+	return nullptr;
+}
+
+inline const value *
+value::find(std::int64_t key) const noexcept
+{
+	return const_cast<value *>(this)->find(key);
+}
+
+class document {
+public:
+	/*
+	 * Document allocating from an internal monotonic arena which is freed
+	 * when the document is destroyed.
+	 */
+	document() noexcept
+	: mr_{&own_}
+	{ }
+
+	explicit document(std::pmr::memory_resource *mr) noexcept
+	: mr_{mr}
+	{ }
+
+	document(const document &) = delete;
+	document &operator=(const document &) = delete;
+
+	std::pmr::memory_resource *resource() const noexcept
+	{
+		return mr_;
+	}
+
+	value &root() noexcept
+	{
+		return root_;
+	}
+
+	const value &root() const noexcept
+	{
+		return root_;
+	}
+
+	/*
+	 * Replace the root with the single item in input.
+	 *
+	 * A document using its own arena frees everything allocated for it
+	 * before, so values obtained from it earlier become invalid. Memory
+	 * from a resource passed to the constructor is only returned with
+	 * that resource.
+	 *
+	 * If copy_strings is false, definite length strings refer directly to
+	 * input, which must then outlive the document. See cursor for the
+	 * meaning of trusted.
+	 */
+	errc parse(std::span<const std::byte> input, bool copy_strings = true,
+	    bool trusted = false);
+
+	/*
+	 * Value factories. Strings are copied into the document.
+	 */
+	value text(std::string_view s)
+	{
+		value v{kind::text, s.size()};
+		v.str_ = copy(s.data(), s.size());
+		return v;
+	}
+
+	value bytes(std::span<const std::byte> s)
+	{
+		value v{kind::bytes, s.size()};
+		v.str_ = copy(s.data(), s.size());
+		return v;
+	}
+
+	value array(std::size_t reserve = 0)
+	{
+		value v{kind::array, 0};
+		v.items_ = alloc<value>(reserve);
+		v.cap_ = static_cast<std::uint32_t>(reserve);
+		return v;
+	}
+
+	value map(std::size_t reserve = 0)
+	{
+		value v{kind::map, 0};
+		v.members_ = alloc<member>(reserve);
+		v.cap_ = static_cast<std::uint32_t>(reserve);
+		return v;
+	}
+
+	value tag(std::uint64_t tag, value item)
+	{
+		value v{kind::tag, tag};
+		v.tagged_ = alloc<value>(1);
+		*v.tagged_ = item;
+		return v;
+	}
+
+	/*
+	 * Container modifiers.
+	 */
+	value &append(value &array, value item)
+	{
+		grow(array, array.items_);
+		return array.items_[array.n_++] = item;
+	}
+
+	member &insert(value &map, value key, value val)
+	{
+		grow(map, map.members_);
+		return map.members_[map.n_++] = {key, val};
+	}
+
+private:
+	template<typename T>
+	T *alloc(std::size_t n)
+	{
+		if (!n)
+			return nullptr;
+		return static_cast<T *>(mr_->allocate(n * sizeof(T),
+		    alignof(T)));
+	}
+
+	const std::byte *copy(const void *s, std::size_t n)
+	{
+		auto *p = alloc<std::byte>(n);
+		if (n)
+			std::memcpy(p, s, n);
+		return p;
+	}
+
+	/* ensure room for one more element */
+	template<typename T>
+	void grow(value &c, T *&storage)
+	{
+		if (c.n_ < c.cap_)
+			return;
+		const std::size_t cap = std::max<std::size_t>(4, c.n_ * 2);
+		T *p = alloc<T>(cap);
+		if (c.n_)
+			std::memcpy(static_cast<void *>(p), storage,
+			    c.n_ * sizeof(T));
+		storage = p;
+		c.cap_ = static_cast<std::uint32_t>(
+		    std::min<std::size_t>(cap, UINT32_MAX));
+	}
+
+	/*
+	 * Append chunk to an indefinite length string whose buffer holds cap
+	 * bytes. The buffer doubles as needed, so that many small chunks
+	 * cost linear rather than quadratic memory.
+	 */
+	void concat(value &s, std::size_t &cap, const event &ev)
+	{
+		if (ev.value > cap - s.n_) {
+			cap = std::max<std::size_t>({16, 2 * cap,
+			    s.n_ + ev.value});
+			auto *p = alloc<std::byte>(cap);
+			if (s.n_)
+				std::memcpy(p, s.str_, s.n_);
+			s.str_ = p;
+		}
+		if (ev.value)
+			std::memcpy(const_cast<std::byte *>(s.str_) + s.n_,
+			    ev.data, ev.value);
+		s.n_ += ev.value;
+	}
+
+	std::pmr::monotonic_buffer_resource own_;
+	std::pmr::memory_resource *mr_;
+	value root_;
+};
+
+inline errc
+document::parse(std::span<const std::byte> input, bool copy_strings,
+    bool trusted)
+{
+	struct frame {
+		value *v;		/* container or string being built */
+		bool key;		/* maps: key of current member is set */
+		std::size_t cap = 0;	/* strings: buffer size */
+	};
+	frame stack[cursor::max_depth];
+	unsigned depth = 0;
+	value *tagged = nullptr;	/* slot for item following a tag */
+	bool done = false;
+
+	/* slot to receive the next item */
+	auto slot = [&]() -> value * {
+		if (tagged) {
+			value *v = tagged;
+			tagged = nullptr;
+			return v;
+		}
+		if (!depth)
+			return &root_;
+		frame &f = stack[depth - 1];
+		value &c = *f.v;
+		if (c.kind_ == kind::array) {
+			grow(c, c.items_);
+			return &c.items_[c.n_++];
+		}
+		if (!f.key) {
+			grow(c, c.members_);
+			f.key = true;
+			return &c.members_[c.n_].key;
+		}
+		f.key = false;
+		return &c.members_[c.n_++].val;
+	};
+
+	root_ = value{};
+	if (mr_ == &own_)
+		own_.release();
+	cursor c{input, trusted};
+	event ev;
+	for (;;) {
+		if (done && !c.depth() && !tagged)
+			return c.offset() == input.size()
+			    ? errc::ok : errc::trailing_data;
+		if (auto r = c.next(ev); r != errc::ok)
+			return r;
+		value *v;
+		switch (ev.type) {
+		case token::eof:
+			return errc::truncated;
+		case token::uint:
+			*slot() = value::uint(ev.value);
+			break;
+		case token::nint:
+			*slot() = value::nint(ev.value);
+			break;
+		case token::bytes:
+		case token::text:
+			if (depth && !stack[depth - 1].v->is(kind::map) &&
+			    !stack[depth - 1].v->is(kind::array)) {
+				concat(*stack[depth - 1].v,
+				    stack[depth - 1].cap, ev);
+				continue;
+			}
+			v = slot();
+			*v = value{ev.type == token::bytes
+			    ? kind::bytes : kind::text, ev.value};
+			v->str_ = copy_strings
+			    ? copy(ev.data, ev.value) : ev.data;
+			break;
+		case token::bytes_begin:
+		case token::text_begin:
+			v = slot();
+			*v = value{ev.type == token::bytes_begin
+			    ? kind::bytes : kind::text, 0};
+			stack[depth++] = {v, false};
+			continue;
+		case token::array_begin:
+			v = slot();
+			*v = array(ev.is_indefinite() ? 0 : ev.value);
+			stack[depth++] = {v, false};
+			continue;
+		case token::map_begin:
+			v = slot();
+			*v = map(ev.is_indefinite() ? 0 : ev.value);
+			stack[depth++] = {v, false};
+			continue;
+		case token::bytes_end:
+		case token::text_end:
+		case token::array_end:
+		case token::map_end:
+			--depth;
+			break;
+		case token::tag:
+			v = slot();
+			*v = tag(ev.value, value{});
+			tagged = v->tagged_;
+			continue;
+		case token::simple:
+			*slot() = value::simple(static_cast<std::uint8_t>(
+			    ev.value));
+			break;
+		case token::boolean:
+			*slot() = value::boolean(ev.value);
+			break;
+		case token::null:
+			*slot() = value::null();
+			break;
+		case token::undefined:
+			*slot() = value::undefined();
+			break;
+		case token::floating:
+			*slot() = value::floating(ev.floating());
+			break;
+		}
+		done = true;
+	}
+}
+
+/*
+ * Encode a value tree.
+ */
+template<typename Sink>
+inline void
+encode(encoder<Sink> &enc, const value &v)
+{
+	switch (v.kind()) {
+	case kind::uint:
+		enc.uint(v.as_uint());
+		break;
+	case kind::nint:
+		enc.nint(v.as_uint());
+		break;
+	case kind::bytes:
+		enc.bytes(v.as_bytes());
+		break;
+	case kind::text:
+		enc.text(v.as_text());
+		break;
+	case kind::array:
+		enc.array(v.size());
+		for (const auto &i : v.items())
+			encode(enc, i);
+		break;
+	case kind::map:
+		enc.map(v.size());
+		for (const auto &m : v.members()) {
+			encode(enc, m.key);
+			encode(enc, m.val);
+		}
+		break;
+	case kind::tag:
+		enc.tag(v.tag_number());
+		encode(enc, v.tagged());
+		break;
+	case kind::simple:
+		enc.simple(static_cast<std::uint8_t>(v.as_uint()));
+		break;
+	case kind::boolean:
+		enc.boolean(v.as_bool());
+		break;
+	case kind::null:
+		enc.null();
+		break;
+	case kind::undefined:
+		enc.undefined();
+		break;
+	case kind::floating:
+		enc.floating(v.as_double());
+		break;
+	}
+}
+
+}
@@ -0,0 +1,546 @@
+#pragma once
+
+/*
+ * Streaming encoder.
+ *
+ * Heads and payloads are written straight into a sink (see sink.h) in a
+ * single pass. Errors are sticky: once an operation fails all following
+ * operations are ignored and status() reports the first error, so a whole
+ * message can be encoded before checking once.
+ *
+ * Example:
+ *
+ *	std::byte buf[256];
+ *	cbor::span_sink sink{buf};
+ *	cbor::encoder enc{sink};
+ *	enc.map(2);
+ *	enc.text("id");
+ *	enc.uint(42);
+ *	enc.text("name");
+ *	enc.text(name);
+ *	if (enc.status() != cbor::errc::ok)
+ *		...
+ *	send(sink.data());
+ *
+ * Heads are always written in their shortest form and floating point values
+ * in the shortest of binary16, binary32 and binary64 which holds them
+ * exactly (preferred serialization, RFC 8949 section 4.1). An encoder
+ * constructed with cbor::deterministic also produces the core deterministic
+ * encoding of RFC 8949 section 4.2.1: map entries may be written in any
+ * order and are sorted by the bytes of their encoded keys as each map is
+ * completed, duplicate keys and indefinite lengths are errors, and every NaN
+ * is written as 0xf97e00. The sink must expose the bytes written so far
+ * through data().
+ */
+
+#include "half.h"
+#include "sink.h"
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace cbor {
+
+/*
+ * Selects deterministic encoding.
+ */
+struct deterministic_t {
+	explicit deterministic_t() = default;
+};
+
+inline constexpr deterministic_t deterministic{};
+
+namespace detail {
+
+/*
+ * Largest room Sink can prepare at once.
+ */
+template<typename Sink>
+constexpr std::size_t
+sink_capacity() noexcept
+{
+	if constexpr (requires { Sink::capacity; })
+		return Sink::capacity;
+	else
+		return SIZE_MAX;
+}
+
+/*
+ * Shortest string entered in a stringref namespace holding n strings;
+ * shorter strings would not be longer than a reference to them.
+ */
+inline constexpr std::size_t
+stringref_min_length(std::uint64_t n) noexcept
+{
+	return n < 24 ? 3 : n < 256 ? 4 : n < 65536 ? 5
+	    : n < 4294967296 ? 7 : 11;
+}
+
+struct string_hash {
+	using is_transparent = void;
+
+	std::size_t operator()(std::string_view s) const noexcept
+	{
+		return std::hash<std::string_view>{}(s);
+	}
+};
+
+/* strings of one stringref namespace and their indices */
+struct stringref_table {
+	using map = std::unordered_map<std::string, std::uint64_t,
+	    string_hash, std::equal_to<>>;
+
+	map text;
+	map bytes;
+	std::uint64_t size = 0;
+};
+
+}
+
+template<typename Sink>
+class encoder {
+public:
+	explicit encoder(Sink &sink) noexcept
+	: sink_{sink}
+	{ }
+
+	encoder(Sink &sink, deterministic_t) noexcept
+	requires requires (Sink &s) {
+		{ s.data() } -> std::convertible_to<std::span<std::byte>>;
+	}
+	: sink_{sink}
+	, det_{true}
+	{ }
+
+	errc status() const noexcept
+	{
+		return err_;
+	}
+
+	Sink &sink() noexcept
+	{
+		return sink_;
+	}
+
+	/*
+	 * Hint that at least n bytes will be encoded.
+	 */
+	void reserve(std::size_t n)
+	{
+		if constexpr (requires { sink_.reserve(n); })
+			sink_.reserve(n);
+	}
+
+	void uint(std::uint64_t v)
+	{
+		head(major::uint, v);
+		item();
+	}
+
+	/* negative integer -1 - v */
+	void nint(std::uint64_t v)
+	{
+		head(major::nint, v);
+		item();
+	}
+
+	void integer(std::int64_t v)
+	{
+		/* -1 - v == ~v for negative v */
+		const std::uint64_t sign = static_cast<std::uint64_t>(v >> 63);
+		head(static_cast<major>(sign & 1),
+		    static_cast<std::uint64_t>(v) ^ sign);
+		item();
+	}
+
+	void bytes(std::span<const std::byte> s)
+	{
+		if (stringref(false, {reinterpret_cast<const char *>(s.data()),
+		    s.size()}))
+			return;
+		head(major::bytes, s.size());
+		payload(s);
+		item();
+	}
+
+	/*
+	 * Byte string of n bytes produced in place. fill(std::span<std::byte>)
+	 * is called for successive pieces of at most piece_size bytes until
+	 * the payload is complete. Pieces are no larger than the sink's
+	 * capacity, if it has one.
+	 */
+	static constexpr std::size_t piece_size = std::min<std::size_t>(4096,
+	    detail::sink_capacity<Sink>());
+
+	template<typename Fill>
+	void bytes(std::size_t n, Fill &&fill)
+	{
+		/* a decoder enters the string in the namespace, so must we */
+		std::string entered;
+		const bool enter = !refs_.empty() && !chunked_ &&
+		    n >= detail::stringref_min_length(refs_.back().size);
+		head(major::bytes, n);
+		while (n) {
+			const std::size_t len = std::min(n, piece_size);
+			std::byte *p = prepare(len);
+			if (!p)
+				return;
+			fill(std::span<std::byte>{p, len});
+			if (enter)
+				entered.append(reinterpret_cast<const char *>(p),
+				    len);
+			sink_.commit(len);
+			n -= len;
+		}
+		if (enter) {
+			auto &t = refs_.back();
+			t.bytes.emplace(std::move(entered), t.size++);
+		}
+		item();
+	}
+
+	void text(std::string_view s)
+	{
+		if (stringref(true, s))
+			return;
+		head(major::text, s.size());
+		payload({reinterpret_cast<const std::byte *>(s.data()),
+		    s.size()});
+		item();
+	}
+
+	/*
+	 * Indefinite length strings. Follow with chunks and end().
+	 */
+	void bytes_begin()
+	{
+		indefinite_head(major::bytes);
+		chunked_ = true;
+	}
+
+	void text_begin()
+	{
+		indefinite_head(major::text);
+		chunked_ = true;
+	}
+
+	/*
+	 * Arrays and maps. Definite length containers must be followed by
+	 * size items or pairs; indefinite length containers by end().
+	 */
+	void array(std::uint64_t size = indefinite)
+	{
+		if (size == indefinite)
+			indefinite_head(major::array);
+		else {
+			head(major::array, size);
+			open(size, false);
+		}
+	}
+
+	void map(std::uint64_t size = indefinite)
+	{
+		if (size == indefinite)
+			indefinite_head(major::map);
+		else {
+			head(major::map, size);
+			open(size, true);
+		}
+	}
+
+	/*
+	 * Terminate an indefinite length string, array or map.
+	 */
+	void end()
+	{
+		indefinite_head(major::simple);
+		chunked_ = false;
+	}
+
+	void tag(std::uint64_t tag)
+	{
+		head(major::tag, tag);
+	}
+
+	void boolean(bool v)
+	{
+		initial(major::simple, 20 + v);
+		item();
+	}
+
+	void null()
+	{
+		initial(major::simple, 22);
+		item();
+	}
+
+	void undefined()
+	{
+		initial(major::simple, 23);
+		item();
+	}
+
+	void simple(std::uint8_t v)
+	{
+		if (v >= ai_1byte && v < 32)
+			fail(errc::malformed);
+		else
+			head(major::simple, v);
+		item();
+	}
+
+	void floating(double v)
+	{
+		std::uint64_t d = std::bit_cast<std::uint64_t>(v);
+		std::uint32_t f;
+		std::uint16_t h;
+		if (det_ && v != v)
+			d = 0x7ff8000000000000;
+		if (!detail::double_to_float(d, f))
+			fixed(ai_8byte, d);
+		else if (!detail::float_to_half(f, h))
+			fixed(ai_4byte, f);
+		else
+			fixed(ai_2byte, h);
+		item();
+	}
+
+	/*
+	 * Stringref namespace (tag 256, see stringref.h). Definite length
+	 * strings written between stringrefs_begin and stringrefs_end which
+	 * repeat an earlier one are written as a reference to it (tag 25).
+	 * The namespace covers exactly the one item following the tag, so
+	 * stringrefs_end must be called once that item is complete.
+	 * Namespaces nest. Not available in deterministic mode, as sorting
+	 * map entries would move references before their strings.
+	 */
+	void stringrefs_begin()
+	{
+		if (det_)
+			return fail(errc::not_deterministic);
+		head(major::tag, 256);
+		refs_.emplace_back();
+	}
+
+	void stringrefs_end()
+	{
+		if (!refs_.empty())
+			refs_.pop_back();
+	}
+
+	/*
+	 * Write pre-encoded CBOR. In deterministic mode s must be a single
+	 * item in deterministic form. Inside a stringref namespace s must not
+	 * contain strings which would be entered in it.
+	 */
+	void raw(std::span<const std::byte> s)
+	{
+		payload(s);
+		item();
+	}
+
+private:
+	void fail(errc e) noexcept
+	{
+		if (err_ == errc::ok)
+			err_ = e;
+	}
+
+	std::byte *prepare(std::size_t n)
+	{
+		if (err_ != errc::ok)
+			return nullptr;
+		std::byte *p = sink_.prepare(n);
+		if (!p)
+			fail(errc::no_space);
+		return p;
+	}
+
+	void initial(major type, std::uint8_t ai)
+	{
+		if (std::byte *p = prepare(1)) {
+			*p = std::byte(static_cast<std::uint8_t>(type) << 5 | ai);
+			sink_.commit(1);
+		}
+	}
+
+	void head(major type, std::uint64_t arg)
+	{
+		if (std::byte *p = prepare(head_size(arg)))
+			sink_.commit(write_head(p, type, arg));
+	}
+
+	/* head with a fixed size argument */
+	template<typename T>
+	void fixed(std::uint8_t ai, T arg)
+	{
+		if (std::byte *p = prepare(1 + sizeof arg)) {
+			p[0] = std::byte(7 << 5 | ai);
+			detail::store_be(p + 1, arg);
+			sink_.commit(1 + sizeof arg);
+		}
+	}
+
+	void payload(std::span<const std::byte> s)
+	{
+		if (err_ != errc::ok || s.empty())
+			return;
+		if constexpr (requires { sink_.write(s); }) {
+			if (!sink_.write(s))
+				fail(errc::no_space);
+		} else if (std::byte *p = prepare(s.size())) {
+			std::memcpy(p, s.data(), s.size());
+			sink_.commit(s.size());
+		}
+	}
+
+	/*
+	 * Write s as a reference if it is in the innermost stringref
+	 * namespace, otherwise enter it if it is long enough.
+	 */
+	bool stringref(bool text, std::string_view s)
+	{
+		if (refs_.empty() || chunked_)
+			return false;
+		auto &t = refs_.back();
+		auto &m = text ? t.text : t.bytes;
+		if (auto i = m.find(s); i != m.end()) {
+			head(major::tag, 25);
+			head(major::uint, i->second);
+			item();
+			return true;
+		}
+		if (s.size() >= detail::stringref_min_length(t.size))
+			m.emplace(s, t.size++);
+		return false;
+	}
+
+	void indefinite_head(major type)
+	{
+		if (det_)
+			fail(errc::not_deterministic);
+		else
+			initial(type, ai_indefinite);
+	}
+
+	/*
+	 * Deterministic mode bookkeeping. Each open definite container has a
+	 * frame counting the items it still needs. Maps also record the sink
+	 * offset of their first key and of the end of every item in bounds_,
+	 * from which the entries are sorted once the last value is written.
+	 */
+	struct frame {
+		std::uint64_t remaining;
+		std::size_t bounds;	/* maps: index of first offset in bounds_ */
+		bool map;
+	};
+
+	/* sort key of an encoded map entry */
+	struct entry {
+		std::uint64_t prefix;	/* first 8 key bytes, big endian */
+		std::size_t key;	/* offset of key */
+		std::size_t len;	/* length of key */
+		std::size_t end;	/* offset past value */
+	};
+
+	void open(std::uint64_t size, bool map)
+	{
+		if (!det_ || err_ != errc::ok)
+			return;
+		if (!size) {
+			item();
+			return;
+		}
+		if constexpr (requires { sink_.data(); }) {
+			const std::size_t b = bounds_.size();
+			if (map)
+				bounds_.push_back(sink_.data().size());
+			frames_.push_back({map ? size * 2 : size, b, map});
+		}
+	}
+
+	/* an item is complete */
+	void item()
+	{
+		if constexpr (requires { sink_.data(); }) {
+			while (!frames_.empty() && err_ == errc::ok) {
+				frame &f = frames_.back();
+				if (f.map)
+					bounds_.push_back(sink_.data().size());
+				if (--f.remaining)
+					return;
+				if (f.map)
+					sort_map(f.bounds);
+				frames_.pop_back();
+			}
+		}
+	}
+
+	static bool before(const std::byte *base, const entry &a,
+	    const entry &b) noexcept
+	{
+		if (a.prefix != b.prefix)
+			return a.prefix < b.prefix;
+		const int c = std::memcmp(base + a.key, base + b.key,
+		    std::min(a.len, b.len));
+		return c < 0 || (c == 0 && a.len < b.len);
+	}
+
+	/* called only for sinks with data() */
+	void sort_map(std::size_t first)
+	{
+		std::byte *base = sink_.data().data();
+		const std::size_t *b = bounds_.data() + first;
+		const std::size_t n = (bounds_.size() - first - 1) / 2;
+		const std::size_t start = b[0];
+		const std::size_t stop = b[2 * n];
+
+		/* most maps are written in order already */
+		entries_.clear();
+		bool sorted = true;
+		for (std::size_t i = 0; i < n; ++i) {
+			const std::size_t k = b[2 * i];
+			const std::size_t len = b[2 * i + 1] - k;
+			std::byte pfx[8] = {};
+			std::memcpy(pfx, base + k, std::min<std::size_t>(len, 8));
+			entries_.push_back({detail::load_be<std::uint64_t>(pfx), k,
+			    len, b[2 * i + 2]});
+			if (i && !before(base, entries_[i - 1], entries_[i]))
+				sorted = false;
+		}
+		bounds_.resize(first);
+		if (sorted)
+			return;
+
+		std::sort(entries_.begin(), entries_.end(),
+		    [base](const entry &x, const entry &y) {
+			return before(base, x, y);
+		});
+		for (std::size_t i = 1; i < n; ++i)
+			if (!before(base, entries_[i - 1], entries_[i]))
+				return fail(errc::duplicate_key);
+
+		scratch_.assign(base + start, base + stop);
+		std::byte *out = base + start;
+		for (const entry &e : entries_) {
+			const std::size_t len = e.end - e.key;
+			std::memcpy(out, scratch_.data() + (e.key - start), len);
+			out += len;
+		}
+	}
+
+	Sink &sink_;
+	errc err_ = errc::ok;
+	bool det_ = false;
+	bool chunked_ = false;	/* inside an indefinite length string */
+	std::vector<detail::stringref_table> refs_;
+	std::vector<frame> frames_;
+	std::vector<std::size_t> bounds_;
+	std::vector<entry> entries_;
+	std::vector<std::byte> scratch_;
+};
+
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+/*
+ * Floating point width conversions for preferred serialization.
+ *
+ * RFC 8949 section 4.1 prefers the shortest of binary16, binary32 and
+ * binary64 which represents a value exactly. The narrowing checks here
+ * work on the bit patterns with shifts and masks only, so they compile to
+ * straight line code; when F16C is enabled (-mf16c or -march) or on
+ * AArch64 the binary16 conversions use the hardware instructions.
+ */
+
+#include <bit>
+#include <cstdint>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace cbor {
+
+namespace detail {
+
+/*
+ * Convert IEEE 754 binary16 to binary64.
+ */
+inline double
+half_to_double(std::uint16_t h) noexcept
+{
+#if defined(__F16C__)
+	return _cvtsh_ss(h);
+#elif defined(__aarch64__)
+	return std::bit_cast<__fp16>(h);
+#else
+	const std::uint64_t sign = static_cast<std::uint64_t>(h & 0x8000) << 48;
+	const unsigned exp = (h >> 10) & 0x1f;
+	std::uint64_t mant = h & 0x3ff;
+	if (exp == 0x1f)
+		return std::bit_cast<double>(sign | 0x7ff0000000000000 | mant << 42);
+	if (exp != 0)
+		return std::bit_cast<double>(sign |
+		    static_cast<std::uint64_t>(exp + 1008) << 52 | mant << 42);
+	if (mant == 0)
+		return std::bit_cast<double>(sign);
+	/* subnormal: normalise mantissa */
+	const int shift = std::countl_zero(mant) - 53;
+	mant = (mant << shift) & 0x3ff;
+	return std::bit_cast<double>(sign |
+	    static_cast<std::uint64_t>(1009 - shift) << 52 | mant << 42);
+#endif
+}
+
+/*
+ * Narrow binary64 bits d to binary32 bits f if no information is lost.
+ * NaN payloads are kept and must fit.
+ */
+inline bool
+double_to_float(std::uint64_t d, std::uint32_t &f) noexcept
+{
+	const auto sign = static_cast<std::uint32_t>(d >> 32) & 0x80000000;
+	const auto exp = static_cast<unsigned>(d >> 52) & 0x7ff;
+	const std::uint64_t mant = d & 0xfffffffffffff;
+
+	/* binary32 normal: exponent 897..1150, 23 mantissa bits */
+	const bool normal = exp - 897 <= 1150 - 897 &&
+	    !(mant & 0x1fffffff);
+	const auto fn = sign | (exp - 896) << 23 |
+	    static_cast<std::uint32_t>(mant >> 29);
+
+	/* binary32 subnormal: exponent 874..896 */
+	const std::uint64_t sig = mant | std::uint64_t{1} << 52;
+	const unsigned shift = (926 - exp) & 63;
+	const bool sub = exp - 874 <= 896 - 874 &&
+	    !(sig & ((std::uint64_t{1} << shift) - 1));
+	const auto fs = sign | static_cast<std::uint32_t>(sig >> shift);
+
+	/* infinity and NaN */
+	const bool special = exp == 0x7ff && !(mant & 0x1fffffff);
+	const auto fi = sign | 0x7f800000 |
+	    static_cast<std::uint32_t>(mant >> 29);
+
+	const bool zero = !(d << 1);
+
+	f = normal ? fn : sub ? fs : special ? fi : sign;
+	return normal | sub | special | zero;
+}
+
+/*
+ * Narrow binary32 bits f to binary16 bits h if no information is lost.
+ * NaN payloads are kept and must fit.
+ */
+inline bool
+float_to_half(std::uint32_t f, std::uint16_t &h) noexcept
+{
+#if defined(__F16C__)
+	const float v = std::bit_cast<float>(f);
+	h = _cvtss_sh(v, _MM_FROUND_TO_NEAREST_INT);
+	return std::bit_cast<std::uint32_t>(_cvtsh_ss(h)) == f;
+#else
+	const auto sign = static_cast<std::uint16_t>((f >> 16) & 0x8000);
+	const unsigned exp = (f >> 23) & 0xff;
+	const std::uint32_t mant = f & 0x7fffff;
+
+	/* binary16 normal: exponent 113..142, 10 mantissa bits */
+	const bool normal = exp - 113 <= 142 - 113 && !(mant & 0x1fff);
+	const auto hn = static_cast<std::uint16_t>(sign | (exp - 112) << 10 |
+	    mant >> 13);
+
+	/* binary16 subnormal: exponent 103..112 */
+	const std::uint32_t sig = mant | 0x800000;
+	const unsigned shift = (126 - exp) & 31;
+	const bool sub = exp - 103 <= 112 - 103 &&
+	    !(sig & ((std::uint32_t{1} << shift) - 1));
+	const auto hs = static_cast<std::uint16_t>(sign | sig >> shift);
+
+	/* infinity and NaN */
+	const bool special = exp == 0xff && !(mant & 0x1fff);
+	const auto hi = static_cast<std::uint16_t>(sign | 0x7c00 | mant >> 13);
+
+	const bool zero = !(f << 1);
+
+	h = normal ? hn : sub ? hs : special ? hi : sign;
+	return normal | sub | special | zero;
+#endif
+}
+
+}
+
+}
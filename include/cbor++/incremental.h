@@ -0,0 +1,236 @@
+#pragma once
+
+/*
+ * Resumable decoder for input arriving in fragments.
+ *
+ * An incremental_decoder carries the same nesting state as a cursor across
+ * calls, so input can be fed as it arrives and decoding resumes exactly
+ * where it stopped. Only an incomplete item head (at most 8 bytes) is ever
+ * left unconsumed; the caller must present those bytes again at the start
+ * of the next input.
+ *
+ * A definite length string which is not entirely present in the input is
+ * delivered like an indefinite length string: a bytes_begin or text_begin
+ * token whose value is the total length, one bytes or text token per
+ * fragment, and a bytes_end or text_end token. A chunk of an indefinite
+ * length string which is split across inputs is delivered as several
+ * chunks. Complete strings are returned as views into the input. Text split
+ * across inputs is validated as UTF-8 as it arrives, even when a fragment
+ * ends inside a code point.
+ *
+ * Example:
+ *
+ *	cbor::incremental_decoder d;
+ *	cbor::event ev;
+ *	std::size_t used;
+ *	for (;;) {
+ *		auto r = d.next({buf + pos, len - pos}, used, ev);
+ *		if (r == cbor::errc::truncated) {
+ *			// keep buf[pos, len), read at least d.needed() bytes
+ *			continue;
+ *		}
+ *		if (r != cbor::errc::ok)
+ *			fail(r);
+ *		pos += used;
+ *		handle(ev);
+ *	}
+ */
+
+#include "cursor.h"
+
+#include <algorithm>
+
+namespace cbor {
+
+class incremental_decoder {
+public:
+	/*
+	 * See cursor for the meaning of trusted.
+	 */
+	explicit incremental_decoder(bool trusted = false) noexcept
+	{
+		c_.stream_ = true;
+		c_.trusted_ = trusted;
+	}
+
+	/*
+	 * Decode the next token from in.
+	 *
+	 * On success consumed is set to the number of bytes of in which were
+	 * used and ev.offset is relative to the start of the stream. When all
+	 * input has been consumed between top level items ev.type is set to
+	 * token::eof. Returns errc::truncated if more input is required.
+	 */
+	errc next(std::span<const std::byte> in, std::size_t &consumed,
+	    event &ev) noexcept;
+
+	/*
+	 * Minimum number of additional bytes required to make progress after
+	 * next returned errc::truncated.
+	 */
+	std::size_t needed() const noexcept
+	{
+		return needed_;
+	}
+
+	/*
+	 * Number of bytes consumed from the stream so far.
+	 */
+	std::uint64_t offset() const noexcept
+	{
+		return offset_;
+	}
+
+	unsigned depth() const noexcept
+	{
+		return c_.depth();
+	}
+
+	bool at_key() const noexcept
+	{
+		return !frag_ && !frag_end_ && c_.at_key();
+	}
+
+private:
+	static std::size_t head_length(std::uint8_t ai) noexcept
+	{
+		switch (ai) {
+		case ai_1byte:
+			return 2;
+		case ai_2byte:
+			return 3;
+		case ai_4byte:
+			return 5;
+		case ai_8byte:
+			return 9;
+		default:
+			return 1;
+		}
+	}
+
+	errc split(std::span<const std::byte> in, std::size_t &consumed,
+	    event &ev) noexcept;
+
+	/* validate a fragment of split text */
+	bool check_text(const std::byte *p, std::size_t n) noexcept
+	{
+		if (frag_type_ != token::text || c_.trusted_)
+			return true;
+		return utf8_.feed(p, n) && (frag_ || utf8_.finish());
+	}
+
+	cursor c_;
+	std::uint64_t offset_ = 0;
+	std::uint64_t frag_ = 0;	/* bytes of split string remaining */
+	std::size_t needed_ = 0;
+	token frag_type_ = token::bytes;
+	bool frag_chunk_ = false;	/* split string is a chunk */
+	bool frag_end_ = false;		/* split string end is pending */
+	utf8_stream utf8_;		/* state for split text */
+};
+
+inline errc
+incremental_decoder::next(std::span<const std::byte> in,
+    std::size_t &consumed, event &ev) noexcept
+{
+	consumed = 0;
+	ev.offset = offset_;
+	ev.data = nullptr;
+	ev.ai = 0;
+
+	if (frag_end_) {
+		frag_end_ = false;
+		ev.type = frag_type_ == token::bytes
+		    ? token::bytes_end : token::text_end;
+		ev.value = 0;
+		c_.complete();
+		return errc::ok;
+	}
+
+	if (frag_) {
+		if (in.empty()) {
+			needed_ = 1;
+			return errc::truncated;
+		}
+		const std::size_t n = std::min<std::uint64_t>(frag_, in.size());
+		ev.type = frag_type_;
+		ev.value = n;
+		ev.data = in.data();
+		frag_ -= n;
+		if (!check_text(in.data(), n))
+			return errc::invalid_utf8;
+		consumed = n;
+		offset_ += n;
+		if (!frag_) {
+			if (frag_chunk_)
+				c_.complete();
+			else
+				frag_end_ = true;
+		}
+		return errc::ok;
+	}
+
+	c_.begin_ = c_.pos_ = in.data();
+	c_.end_ = in.data() + in.size();
+	if (auto r = c_.next(ev); r != errc::truncated) {
+		if (r == errc::ok) {
+			consumed = c_.offset();
+			ev.offset += offset_;
+			offset_ += consumed;
+		}
+		return r;
+	}
+	return split(in, consumed, ev);
+}
+
+/*
+ * Handle truncated input: either the head is incomplete, or the payload of
+ * a definite length string is.
+ */
+inline errc
+incremental_decoder::split(std::span<const std::byte> in,
+    std::size_t &consumed, event &ev) noexcept
+{
+	if (in.empty()) {
+		needed_ = 1;
+		return errc::truncated;
+	}
+
+	const std::byte *p = in.data();
+	const std::byte *end = p + in.size();
+	head h{};
+	if (read_head(p, end, h) != errc::ok) {
+		needed_ = head_length(h.ai) - in.size();
+		return errc::truncated;
+	}
+
+	const std::size_t hlen = p - in.data();
+	const std::size_t avail = end - p;
+	ev.offset = offset_;
+	frag_type_ = h.type == major::bytes ? token::bytes : token::text;
+	frag_chunk_ = c_.depth_ &&
+	    (c_.stack_[c_.depth_ - 1].type == token::bytes_begin ||
+	    c_.stack_[c_.depth_ - 1].type == token::text_begin);
+	c_.tagged_ = false;
+
+	if (frag_chunk_) {
+		ev.type = frag_type_;
+		ev.value = avail;
+		ev.data = p;
+		frag_ = h.arg - avail;
+		if (!check_text(p, avail))
+			return errc::invalid_utf8;
+		consumed = in.size();
+	} else {
+		ev.type = frag_type_ == token::bytes
+		    ? token::bytes_begin : token::text_begin;
+		ev.ai = h.ai;
+		ev.value = h.arg;
+		frag_ = h.arg;
+		consumed = hlen;
+	}
+	offset_ += consumed;
+	return errc::ok;
+}
+
+}
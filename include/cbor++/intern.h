@@ -0,0 +1,352 @@
+#pragma once
+
+/*
+ * Interning of map keys across messages.
+ *
+ * key_interner assigns small consecutive integer ids to strings and keeps
+ * them for its lifetime, so that one interner per connection or stream
+ * turns the text keys of every message into ids which can be compared,
+ * switched on or used as array indices instead of strings. The table is
+ * open addressed in groups of 16 one byte hash tags which are matched
+ * against a key with a single SIMD comparison (SSE2 or NEON), so a lookup
+ * usually hashes the key once and compares it with one stored key.
+ *
+ * interning_cursor works like a cursor and interns each text map key as
+ * it is read. Indefinite length keys are joined and reported as a single
+ * text string.
+ *
+ * The number of keys is bounded, so that a peer sending a new key with
+ * every message cannot grow the table without limit; keys past the bound
+ * are not interned.
+ *
+ * Example:
+ *
+ *	cbor::key_interner keys;	// per connection
+ *	const std::uint32_t ts = keys.intern("ts");
+ *	...
+ *	cbor::interning_cursor c{msg, keys};
+ *	cbor::event ev;
+ *	while (c.next(ev) == cbor::errc::ok && ev.type != cbor::token::eof)
+ *		if (c.key_id() == ts)
+ *			...
+ */
+
+#include "cursor.h"
+
+#include <bit>
+#include <cstring>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace cbor {
+
+namespace detail {
+
+/*
+ * Hash of a key, 8 bytes at a time. Keys are mostly short, so this does
+ * as little per byte as gives usable tags and group indices.
+ */
+inline std::uint64_t
+intern_hash(const char *p, std::size_t n) noexcept
+{
+	constexpr std::uint64_t k = 0x9e3779b97f4a7c15;
+	std::uint64_t h = n * k;
+	std::uint64_t v;
+	for (; n >= 8; p += 8, n -= 8) {
+		std::memcpy(&v, p, 8);
+		h = (h ^ v) * k;
+		h ^= h >> 32;
+	}
+	if (n) {
+		v = 0;
+		std::memcpy(&v, p, n);
+		h = (h ^ v) * k;
+	}
+	h ^= h >> 29;
+	h *= 0xbf58476d1ce4e5b9;
+	return h ^ (h >> 32);
+}
+
+/*
+ * Bit i is set if control byte i of the group of 16 at p equals b.
+ */
+inline unsigned
+key_group_match(const std::uint8_t *p, std::uint8_t b) noexcept
+{
+#if defined(__SSE2__)
+	const __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+	return static_cast<unsigned>(_mm_movemask_epi8(
+	    _mm_cmpeq_epi8(g, _mm_set1_epi8(static_cast<char>(b)))));
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	static constexpr std::uint8_t bits[16] = {
+		1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128,
+	};
+	const uint8x16_t m = vandq_u8(vceqq_u8(vld1q_u8(p), vdupq_n_u8(b)),
+	    vld1q_u8(bits));
+	return vaddv_u8(vget_low_u8(m)) |
+	    static_cast<unsigned>(vaddv_u8(vget_high_u8(m))) << 8;
+#else
+	unsigned m = 0;
+	for (unsigned i = 0; i < 16; ++i)
+		m |= static_cast<unsigned>(p[i] == b) << i;
+	return m;
+#endif
+}
+
+}
+
+class key_interner {
+public:
+	static constexpr std::uint32_t npos = UINT32_MAX;
+
+	/*
+	 * Interner holding at most max_keys keys.
+	 */
+	explicit key_interner(std::size_t max_keys = 1 << 16) noexcept
+	: max_{max_keys < npos ? max_keys : npos - 1}
+	{ }
+
+	key_interner(const key_interner &) = delete;
+	key_interner &operator=(const key_interner &) = delete;
+
+	/*
+	 * Id of key, which is added if it is new. Returns npos if the
+	 * interner is full.
+	 */
+	std::uint32_t intern(std::string_view key);
+
+	/*
+	 * Id of key, or npos if it has not been interned.
+	 */
+	std::uint32_t find(std::string_view key) const noexcept
+	{
+		if (ctrl_.empty())
+			return npos;
+		std::uint32_t id;
+		probe(key, detail::intern_hash(key.data(), key.size()), id);
+		return id;
+	}
+
+	/*
+	 * Key with the given id. The view stays valid until clear.
+	 */
+	std::string_view key(std::uint32_t id) const noexcept
+	{
+		return keys_[id];
+	}
+
+	std::size_t size() const noexcept
+	{
+		return keys_.size();
+	}
+
+	/*
+	 * Forget all keys. Ids are assigned from 0 again.
+	 */
+	void clear() noexcept
+	{
+		ctrl_.clear();
+		slots_.clear();
+		keys_.clear();
+		hashes_.clear();
+		arena_.release();
+	}
+
+private:
+	static constexpr std::uint8_t empty = 0x80;
+	static constexpr std::size_t group = 16;
+
+	std::size_t probe(std::string_view key, std::uint64_t h,
+	    std::uint32_t &id) const noexcept;
+	void grow();
+
+	std::size_t max_;
+	std::vector<std::uint8_t> ctrl_;	/* hash tags, or empty */
+	std::vector<std::uint32_t> slots_;	/* ids */
+	std::vector<std::string_view> keys_;	/* by id, in arena_ */
+	std::vector<std::uint64_t> hashes_;	/* by id */
+	std::pmr::monotonic_buffer_resource arena_;
+};
+
+/*
+ * Look key up, visiting groups in triangular order, which reaches every
+ * group of a power of two table. Sets id to npos if key is not present
+ * and returns the first free slot for it.
+ */
+inline std::size_t
+key_interner::probe(std::string_view key, std::uint64_t h,
+    std::uint32_t &id) const noexcept
+{
+	const std::size_t mask = ctrl_.size() / group - 1;
+	const auto tag = static_cast<std::uint8_t>(h & 0x7f);
+	std::size_t g = (h >> 7) & mask;
+	for (std::size_t step = 1;; ++step) {
+		const std::uint8_t *p = ctrl_.data() + g * group;
+		for (unsigned m = detail::key_group_match(p, tag); m;
+		    m &= m - 1) {
+			const std::uint32_t i = slots_[g * group +
+			    std::countr_zero(m)];
+			if (hashes_[i] == h && keys_[i] == key) {
+				id = i;
+				return 0;
+			}
+		}
+		if (const unsigned m = detail::key_group_match(p, empty)) {
+			id = npos;
+			return g * group + std::countr_zero(m);
+		}
+		g = (g + step) & mask;
+	}
+}
+
+/*
+ * Double the table, keeping it at most 7/8 full so that probes stay short
+ * and always find a free slot.
+ */
+inline void
+key_interner::grow()
+{
+	const std::size_t n = ctrl_.empty() ? 4 * group : 2 * ctrl_.size();
+	ctrl_.assign(n, empty);
+	slots_.assign(n, 0);
+	for (std::uint32_t i = 0; i < keys_.size(); ++i) {
+		std::uint32_t id;
+		const std::size_t s = probe(keys_[i], hashes_[i], id);
+		ctrl_[s] = static_cast<std::uint8_t>(hashes_[i] & 0x7f);
+		slots_[s] = i;
+	}
+}
+
+inline std::uint32_t
+key_interner::intern(std::string_view key)
+{
+	if (ctrl_.empty())
+		grow();
+	const std::uint64_t h = detail::intern_hash(key.data(), key.size());
+	std::uint32_t id;
+	std::size_t s = probe(key, h, id);
+	if (id != npos)
+		return id;
+	if (keys_.size() >= max_)
+		return npos;
+	if (keys_.size() + 1 > ctrl_.size() / 8 * 7) {
+		grow();
+		s = probe(key, h, id);
+	}
+
+	auto *p = static_cast<char *>(arena_.allocate(key.size() ? key.size()
+	    : 1, 1));
+	if (!key.empty())
+		std::memcpy(p, key.data(), key.size());
+	id = static_cast<std::uint32_t>(keys_.size());
+	keys_.emplace_back(p, key.size());
+	hashes_.push_back(h);
+	ctrl_[s] = static_cast<std::uint8_t>(h & 0x7f);
+	slots_[s] = id;
+	return id;
+}
+
+class interning_cursor {
+public:
+	static constexpr unsigned max_depth = cbor::max_depth;
+
+	/*
+	 * Cursor interning keys in keys, which must outlive it. See cursor
+	 * for the meaning of trusted.
+	 */
+	interning_cursor(std::span<const std::byte> in, key_interner &keys,
+	    bool trusted = false) noexcept
+	: c_{in, trusted}
+	, keys_{&keys}
+	{ }
+
+	/*
+	 * Decode the next token into ev, as cursor::next does. An indefinite
+	 * length text key is reported as a single text token, with data
+	 * pointing into the interner, or, if the interner is full, to a
+	 * buffer valid until the next call.
+	 */
+	errc next(event &ev);
+
+	/*
+	 * Id of the text map key returned by the last call to next, or
+	 * key_interner::npos if it returned something else or the interner
+	 * is full.
+	 */
+	std::uint32_t key_id() const noexcept
+	{
+		return id_;
+	}
+
+	unsigned depth() const noexcept
+	{
+		return c_.depth();
+	}
+
+	bool at_key() const noexcept
+	{
+		return c_.at_key();
+	}
+
+	std::size_t offset() const noexcept
+	{
+		return c_.offset();
+	}
+
+	std::span<const std::byte> input() const noexcept
+	{
+		return c_.input();
+	}
+
+private:
+	cursor c_;
+	key_interner *keys_;
+	std::uint32_t id_ = key_interner::npos;
+	std::string joined_;
+};
+
+inline errc
+interning_cursor::next(event &ev)
+{
+	id_ = key_interner::npos;
+	const bool key = c_.at_key();
+	if (auto r = c_.next(ev); r != errc::ok)
+		return r;
+	if (!key)
+		return errc::ok;
+	if (ev.type == token::text) {
+		id_ = keys_->intern(ev.text());
+		return errc::ok;
+	}
+	if (ev.type != token::text_begin)
+		return errc::ok;
+
+	const std::size_t offset = ev.offset;
+	joined_.clear();
+	for (;;) {
+		if (auto r = c_.next(ev); r != errc::ok)
+			return r;
+		if (ev.type == token::text_end)
+			break;
+		joined_ += ev.text();
+	}
+	id_ = keys_->intern(joined_);
+	const std::string_view s = id_ == key_interner::npos ? joined_
+	    : keys_->key(id_);
+	ev.type = token::text;
+	ev.ai = 0;
+	ev.value = s.size();
+	ev.data = reinterpret_cast<const std::byte *>(s.data());
+	ev.offset = offset;
+	return errc::ok;
+}
+
+}
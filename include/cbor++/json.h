@@ -0,0 +1,753 @@
+#pragma once
+
+/*
+ * Streaming conversion between CBOR and JSON.
+ *
+ * to_json walks a CBOR item with a cursor and writes JSON text to a sink
+ * (see sink.h) as it goes; from_json parses JSON text and writes CBOR
+ * through an encoder. Neither builds a tree. Text is scanned for bytes that
+ * need escaping 16 at a time, and numbers are formatted and parsed with
+ * std::to_chars and std::from_chars, which give the shortest representation
+ * that reads back exactly.
+ *
+ * CBOR to JSON follows RFC 8949 section 6.1:
+ *
+ *	integers		decimal numbers, including those outside 64 bits
+ *	floating point		shortest decimal of the encoded width, or null
+ *				for infinities and NaN
+ *	byte strings		base64url strings without padding, or base64
+ *				(tag 22) or base16 (tag 23) inside those tags
+ *	bignums (tags 2, 3)	the byte string as above, with a ~ before it
+ *				for negative bignums (tag 3)
+ *	text strings		strings
+ *	arrays, maps		arrays, objects; keys which are not strings are
+ *				written as quoted JSON, containers as keys are
+ *				errc::type_mismatch
+ *	other tags		the tagged item
+ *	simple values		true, false or null
+ *
+ * JSON to CBOR writes integers which fit in 64 bits as integers and other
+ * numbers as floating point. Arrays and objects become indefinite length
+ * containers, as their size is not known until their end; strings without
+ * escapes are passed to the encoder without copying.
+ *
+ * Example:
+ *
+ *	std::vector<std::byte> out;
+ *	cbor::vector_sink sink{out};
+ *	if (cbor::to_json(msg, sink) != cbor::errc::ok)
+ *		...
+ */
+
+#include "cursor.h"
+#include "encoder.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace cbor {
+
+namespace detail {
+
+/*
+ * Length of the prefix of p which can appear in a JSON string unescaped:
+ * no control characters, quotes or backslashes.
+ */
+inline std::size_t
+json_plain(const char *p, std::size_t n) noexcept
+{
+	std::size_t i = 0;
+#if defined(__SSE2__)
+	const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+	const __m128i space = _mm_set1_epi8(static_cast<char>(0x20 ^ 0x80));
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i bslash = _mm_set1_epi8('\\');
+	for (; i + 16 <= n; i += 16) {
+		const __m128i v = _mm_loadu_si128(
+		    reinterpret_cast<const __m128i *>(p + i));
+		const __m128i bad = _mm_or_si128(
+		    _mm_cmplt_epi8(_mm_xor_si128(v, bias), space),
+		    _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+		    _mm_cmpeq_epi8(v, bslash)));
+		if (const int m = _mm_movemask_epi8(bad))
+			return i + std::countr_zero(static_cast<unsigned>(m));
+	}
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	for (; i + 16 <= n; i += 16) {
+		const uint8x16_t v = vld1q_u8(
+		    reinterpret_cast<const std::uint8_t *>(p + i));
+		const uint8x16_t bad = vorrq_u8(vcltq_u8(v, vdupq_n_u8(0x20)),
+		    vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')),
+		    vceqq_u8(v, vdupq_n_u8('\\'))));
+		if (vmaxvq_u8(bad))
+			break;
+	}
+#endif
+	for (; i < n; ++i) {
+		const auto c = static_cast<unsigned char>(p[i]);
+		if (c < 0x20 || c == '"' || c == '\\')
+			break;
+	}
+	return i;
+}
+
+enum class json_binary : std::uint8_t {
+	base64url,
+	base64,
+	base16,
+};
+
+template<typename Sink>
+class json_writer {
+public:
+	explicit json_writer(Sink &sink) noexcept
+	: sink_{sink}
+	{ }
+
+	errc status() const noexcept
+	{
+		return err_;
+	}
+
+	void put(char c)
+	{
+		put(&c, 1);
+	}
+
+	void put(const char *p, std::size_t n)
+	{
+		if (err_ != errc::ok || !n)
+			return;
+		std::byte *d = sink_.prepare(n);
+		if (!d) {
+			err_ = errc::no_space;
+			return;
+		}
+		std::memcpy(d, p, n);
+		sink_.commit(n);
+	}
+
+	void put(std::string_view s)
+	{
+		put(s.data(), s.size());
+	}
+
+	void uint(std::uint64_t v)
+	{
+		char buf[20];
+		put(buf, std::to_chars(buf, buf + sizeof buf, v).ptr - buf);
+	}
+
+	/* -1 - v */
+	void nint(std::uint64_t v)
+	{
+		if (v == UINT64_MAX)
+			return put("-18446744073709551616");
+		put('-');
+		uint(v + 1);
+	}
+
+	void floating(double v, bool single)
+	{
+		if (v != v || v - v != 0)
+			return put("null");
+		char buf[32];
+		const auto r = single
+		    ? std::to_chars(buf, buf + sizeof buf, static_cast<float>(v))
+		    : std::to_chars(buf, buf + sizeof buf, v);
+		put(buf, r.ptr - buf);
+	}
+
+	/* escaped string contents */
+	void text(const char *p, std::size_t n)
+	{
+		static constexpr char hex[] = "0123456789abcdef";
+		for (;;) {
+			const std::size_t k = json_plain(p, n);
+			put(p, k);
+			if (k == n)
+				return;
+			const auto c = static_cast<unsigned char>(p[k]);
+			switch (c) {
+			case '"':
+				put("\\\"");
+				break;
+			case '\\':
+				put("\\\\");
+				break;
+			case '\b':
+				put("\\b");
+				break;
+			case '\f':
+				put("\\f");
+				break;
+			case '\n':
+				put("\\n");
+				break;
+			case '\r':
+				put("\\r");
+				break;
+			case '\t':
+				put("\\t");
+				break;
+			default: {
+				const char u[] = {'\\', 'u', '0', '0',
+				    hex[c >> 4], hex[c & 15]};
+				put(u, sizeof u);
+			}
+			}
+			p += k + 1;
+			n -= k + 1;
+		}
+	}
+
+	/*
+	 * Binary string contents, possibly in chunks. Call binary_end after
+	 * the last chunk.
+	 */
+	void binary(const std::byte *p, std::size_t n, json_binary enc)
+	{
+		static constexpr char hex[] = "0123456789abcdef";
+		char buf[256];
+		std::size_t o = 0;
+		if (enc == json_binary::base16) {
+			for (std::size_t i = 0; i < n; ++i) {
+				const auto c = static_cast<unsigned>(p[i]);
+				buf[o++] = hex[c >> 4];
+				buf[o++] = hex[c & 15];
+				if (o == sizeof buf)
+					put(buf, std::exchange(o, 0));
+			}
+			return put(buf, o);
+		}
+		const char *t = alphabet(enc);
+		for (std::size_t i = 0; i < n; ++i) {
+			carry_ = carry_ << 8 | static_cast<unsigned>(p[i]);
+			if (++carry_n_ < 3)
+				continue;
+			buf[o++] = t[carry_ >> 18 & 63];
+			buf[o++] = t[carry_ >> 12 & 63];
+			buf[o++] = t[carry_ >> 6 & 63];
+			buf[o++] = t[carry_ & 63];
+			carry_ = carry_n_ = 0;
+			if (o == sizeof buf)
+				put(buf, std::exchange(o, 0));
+		}
+		put(buf, o);
+	}
+
+	void binary_end(json_binary enc)
+	{
+		if (!carry_n_ || enc == json_binary::base16)
+			return;
+		const char *t = alphabet(enc);
+		const unsigned v = carry_ << (carry_n_ == 1 ? 16 : 8);
+		char out[4] = {t[v >> 18 & 63], t[v >> 12 & 63],
+		    t[v >> 6 & 63], '='};
+		if (carry_n_ == 1)
+			out[2] = '=';
+		put(out, enc == json_binary::base64 ? 4 : carry_n_ + 1);
+		carry_ = carry_n_ = 0;
+	}
+
+private:
+	static const char *alphabet(json_binary enc) noexcept
+	{
+		return enc == json_binary::base64
+		    ? "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+		      "0123456789+/"
+		    : "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+		      "0123456789-_";
+	}
+
+	Sink &sink_;
+	errc err_ = errc::ok;
+	unsigned carry_ = 0;		/* base64 input not yet written */
+	unsigned carry_n_ = 0;
+};
+
+}
+
+/*
+ * Write the single CBOR item in input to sink as JSON text. See cursor for
+ * the meaning of trusted. On error the sink holds a partial document.
+ */
+template<typename Sink>
+inline errc
+to_json(std::span<const std::byte> input, Sink &sink, bool trusted = false)
+{
+	using detail::json_binary;
+
+	struct frame {
+		token type;		/* *_begin token */
+		json_binary enc;	/* byte string conversion inside */
+		std::uint64_t n = 0;	/* items written */
+	};
+	frame stack[max_depth];
+	unsigned depth = 0;
+	json_binary enc = json_binary::base64url;
+	bool tagged = false;	/* separator already written for item */
+	bool tagged_key = false;	/* tagged item is a map key */
+	bool negative = false;	/* item is tagged 3 */
+	bool done = false;
+
+	detail::json_writer<Sink> w{sink};
+	cursor c{input, trusted};
+	event ev;
+	for (;;) {
+		if (done && !depth)
+			return w.status() != errc::ok ? w.status()
+			    : c.offset() == input.size() ? errc::ok
+			    : errc::trailing_data;
+		if (auto r = c.next(ev); r != errc::ok)
+			return r;
+		if (w.status() != errc::ok)
+			return w.status();
+		if (ev.type == token::eof)
+			return errc::truncated;
+
+		frame *f = depth ? &stack[depth - 1] : nullptr;
+		const bool end = ev.type == token::array_end ||
+		    ev.type == token::map_end || ev.type == token::bytes_end ||
+		    ev.type == token::text_end;
+		const bool chunk = f && (f->type == token::bytes_begin ||
+		    f->type == token::text_begin);
+		bool key = tagged && tagged_key;
+
+		/* separator before the item */
+		if (!end && !chunk && !tagged && f) {
+			if (f->type == token::map_begin) {
+				key = !(f->n & 1);
+				if (f->n)
+					w.put(key ? ',' : ':');
+			} else if (f->n)
+				w.put(',');
+			++f->n;
+		}
+		if (!end && !chunk && !tagged)
+			enc = f ? f->enc : json_binary::base64url;
+		/* a byte string tagged 3 is a negative bignum, written with ~ */
+		const bool tilde = negative && !chunk &&
+		    (ev.type == token::bytes || ev.type == token::bytes_begin);
+		if (ev.type != token::tag && !chunk)
+			tagged = negative = false;
+
+		/* keys which are not strings are written as quoted JSON */
+		const bool quote = key && ev.type != token::text &&
+		    ev.type != token::text_begin && ev.type != token::bytes &&
+		    ev.type != token::bytes_begin && ev.type != token::tag;
+		if (quote && (ev.type == token::array_begin ||
+		    ev.type == token::map_begin))
+			return errc::type_mismatch;
+		if (quote)
+			w.put('"');
+
+		switch (ev.type) {
+		case token::uint:
+			w.uint(ev.value);
+			break;
+		case token::nint:
+			w.nint(ev.value);
+			break;
+		case token::bytes:
+			if (!chunk)
+				w.put('"');
+			if (tilde)
+				w.put('~');
+			w.binary(ev.data, ev.value, chunk ? f->enc : enc);
+			if (!chunk) {
+				w.binary_end(enc);
+				w.put('"');
+			}
+			break;
+		case token::text:
+			if (!chunk)
+				w.put('"');
+			w.text(reinterpret_cast<const char *>(ev.data), ev.value);
+			if (!chunk)
+				w.put('"');
+			break;
+		case token::bytes_begin:
+		case token::text_begin:
+		case token::array_begin:
+		case token::map_begin:
+			if (depth == max_depth)
+				return errc::depth_exceeded;
+			stack[depth++] = {ev.type, enc};
+			w.put(ev.type == token::array_begin ? '['
+			    : ev.type == token::map_begin ? '{' : '"');
+			if (tilde)
+				w.put('~');
+			continue;
+		case token::bytes_end:
+			w.binary_end(f->enc);
+			[[fallthrough]];
+		case token::text_end:
+		case token::array_end:
+		case token::map_end:
+			--depth;
+			w.put(ev.type == token::array_end ? ']'
+			    : ev.type == token::map_end ? '}' : '"');
+			break;
+		case token::tag:
+			if (ev.value >= 21 && ev.value <= 23)
+				enc = static_cast<json_binary>(ev.value - 21);
+			negative = ev.value == 3;
+			tagged = true;
+			tagged_key = key;
+			continue;
+		case token::boolean:
+			w.put(ev.value ? "true" : "false");
+			break;
+		case token::floating:
+			w.floating(ev.floating(), ev.ai != ai_8byte);
+			break;
+		default:
+			w.put("null");
+			break;
+		}
+		if (quote)
+			w.put('"');
+		done = true;
+	}
+}
+
+namespace detail {
+
+inline bool
+json_space(char c) noexcept
+{
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+inline int
+json_hex(char c) noexcept
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	c |= 0x20;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+/*
+ * Parse the string starting after the opening quote at p. On success p is
+ * left after the closing quote and s refers either to the input or, if the
+ * string has escapes, to scratch.
+ */
+inline errc
+json_string(const char *&p, const char *e, std::string &scratch,
+    std::string_view &s, bool trusted)
+{
+	const char *b = p;
+	std::size_t k = json_plain(p, e - p);
+	if (b + k != e && b[k] == '"') {
+		s = {b, k};
+		p = b + k + 1;
+		if (!trusted && !utf8_valid(s))
+			return errc::invalid_utf8;
+		return errc::ok;
+	}
+
+	scratch.clear();
+	for (;;) {
+		scratch.append(p, k);
+		p += k;
+		if (p == e)
+			return errc::invalid_json;
+		if (*p == '"')
+			break;
+		if (*p != '\\' || ++p == e)
+			return errc::invalid_json;
+		switch (*p++) {
+		case '"':
+			scratch += '"';
+			break;
+		case '\\':
+			scratch += '\\';
+			break;
+		case '/':
+			scratch += '/';
+			break;
+		case 'b':
+			scratch += '\b';
+			break;
+		case 'f':
+			scratch += '\f';
+			break;
+		case 'n':
+			scratch += '\n';
+			break;
+		case 'r':
+			scratch += '\r';
+			break;
+		case 't':
+			scratch += '\t';
+			break;
+		case 'u': {
+			const auto hex4 = [&](std::uint32_t &v) {
+				if (e - p < 4)
+					return false;
+				v = 0;
+				for (int i = 0; i < 4; ++i) {
+					const int d = json_hex(p[i]);
+					if (d < 0)
+						return false;
+					v = v << 4 | d;
+				}
+				p += 4;
+				return true;
+			};
+			std::uint32_t cp;
+			if (!hex4(cp))
+				return errc::invalid_json;
+			if (cp >= 0xd800 && cp < 0xdc00) {
+				std::uint32_t lo;
+				if (e - p < 2 || p[0] != '\\' || p[1] != 'u')
+					return errc::invalid_utf8;
+				p += 2;
+				if (!hex4(lo))
+					return errc::invalid_json;
+				if (lo < 0xdc00 || lo >= 0xe000)
+					return errc::invalid_utf8;
+				cp = 0x10000 + ((cp - 0xd800) << 10) +
+				    (lo - 0xdc00);
+			} else if (cp >= 0xdc00 && cp < 0xe000)
+				return errc::invalid_utf8;
+			if (cp < 0x80)
+				scratch += static_cast<char>(cp);
+			else if (cp < 0x800) {
+				scratch += static_cast<char>(0xc0 | cp >> 6);
+				scratch += static_cast<char>(0x80 | (cp & 0x3f));
+			} else if (cp < 0x10000) {
+				scratch += static_cast<char>(0xe0 | cp >> 12);
+				scratch += static_cast<char>(0x80 |
+				    (cp >> 6 & 0x3f));
+				scratch += static_cast<char>(0x80 | (cp & 0x3f));
+			} else {
+				scratch += static_cast<char>(0xf0 | cp >> 18);
+				scratch += static_cast<char>(0x80 |
+				    (cp >> 12 & 0x3f));
+				scratch += static_cast<char>(0x80 |
+				    (cp >> 6 & 0x3f));
+				scratch += static_cast<char>(0x80 | (cp & 0x3f));
+			}
+			break;
+		}
+		default:
+			return errc::invalid_json;
+		}
+		k = json_plain(p, e - p);
+	}
+	++p;
+	s = scratch;
+	if (!trusted && !utf8_valid(s))
+		return errc::invalid_utf8;
+	return errc::ok;
+}
+
+/*
+ * Parse the number at p and write it to enc.
+ */
+template<typename Sink>
+inline errc
+json_number(const char *&p, const char *e, encoder<Sink> &enc)
+{
+	const char *b = p;
+	const bool neg = p != e && *p == '-';
+	p += neg;
+	const char *digits = p;
+	while (p != e && *p >= '0' && *p <= '9')
+		++p;
+	if (p == digits || (*digits == '0' && p - digits > 1))
+		return errc::invalid_json;
+	bool integral = true;
+	if (p != e && *p == '.') {
+		integral = false;
+		const char *f = ++p;
+		while (p != e && *p >= '0' && *p <= '9')
+			++p;
+		if (p == f)
+			return errc::invalid_json;
+	}
+	if (p != e && (*p == 'e' || *p == 'E')) {
+		integral = false;
+		++p;
+		if (p != e && (*p == '+' || *p == '-'))
+			++p;
+		const char *x = p;
+		while (p != e && *p >= '0' && *p <= '9')
+			++p;
+		if (p == x)
+			return errc::invalid_json;
+	}
+
+	if (integral) {
+		std::uint64_t v;
+		const auto r = std::from_chars(digits, p, v);
+		if (r.ec == std::errc{} && !(neg && v == 0)) {
+			if (neg)
+				enc.nint(v - 1);
+			else
+				enc.uint(v);
+			return errc::ok;
+		}
+		/* -2^64 is the one negative integer beyond UINT64_MAX */
+		if (neg && std::string_view{digits, static_cast<std::size_t>(
+		    p - digits)} == "18446744073709551616") {
+			enc.nint(UINT64_MAX);
+			return errc::ok;
+		}
+	}
+	double d;
+	const auto r = std::from_chars(b, p, d);
+	if (r.ec == std::errc::invalid_argument)
+		return errc::invalid_json;
+	/* out of range values are rounded to zero or infinity */
+	if (r.ec == std::errc::result_out_of_range) {
+		const char *x = std::find_if(b, p, [](char c) {
+			return c == 'e' || c == 'E';
+		});
+		const bool tiny = x != p && x[1] == '-';
+		d = tiny ? 0.0 : HUGE_VAL;
+		if (neg)
+			d = -d;
+	}
+	enc.floating(d);
+	return errc::ok;
+}
+
+}
+
+/*
+ * Parse the JSON text in json and write it to enc. Input strings are
+ * checked to be valid UTF-8 unless trusted is set. Errors from the encoder
+ * are returned as they occur.
+ */
+template<typename Sink>
+inline errc
+from_json(std::string_view json, encoder<Sink> &enc, bool trusted = false)
+{
+	const char *p = json.data();
+	const char *const e = p + json.size();
+	std::string scratch;
+	struct frame {
+		bool object;
+		bool empty;
+	};
+	frame stack[max_depth];
+	unsigned depth = 0;
+
+	const auto space = [&] {
+		while (p != e && detail::json_space(*p))
+			++p;
+	};
+	const auto literal = [&](std::string_view w) {
+		if (static_cast<std::size_t>(e - p) < w.size() ||
+		    std::memcmp(p, w.data(), w.size()))
+			return false;
+		p += w.size();
+		return true;
+	};
+
+	for (;;) {
+		space();
+		if (p == e)
+			return errc::invalid_json;
+
+		/* end of containers, or the separator before the next value */
+		if (depth) {
+			frame &f = stack[depth - 1];
+			if (*p == (f.object ? '}' : ']')) {
+				++p;
+				enc.end();
+				--depth;
+				goto next;
+			}
+			if (!f.empty) {
+				if (*p != ',')
+					return errc::invalid_json;
+				++p;
+				space();
+			}
+			f.empty = false;
+			if (f.object) {
+				std::string_view k;
+				if (p == e || *p++ != '"')
+					return errc::invalid_json;
+				if (auto r = detail::json_string(p, e, scratch, k,
+				    trusted); r != errc::ok)
+					return r;
+				enc.text(k);
+				space();
+				if (p == e || *p++ != ':')
+					return errc::invalid_json;
+				space();
+				if (p == e)
+					return errc::invalid_json;
+			}
+		}
+
+		switch (*p) {
+		case '{':
+		case '[':
+			if (depth == max_depth)
+				return errc::depth_exceeded;
+			stack[depth++] = {*p == '{', true};
+			if (*p++ == '{')
+				enc.map();
+			else
+				enc.array();
+			continue;
+		case '"': {
+			std::string_view s;
+			++p;
+			if (auto r = detail::json_string(p, e, scratch, s,
+			    trusted); r != errc::ok)
+				return r;
+			enc.text(s);
+			break;
+		}
+		case 't':
+			if (!literal("true"))
+				return errc::invalid_json;
+			enc.boolean(true);
+			break;
+		case 'f':
+			if (!literal("false"))
+				return errc::invalid_json;
+			enc.boolean(false);
+			break;
+		case 'n':
+			if (!literal("null"))
+				return errc::invalid_json;
+			enc.null();
+			break;
+		default:
+			if (auto r = detail::json_number(p, e, enc);
+			    r != errc::ok)
+				return r;
+			break;
+		}
+next:
+		if (enc.status() != errc::ok)
+			return enc.status();
+		if (!depth) {
+			space();
+			return p == e ? errc::ok : errc::trailing_data;
+		}
+	}
+}
+
+}
@@ -0,0 +1,394 @@
+#pragma once
+
+/*
+ * Lazily decoded CBOR document.
+ *
+ * lazy_document::parse only checks that the input is a single well-formed
+ * item. Nothing else is decoded until it is accessed: a container records
+ * where each of its children starts and ends the first time one of them is
+ * asked for, and indefinite length strings are joined the first time they
+ * are read. Both are cached in the document, so repeated access costs no
+ * more than a document tree, while parts of the input that are never
+ * visited cost only the validation scan.
+ *
+ * Values are handles into the document and stay valid as long as it does.
+ * The input is referenced, not copied, and must outlive the document.
+ * Access mutates the cache, so a document must not be read from several
+ * threads at once.
+ *
+ * Example:
+ *
+ *	cbor::lazy_document doc;
+ *	if (doc.parse(config) != cbor::errc::ok)
+ *		...
+ *	if (auto port = doc.root().find("port"))
+ *		listen(port.as_uint());
+ */
+
+#include "document.h"
+#include "validate.h"
+
+#include <memory_resource>
+#include <new>
+
+namespace cbor {
+
+namespace detail {
+
+struct lazy_node {
+	const std::byte *head;
+	const std::byte *end;
+	lazy_node *children = nullptr;	/* items, map keys and values, or tagged item */
+	const std::byte *str = nullptr;	/* joined indefinite length string */
+	std::uint64_t n = 0;		/* array or map size, or string length */
+	bool expanded = false;
+};
+
+}
+
+class lazy_document;
+
+class lazy_value {
+public:
+	lazy_value() noexcept = default;
+
+	/*
+	 * False for the value returned by a failed find.
+	 */
+	explicit operator bool() const noexcept
+	{
+		return n_ != nullptr;
+	}
+
+	cbor::kind kind() const noexcept;
+
+	bool is(cbor::kind k) const noexcept
+	{
+		return kind() == k;
+	}
+
+	/*
+	 * Accessors. The value must be of the matching kind.
+	 */
+
+	/* uint, nint (-1 - v), simple, boolean */
+	std::uint64_t as_uint() const noexcept
+	{
+		return head().value;
+	}
+
+	bool as_bool() const noexcept
+	{
+		return head().value != 0;
+	}
+
+	double as_double() const noexcept
+	{
+		return head().floating();
+	}
+
+	std::span<const std::byte> as_bytes() const;
+	std::string_view as_text() const;
+
+	/* array or map size */
+	std::size_t size() const;
+
+	/* array item */
+	lazy_value operator[](std::size_t i) const;
+
+	/* map member */
+	lazy_value key(std::size_t i) const;
+	lazy_value val(std::size_t i) const;
+
+	/*
+	 * Map lookup. Returns an empty value if the key is not present.
+	 */
+	lazy_value find(std::string_view key) const;
+	lazy_value find(std::int64_t key) const;
+
+	std::uint64_t tag_number() const noexcept
+	{
+		return head().value;
+	}
+
+	lazy_value tagged() const;
+
+	/*
+	 * Encoded bytes of the item, e.g. for document::parse or to copy it
+	 * to an encoder unchanged.
+	 */
+	std::span<const std::byte> raw() const noexcept
+	{
+		return {n_->head, n_->end};
+	}
+
+private:
+	friend class lazy_document;
+
+	lazy_value(lazy_document *doc, detail::lazy_node *n) noexcept
+	: doc_{doc}
+	, n_{n}
+	{ }
+
+	event head() const noexcept
+	{
+		cursor c{raw(), true};
+		event ev;
+		c.next(ev);
+		return ev;
+	}
+
+	lazy_value child(std::size_t i) const;
+
+	lazy_document *doc_ = nullptr;
+	detail::lazy_node *n_ = nullptr;
+};
+
+class lazy_document {
+public:
+	/*
+	 * Document allocating its cache from an internal monotonic arena which
+	 * is freed when the document is destroyed.
+	 */
+	lazy_document() noexcept
+	: mr_{&own_}
+	{ }
+
+	explicit lazy_document(std::pmr::memory_resource *mr) noexcept
+	: mr_{mr}
+	{ }
+
+	lazy_document(const lazy_document &) = delete;
+	lazy_document &operator=(const lazy_document &) = delete;
+
+	/*
+	 * Replace the root with the single item in input, which must outlive
+	 * the document. Values obtained before are invalidated. A document
+	 * using its own arena frees the memory used for them; memory from a
+	 * resource passed to the constructor is only returned with that
+	 * resource. See cursor for the meaning of trusted.
+	 */
+	errc parse(std::span<const std::byte> input, bool trusted = false)
+	{
+		root_ = {};
+		if (mr_ == &own_)
+			own_.release();
+		std::size_t end;
+		if (auto r = validate(input, end, trusted); r != errc::ok)
+			return r;
+		if (end != input.size())
+			return errc::trailing_data;
+		root_ = {input.data(), input.data() + end};
+		return errc::ok;
+	}
+
+	/*
+	 * Root value. Only valid after a successful parse.
+	 */
+	lazy_value root() noexcept
+	{
+		return {this, &root_};
+	}
+
+private:
+	friend class lazy_value;
+
+	void expand(detail::lazy_node &n);
+
+	std::pmr::monotonic_buffer_resource own_;
+	std::pmr::memory_resource *mr_;
+	detail::lazy_node root_{};
+};
+
+/*
+ * Record the extents of the children of a container or tag, or join the
+ * chunks of an indefinite length string. The input has been validated, so
+ * the cursor cannot fail.
+ */
+inline void
+lazy_document::expand(detail::lazy_node &n)
+{
+	if (n.expanded)
+		return;
+	cursor c{{n.head, n.end}, true};
+	event ev;
+	c.next(ev);
+	switch (ev.type) {
+	case token::array_begin:
+	case token::map_begin:
+	case token::tag: {
+		std::uint64_t count = 1;
+		if (ev.type != token::tag) {
+			count = ev.value;
+			if (ev.is_indefinite()) {
+				cursor k = c;
+				for (count = 0; k.skip() == errc::ok; ++count)
+					;
+			} else if (ev.type == token::map_begin)
+				count *= 2;
+		}
+		if (count) {
+			n.children = static_cast<detail::lazy_node *>(
+			    mr_->allocate(count * sizeof(detail::lazy_node),
+			    alignof(detail::lazy_node)));
+		}
+		for (std::uint64_t i = 0; i < count; ++i) {
+			const std::byte *h = n.head + c.offset();
+			c.skip();
+			::new (&n.children[i]) detail::lazy_node{h,
+			    n.head + c.offset()};
+		}
+		n.n = ev.type == token::map_begin ? count / 2 : count;
+		break;
+	}
+	case token::bytes_begin:
+	case token::text_begin: {
+		cursor k = c;
+		std::uint64_t len = 0;
+		while (k.next(ev), ev.type == token::bytes ||
+		    ev.type == token::text)
+			len += ev.value;
+		auto *p = static_cast<std::byte *>(mr_->allocate(len ? len : 1,
+		    1));
+		n.str = p;
+		n.n = len;
+		while (c.next(ev), ev.type == token::bytes ||
+		    ev.type == token::text) {
+			if (ev.value)
+				std::memcpy(p, ev.data, ev.value);
+			p += ev.value;
+		}
+		break;
+	}
+	default:
+		break;
+	}
+	n.expanded = true;
+}
+
+inline cbor::kind
+lazy_value::kind() const noexcept
+{
+	switch (head().type) {
+	case token::uint:
+		return kind::uint;
+	case token::nint:
+		return kind::nint;
+	case token::bytes:
+	case token::bytes_begin:
+		return kind::bytes;
+	case token::text:
+	case token::text_begin:
+		return kind::text;
+	case token::array_begin:
+		return kind::array;
+	case token::map_begin:
+		return kind::map;
+	case token::tag:
+		return kind::tag;
+	case token::simple:
+		return kind::simple;
+	case token::boolean:
+		return kind::boolean;
+	case token::undefined:
+		return kind::undefined;
+	case token::floating:
+		return kind::floating;
+	default:
+		return kind::null;
+	}
+}
+
+inline std::span<const std::byte>
+lazy_value::as_bytes() const
+{
+	const event ev = head();
+	if (ev.type == token::bytes)
+		return ev.bytes();
+	doc_->expand(*n_);
+	return {n_->str, static_cast<std::size_t>(n_->n)};
+}
+
+inline std::string_view
+lazy_value::as_text() const
+{
+	const event ev = head();
+	if (ev.type == token::text)
+		return ev.text();
+	doc_->expand(*n_);
+	return {reinterpret_cast<const char *>(n_->str),
+	    static_cast<std::size_t>(n_->n)};
+}
+
+inline std::size_t
+lazy_value::size() const
+{
+	if (n_->expanded)
+		return n_->n;
+	const event ev = head();
+	if (!ev.is_indefinite())
+		return ev.value;
+	doc_->expand(*n_);
+	return n_->n;
+}
+
+inline lazy_value
+lazy_value::child(std::size_t i) const
+{
+	doc_->expand(*n_);
+	return {doc_, &n_->children[i]};
+}
+
+inline lazy_value
+lazy_value::operator[](std::size_t i) const
+{
+	return child(i);
+}
+
+inline lazy_value
+lazy_value::key(std::size_t i) const
+{
+	return child(2 * i);
+}
+
+inline lazy_value
+lazy_value::val(std::size_t i) const
+{
+	return child(2 * i + 1);
+}
+
+inline lazy_value
+lazy_value::tagged() const
+{
+	return child(0);
+}
+
+inline lazy_value
+lazy_value::find(std::string_view key) const
+{
+	const std::size_t n = size();
+	for (std::size_t i = 0; i < n; ++i) {
+		const lazy_value k = child(2 * i);
+		const event ev = k.head();
+		if (ev.type == token::text ? ev.text() == key
+		    : ev.type == token::text_begin && k.as_text() == key)
+			return child(2 * i + 1);
+	}
+	return {};
+}
+
+inline lazy_value
+lazy_value::find(std::int64_t key) const
+{
+	const value want = value::integer(key);
+	const token t = want.is(kind::uint) ? token::uint : token::nint;
+	const std::size_t n = size();
+	for (std::size_t i = 0; i < n; ++i) {
+		const event ev = child(2 * i).head();
+		if (ev.type == t && ev.value == want.as_uint())
+			return child(2 * i + 1);
+	}
+	return {};
+}
+
+}
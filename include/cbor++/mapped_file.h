@@ -0,0 +1,178 @@
+#pragma once
+
+/*
+ * Read only memory mapped files.
+ *
+ * A mapped_file exposes a file's contents as a span which can be handed to
+ * a cursor, validate or document::parse without reading it into memory
+ * first; pages are read on first touch and are shared with the page cache
+ * rather than counted twice. The access pattern given to open, or later to
+ * advise, is passed to the kernel with madvise to tune readahead. Only
+ * available where <sys/mman.h> is.
+ *
+ * Example:
+ *
+ *	cbor::mapped_file f;
+ *	if (auto ec = f.open("archive.cbor", cbor::access::random))
+ *		fail(ec);
+ *	cbor::extent_index idx;
+ *	idx.build(f.data());
+ *	cbor::cursor c{f.data(), idx};
+ */
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <system_error>
+#include <utility>
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cbor {
+
+/*
+ * Expected access pattern for a mapping.
+ */
+enum class access {
+	normal,		/* kernel default readahead */
+	sequential,	/* one pass front to back, e.g. sequences and validate */
+	random,		/* index driven lookups, readahead disabled */
+	willneed,	/* read the whole range in now */
+};
+
+namespace detail {
+
+inline int
+madvise_advice(access a) noexcept
+{
+	switch (a) {
+	case access::normal:
+		return MADV_NORMAL;
+	case access::sequential:
+		return MADV_SEQUENTIAL;
+	case access::random:
+		return MADV_RANDOM;
+	case access::willneed:
+		return MADV_WILLNEED;
+	}
+	return MADV_NORMAL;
+}
+
+}
+
+class mapped_file {
+public:
+	mapped_file() noexcept = default;
+
+	mapped_file(const mapped_file &) = delete;
+	mapped_file &operator=(const mapped_file &) = delete;
+
+	mapped_file(mapped_file &&o) noexcept
+	: data_{std::exchange(o.data_, nullptr)}
+	, size_{std::exchange(o.size_, 0)}
+	{ }
+
+	mapped_file &operator=(mapped_file &&o) noexcept
+	{
+		if (this != &o) {
+			close();
+			data_ = std::exchange(o.data_, nullptr);
+			size_ = std::exchange(o.size_, 0);
+		}
+		return *this;
+	}
+
+	~mapped_file()
+	{
+		close();
+	}
+
+	/*
+	 * Map the whole of path, replacing any current mapping, and advise the
+	 * kernel of the expected access pattern.
+	 */
+	std::error_code open(const char *path, access a = access::normal) noexcept
+	{
+		close();
+		const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return {errno, std::system_category()};
+		std::error_code ec;
+		struct stat st;
+		if (::fstat(fd, &st) < 0)
+			ec = {errno, std::system_category()};
+		else if (st.st_size > 0) {
+			void *p = ::mmap(nullptr, st.st_size, PROT_READ,
+			    MAP_SHARED, fd, 0);
+			if (p == MAP_FAILED)
+				ec = {errno, std::system_category()};
+			else {
+				data_ = static_cast<const std::byte *>(p);
+				size_ = st.st_size;
+				/* advice is only a hint, ignore failure */
+				if (a != access::normal)
+					advise(a);
+			}
+		}
+		::close(fd);
+		return ec;
+	}
+
+	/*
+	 * Change the expected access pattern for the whole mapping.
+	 */
+	std::error_code advise(access a) noexcept
+	{
+		return advise(data(), a);
+	}
+
+	/*
+	 * Change the expected access pattern for part of the mapping, e.g. to
+	 * read ahead the extent of a container before walking it. range must
+	 * lie within data() and is widened to whole pages.
+	 */
+	std::error_code advise(std::span<const std::byte> range, access a) noexcept
+	{
+		if (range.empty())
+			return {};
+		const auto page = static_cast<std::uintptr_t>(::sysconf(_SC_PAGESIZE));
+		const auto b = reinterpret_cast<std::uintptr_t>(range.data()) &
+		    ~(page - 1);
+		const auto e = reinterpret_cast<std::uintptr_t>(range.data()) +
+		    range.size();
+		if (::madvise(reinterpret_cast<void *>(b), e - b,
+		    detail::madvise_advice(a)) < 0)
+			return {errno, std::system_category()};
+		return {};
+	}
+
+	void close() noexcept
+	{
+		if (data_)
+			::munmap(const_cast<std::byte *>(data_), size_);
+		data_ = nullptr;
+		size_ = 0;
+	}
+
+	std::span<const std::byte> data() const noexcept
+	{
+		return {data_, size_};
+	}
+
+	std::size_t size() const noexcept
+	{
+		return size_;
+	}
+
+private:
+	const std::byte *data_ = nullptr;
+	std::size_t size_ = 0;
+};
+
+}
+#endif
@@ -0,0 +1,862 @@
+#pragma once
+
+/*
+ * Packed CBOR (draft-ietf-cbor-packed): items repeated within a message are
+ * stored once in tables at its start and referred to from the rest of it.
+ *
+ *	113([shared items, argument items, rump])
+ *
+ * In the rump and in the tables, simple values 0 to 15 refer to shared
+ * items 0 to 15, tag 6 with unsigned integer n to shared item 16 + 2n and
+ * tag 6 with negative integer -1 - n to shared item 17 + 2n. Tags 224 to
+ * 255 and 28704 to 32767 refer to argument items 0 to 4095: the argument
+ * is a prefix which is joined with the tagged item, the rump of the
+ * reference. Tags 216 to 223 refer to arguments 0 to 7 as suffixes.
+ * Strings are joined by concatenation, arrays by concatenating their
+ * items and maps by merging their entries.
+ *
+ * packer builds the tables from one or more sample messages and writes
+ * messages with them. Shared items are chosen among repeated integers,
+ * floats and strings, and prefixes among the leading parts of text strings
+ * that end in punctuation, such as URIs and dotted names. Each is taken
+ * only if it saves more bytes than its table entry costs, with the most
+ * frequent items getting the shortest references. A batch of readings
+ * which repeat a device identifier, unit and resource URI packs to about
+ * half its size.
+ *
+ * packed_document reads packed messages on access like lazy_document,
+ * resolving references as values are visited. Nothing is unpacked up
+ * front; joined strings are built the first time they are read and cached.
+ * Messages without table setup are read as plain CBOR. unpack writes the
+ * fully unpacked item to an encoder.
+ *
+ * Not supported: table setup other than at the root, the suffix
+ * references with two byte tags (27647 to 28671) and all argument
+ * references with four byte tags, and arguments which themselves contain
+ * argument references (shared references are resolved anywhere). A
+ * reference in an unsupported range is errc::invalid_packed rather than
+ * being read as an unknown tag.
+ *
+ * Example:
+ *
+ *	cbor::encoder enc{sink};
+ *	if (cbor::pack(reading, enc) != cbor::errc::ok)
+ *		...
+ *
+ *	cbor::packed_document doc;
+ *	if (doc.parse(frame) != cbor::errc::ok)
+ *		...
+ *	for (std::size_t i = 0; i < doc.root().size(); ++i)
+ *		store(doc.root()[i].find("v").as_double());
+ */
+
+#include "encoder.h"
+#include "lazy.h"
+
+#include <algorithm>
+#include <cctype>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cbor {
+
+namespace detail {
+
+/*
+ * Argument index and direction of a reference tag, or false for other tags.
+ */
+inline bool
+packed_argument(std::uint64_t tag, std::size_t &i, bool &suffix) noexcept
+{
+	suffix = tag >= 216 && tag < 224;
+	if (suffix)
+		i = tag - 216;
+	else if (tag >= 224 && tag < 256)
+		i = tag - 224;
+	else if (tag >= 28704 && tag < 32768)
+		i = tag - 28704 + 32;
+	else
+		return false;
+	return true;
+}
+
+/*
+ * Argument reference tags which are not supported: suffixes with two byte
+ * tags and both directions with four byte tags.
+ */
+inline bool
+packed_unsupported(std::uint64_t tag) noexcept
+{
+	return (tag >= 27647 && tag <= 28671) ||
+	    (tag >= 1811940352 && tag <= 2147483647);
+}
+
+/* tags and simple values packed CBOR assigns a meaning to */
+inline bool
+packed_reserved(const event &ev) noexcept
+{
+	std::size_t i;
+	bool suffix;
+	if (ev.type == token::simple)
+		return ev.value < 16;
+	return ev.type == token::tag && (ev.value == 6 || ev.value == 113 ||
+	    packed_argument(ev.value, i, suffix) ||
+	    packed_unsupported(ev.value));
+}
+
+/* bytes taken by a reference to shared item i */
+constexpr std::size_t
+packed_reference_size(std::size_t i) noexcept
+{
+	return i < 16 ? 1 : 1 + head_size((i - 16) / 2);
+}
+
+}
+
+class packer {
+public:
+	/*
+	 * Count the items of input, a single item, as candidates for the
+	 * tables. Input which uses simple values 0 to 15 or the tags reserved
+	 * for references cannot be packed and is errc::type_mismatch. See
+	 * cursor for the meaning of trusted.
+	 */
+	errc add(std::span<const std::byte> input, bool trusted = false);
+
+	/*
+	 * Choose the tables from the items counted since the last clear.
+	 */
+	void build();
+
+	/*
+	 * Write input, a single item, to enc as packed CBOR with the tables
+	 * chosen by build. Input need not have been passed to add, so tables
+	 * built from samples can be used for later messages.
+	 */
+	template<typename Sink>
+	errc write(std::span<const std::byte> input, encoder<Sink> &enc,
+	    bool trusted = false) const;
+
+	void clear()
+	{
+		*this = {};
+	}
+
+	/* number of shared items and of prefixes chosen */
+	std::size_t shared_size() const noexcept
+	{
+		return shared_.size();
+	}
+
+	std::size_t prefix_size() const noexcept
+	{
+		return prefixes_.size();
+	}
+
+private:
+	using counts = std::unordered_map<std::string, std::size_t,
+	    detail::string_hash, std::equal_to<>>;
+
+	static constexpr std::size_t max_prefixes = 32;
+	static constexpr std::size_t min_prefix = 3;
+
+	template<typename Sink>
+	static void reference(encoder<Sink> &enc, std::size_t i);
+
+	void choose_prefixes();
+
+	counts items_;		/* encoded scalar or string -> occurrences */
+	counts texts_;		/* text string -> occurrences */
+	std::vector<std::string> shared_;	/* encoded */
+	counts index_;		/* encoded -> shared item index */
+	std::vector<std::string> prefixes_;
+};
+
+inline errc
+packer::add(std::span<const std::byte> input, bool trusted)
+{
+	std::size_t end;
+	if (auto r = validate(input, end, trusted); r != errc::ok)
+		return r;
+	if (end != input.size())
+		return errc::trailing_data;
+
+	/* check before counting so that a failed add changes nothing */
+	cursor c{input, true};
+	event ev;
+	while (c.next(ev), ev.type != token::eof)
+		if (detail::packed_reserved(ev))
+			return errc::type_mismatch;
+
+	c = cursor{input, true};
+	bool chunked = false;
+	while (c.next(ev), ev.type != token::eof) {
+		switch (ev.type) {
+		case token::bytes_begin:
+		case token::text_begin:
+			chunked = true;
+			continue;
+		case token::bytes_end:
+		case token::text_end:
+			chunked = false;
+			continue;
+		case token::text:
+			if (!chunked)
+				++texts_[std::string{ev.text()}];
+			[[fallthrough]];
+		case token::bytes:
+			if (chunked)
+				continue;
+			break;
+		case token::uint:
+		case token::nint:
+		case token::floating:
+			break;
+		default:
+			continue;
+		}
+		const auto raw = input.subspan(ev.offset, c.offset() - ev.offset);
+		if (raw.size() < 2)
+			continue;
+		const std::string_view key{
+		    reinterpret_cast<const char *>(raw.data()), raw.size()};
+		if (auto i = items_.find(key); i != items_.end())
+			++i->second;
+		else
+			items_.emplace(key, 1);
+	}
+	return errc::ok;
+}
+
+inline void
+packer::build()
+{
+	shared_.clear();
+	index_.clear();
+	prefixes_.clear();
+
+	/* most frequent first, so they get the one byte references */
+	std::vector<counts::const_pointer> cand;
+	for (const auto &i : items_)
+		if (i.second > 1)
+			cand.push_back(&i);
+	std::sort(cand.begin(), cand.end(), [](auto a, auto b) {
+		if (a->second != b->second)
+			return a->second > b->second;
+		if (a->first.size() != b->first.size())
+			return a->first.size() > b->first.size();
+		return a->first < b->first;
+	});
+	for (auto i : cand) {
+		const std::size_t n = i->first.size();
+		const std::size_t ref =
+		    detail::packed_reference_size(shared_.size());
+		if (n <= ref || i->second * (n - ref) <= n)
+			continue;
+		index_.emplace(i->first, shared_.size());
+		shared_.push_back(i->first);
+	}
+
+	choose_prefixes();
+}
+
+/*
+ * Greedily take the prefix saving most over the prefixes already taken,
+ * until none saves more than its table entry costs.
+ */
+inline void
+packer::choose_prefixes()
+{
+	struct user {
+		std::size_t count;
+		std::size_t best = 2;	/* longest prefix taken, at least the tag */
+	};
+	std::vector<user> users;
+	std::unordered_map<std::string_view, std::vector<std::size_t>> cand;
+
+	std::string enc;
+	for (const auto &[s, count] : texts_) {
+		/* strings shared whole need no prefix */
+		enc.resize(9);
+		enc.resize(write_head(reinterpret_cast<std::byte *>(enc.data()),
+		    major::text, s.size()));
+		enc += s;
+		if (index_.contains(enc))
+			continue;
+		for (std::size_t j = min_prefix; j < s.size(); ++j) {
+			const unsigned char ch = s[j - 1];
+			if (ch < 0x80 && !std::isalnum(ch))
+				cand[std::string_view{s}.substr(0, j)].push_back(
+				    users.size());
+		}
+		users.push_back({count});
+	}
+
+	std::vector<std::string_view> order;
+	for (const auto &i : cand)
+		order.push_back(i.first);
+	std::sort(order.begin(), order.end());
+
+	while (prefixes_.size() < max_prefixes) {
+		std::size_t best = 0;
+		std::string_view pick;
+		for (std::string_view p : order) {
+			std::size_t gain = 0;
+			for (std::size_t u : cand[p])
+				if (p.size() > users[u].best)
+					gain += users[u].count *
+					    (p.size() - users[u].best);
+			const std::size_t cost = p.size() + head_size(p.size());
+			if (gain > cost && gain - cost > best) {
+				best = gain - cost;
+				pick = p;
+			}
+		}
+		if (!best)
+			break;
+		for (std::size_t u : cand[pick])
+			users[u].best = std::max(users[u].best, pick.size());
+		prefixes_.emplace_back(pick);
+		std::erase(order, pick);
+	}
+}
+
+template<typename Sink>
+inline void
+packer::reference(encoder<Sink> &enc, std::size_t i)
+{
+	if (i < 16)
+		return enc.simple(static_cast<std::uint8_t>(i));
+	i -= 16;
+	enc.tag(6);
+	if (i % 2)
+		enc.nint(i / 2);
+	else
+		enc.uint(i / 2);
+}
+
+template<typename Sink>
+inline errc
+packer::write(std::span<const std::byte> input, encoder<Sink> &enc,
+    bool trusted) const
+{
+	std::size_t end;
+	if (auto r = validate(input, end, trusted); r != errc::ok)
+		return r;
+	if (end != input.size())
+		return errc::trailing_data;
+	cursor c{input, true};
+	event ev;
+	while (c.next(ev), ev.type != token::eof)
+		if (detail::packed_reserved(ev))
+			return errc::type_mismatch;
+
+	enc.tag(113);
+	enc.array(3);
+	enc.array(shared_.size());
+	for (const auto &s : shared_)
+		enc.raw({reinterpret_cast<const std::byte *>(s.data()),
+		    s.size()});
+	enc.array(prefixes_.size());
+	for (const auto &p : prefixes_)
+		enc.text(p);
+
+	c = cursor{input, true};
+	bool chunked = false;
+	while (c.next(ev), ev.type != token::eof) {
+		const auto raw = input.subspan(ev.offset, c.offset() - ev.offset);
+		switch (ev.type) {
+		case token::tag:
+			enc.tag(ev.value);
+			continue;
+		case token::array_begin:
+			enc.array(ev.is_indefinite() ? indefinite : ev.value);
+			continue;
+		case token::map_begin:
+			enc.map(ev.is_indefinite() ? indefinite : ev.value);
+			continue;
+		case token::bytes_begin:
+			enc.bytes_begin();
+			chunked = true;
+			continue;
+		case token::text_begin:
+			enc.text_begin();
+			chunked = true;
+			continue;
+		case token::array_end:
+		case token::map_end:
+		case token::bytes_end:
+		case token::text_end:
+			/* definite length containers end without a break */
+			if (!raw.empty())
+				enc.end();
+			chunked = false;
+			continue;
+		default:
+			break;
+		}
+
+		if (!chunked) {
+			const std::string_view key{
+			    reinterpret_cast<const char *>(raw.data()),
+			    raw.size()};
+			if (auto i = index_.find(key); i != index_.end()) {
+				reference(enc, i->second);
+				continue;
+			}
+		}
+		if (ev.type == token::text && !chunked) {
+			const std::string_view s = ev.text();
+			std::size_t best = 0, len = 0;
+			for (std::size_t i = 0; i < prefixes_.size(); ++i)
+				if (prefixes_[i].size() > len &&
+				    s.starts_with(prefixes_[i])) {
+					best = i;
+					len = prefixes_[i].size();
+				}
+			if (len) {
+				enc.tag(224 + best);
+				enc.text(s.substr(len));
+				continue;
+			}
+		}
+		if (chunked && ev.type == token::text)
+			enc.text(ev.text());
+		else if (chunked)
+			enc.bytes(ev.bytes());
+		else
+			enc.raw(raw);
+	}
+	return enc.status();
+}
+
+/*
+ * Pack the single item in input with tables built from it alone.
+ */
+template<typename Sink>
+inline errc
+pack(std::span<const std::byte> input, encoder<Sink> &enc,
+    bool trusted = false)
+{
+	packer p;
+	if (auto r = p.add(input, trusted); r != errc::ok)
+		return r;
+	p.build();
+	return p.write(input, enc, true);
+}
+
+class packed_document;
+
+class packed_value {
+public:
+	packed_value() noexcept = default;
+
+	/*
+	 * False for the value returned by a failed find, and for values
+	 * whose reference cannot be resolved.
+	 */
+	explicit operator bool() const noexcept
+	{
+		return static_cast<bool>(v_);
+	}
+
+	cbor::kind kind() const noexcept
+	{
+		return v_.kind();
+	}
+
+	bool is(cbor::kind k) const noexcept
+	{
+		return kind() == k;
+	}
+
+	/*
+	 * Accessors, as for lazy_value. The value must be of the matching
+	 * kind.
+	 */
+
+	std::uint64_t as_uint() const noexcept
+	{
+		return v_.as_uint();
+	}
+
+	bool as_bool() const noexcept
+	{
+		return v_.as_bool();
+	}
+
+	double as_double() const noexcept
+	{
+		return v_.as_double();
+	}
+
+	std::span<const std::byte> as_bytes() const;
+	std::string_view as_text() const;
+
+	std::size_t size() const
+	{
+		return v_.size() + (arg_ ? arg_.size() : 0);
+	}
+
+	packed_value operator[](std::size_t i) const;
+	packed_value key(std::size_t i) const;
+	packed_value val(std::size_t i) const;
+
+	/*
+	 * Map lookup. Where a merged map has a key twice, the entry from the
+	 * rump is found.
+	 */
+	packed_value find(std::string_view key) const;
+	packed_value find(std::int64_t key) const;
+
+	std::uint64_t tag_number() const noexcept
+	{
+		return v_.tag_number();
+	}
+
+	packed_value tagged() const;
+
+	/*
+	 * True if the value is joined from an argument and a rump.
+	 */
+	bool joined() const noexcept
+	{
+		return static_cast<bool>(arg_);
+	}
+
+	/*
+	 * Encoded bytes of the item, or of the rump of a joined value.
+	 * References within it are not resolved.
+	 */
+	std::span<const std::byte> raw() const noexcept
+	{
+		return v_.raw();
+	}
+
+private:
+	friend class packed_document;
+
+	packed_value(packed_document *doc, lazy_value v, lazy_value arg = {},
+	    const std::byte *site = nullptr, bool suffix = false) noexcept
+	: doc_{doc}
+	, v_{v}
+	, arg_{arg}
+	, site_{site}
+	, suffix_{suffix}
+	{ }
+
+	/* item i of a joined array, or entry i of a joined map */
+	lazy_value part(std::size_t i, std::size_t per) const;
+
+	std::span<const std::byte> join() const;
+
+	packed_document *doc_ = nullptr;
+	lazy_value v_;
+	lazy_value arg_;		/* argument of a joined value */
+	const std::byte *site_ = nullptr;	/* reference tag */
+	bool suffix_ = false;		/* argument follows the rump */
+};
+
+class packed_document {
+public:
+	packed_document() noexcept
+	: mr_{&own_}
+	, doc_{&own_}
+	{ }
+
+	/*
+	 * Document allocating from mr, which must outlive it.
+	 */
+	explicit packed_document(std::pmr::memory_resource *mr) noexcept
+	: mr_{mr}
+	, doc_{mr}
+	{ }
+
+	packed_document(const packed_document &) = delete;
+	packed_document &operator=(const packed_document &) = delete;
+
+	/*
+	 * Replace the root with the single item in input, which must outlive
+	 * the document. Tag 113 at the root must hold two arrays and the
+	 * rump, or errc::invalid_packed is returned; references are checked
+	 * only as they are resolved. See cursor for the meaning of trusted.
+	 */
+	errc parse(std::span<const std::byte> input, bool trusted = false)
+	{
+		packed_ = false;
+		joined_.clear();
+		if (auto r = doc_.parse(input, trusted); r != errc::ok)
+			return r;
+		lazy_value root = doc_.root();
+		if (!root.is(kind::tag) || root.tag_number() != 113) {
+			rump_ = root;
+			return errc::ok;
+		}
+		root = root.tagged();
+		if (!root.is(kind::array) || root.size() != 3 ||
+		    !root[0].is(kind::array) || !root[1].is(kind::array))
+			return errc::invalid_packed;
+		shared_ = root[0];
+		args_ = root[1];
+		rump_ = root[2];
+		packed_ = true;
+		return errc::ok;
+	}
+
+	/*
+	 * Root value, the unpacked rump. Only valid after a successful parse.
+	 */
+	packed_value root()
+	{
+		return make(rump_);
+	}
+
+private:
+	friend class packed_value;
+
+	lazy_value resolve(lazy_value v) const;
+	packed_value make(lazy_value v);
+
+	std::pmr::monotonic_buffer_resource own_;
+	std::pmr::memory_resource *mr_;
+	lazy_document doc_;
+	lazy_value shared_;
+	lazy_value args_;
+	lazy_value rump_;
+	bool packed_ = false;
+	std::unordered_map<const std::byte *, std::span<const std::byte>>
+	    joined_;
+};
+
+/*
+ * Follow shared item references. Returns an empty value for a reference
+ * past the end of the table or a cycle of references.
+ */
+inline lazy_value
+packed_document::resolve(lazy_value v) const
+{
+	if (!packed_)
+		return v;
+	for (std::size_t hops = 0; hops <= shared_.size(); ++hops) {
+		std::uint64_t i;
+		if (v.is(kind::simple) && v.as_uint() < 16)
+			i = v.as_uint();
+		else if (v.is(kind::tag) && v.tag_number() == 6 &&
+		    (v.tagged().is(kind::uint) || v.tagged().is(kind::nint))) {
+			const std::uint64_t n = v.tagged().as_uint();
+			if (n > (UINT64_MAX - 17) / 2)
+				return {};
+			i = 16 + 2 * n + v.tagged().is(kind::nint);
+		} else
+			return v;
+		if (i >= shared_.size())
+			return {};
+		v = shared_[i];
+	}
+	return {};
+}
+
+inline packed_value
+packed_document::make(lazy_value v)
+{
+	v = resolve(v);
+	std::size_t i;
+	bool suffix;
+	if (!v || !v.is(kind::tag) || !packed_)
+		return {this, v};
+	if (detail::packed_unsupported(v.tag_number()))
+		return {};
+	if (!detail::packed_argument(v.tag_number(), i, suffix))
+		return {this, v};
+	if (i >= args_.size())
+		return {};
+	const lazy_value a = resolve(args_[i]);
+	const lazy_value r = resolve(v.tagged());
+	if (!a || !r)
+		return {};
+	const cbor::kind k = r.kind();
+	if (a.kind() != k || (k != kind::bytes && k != kind::text &&
+	    k != kind::array && k != kind::map))
+		return {};
+	return {this, r, a, v.raw().data(), suffix};
+}
+
+/*
+ * Concatenate the strings of a joined value in the document's memory
+ * resource, once.
+ */
+inline std::span<const std::byte>
+packed_value::join() const
+{
+	auto &cache = doc_->joined_;
+	if (auto i = cache.find(site_); i != cache.end())
+		return i->second;
+	const auto content = [](const lazy_value &v) {
+		if (!v.is(kind::text))
+			return v.as_bytes();
+		const std::string_view s = v.as_text();
+		return std::span<const std::byte>{
+		    reinterpret_cast<const std::byte *>(s.data()), s.size()};
+	};
+	const auto first = content(suffix_ ? v_ : arg_);
+	const auto second = content(suffix_ ? arg_ : v_);
+	const std::size_t n = first.size() + second.size();
+	auto *p = static_cast<std::byte *>(doc_->mr_->allocate(n ? n : 1, 1));
+	if (!first.empty())
+		std::memcpy(p, first.data(), first.size());
+	if (!second.empty())
+		std::memcpy(p + first.size(), second.data(), second.size());
+	return cache.emplace(site_, std::span<const std::byte>{p, n})
+	    .first->second;
+}
+
+inline std::span<const std::byte>
+packed_value::as_bytes() const
+{
+	return arg_ ? join() : v_.as_bytes();
+}
+
+inline std::string_view
+packed_value::as_text() const
+{
+	if (!arg_)
+		return v_.as_text();
+	const auto s = join();
+	return {reinterpret_cast<const char *>(s.data()), s.size()};
+}
+
+inline lazy_value
+packed_value::part(std::size_t i, std::size_t per) const
+{
+	const lazy_value &first = suffix_ ? v_ : arg_;
+	const lazy_value &second = suffix_ ? arg_ : v_;
+	const bool map = v_.is(kind::map);
+	const std::size_t n = first.size();
+	const std::size_t e = i / 2;
+	if (!map)
+		return i < n ? first[i] : second[i - n];
+	if (e < n)
+		return per ? first.val(e) : first.key(e);
+	return per ? second.val(e - n) : second.key(e - n);
+}
+
+inline packed_value
+packed_value::operator[](std::size_t i) const
+{
+	return doc_->make(arg_ ? part(i, 0) : v_[i]);
+}
+
+inline packed_value
+packed_value::key(std::size_t i) const
+{
+	return doc_->make(arg_ ? part(2 * i, 0) : v_.key(i));
+}
+
+inline packed_value
+packed_value::val(std::size_t i) const
+{
+	return doc_->make(arg_ ? part(2 * i, 1) : v_.val(i));
+}
+
+inline packed_value
+packed_value::tagged() const
+{
+	return doc_->make(v_.tagged());
+}
+
+inline packed_value
+packed_value::find(std::string_view key) const
+{
+	/* start with the entries of the rump */
+	const std::size_t n = size();
+	const std::size_t first = arg_ && !suffix_ ? arg_.size() : 0;
+	for (std::size_t j = 0; j < n; ++j) {
+		const std::size_t i = (first + j) % n;
+		const packed_value k = this->key(i);
+		if (k && k.is(kind::text) && k.as_text() == key)
+			return val(i);
+	}
+	return {};
+}
+
+inline packed_value
+packed_value::find(std::int64_t key) const
+{
+	const value want = value::integer(key);
+	const cbor::kind t = want.is(kind::uint) ? kind::uint : kind::nint;
+	const std::size_t n = size();
+	const std::size_t first = arg_ && !suffix_ ? arg_.size() : 0;
+	for (std::size_t j = 0; j < n; ++j) {
+		const std::size_t i = (first + j) % n;
+		const packed_value k = this->key(i);
+		if (k && k.is(t) && k.as_uint() == want.as_uint())
+			return val(i);
+	}
+	return {};
+}
+
+namespace detail {
+
+template<typename Sink>
+inline errc
+unpack(const packed_value &v, encoder<Sink> &enc, unsigned depth)
+{
+	if (!v)
+		return errc::invalid_packed;
+	if (depth > max_depth)
+		return errc::depth_exceeded;
+	switch (v.kind()) {
+	case kind::bytes:
+		enc.bytes(v.as_bytes());
+		break;
+	case kind::text:
+		enc.text(v.as_text());
+		break;
+	case kind::array: {
+		const std::size_t n = v.size();
+		enc.array(n);
+		for (std::size_t i = 0; i < n; ++i)
+			if (auto r = unpack(v[i], enc, depth + 1); r != errc::ok)
+				return r;
+		break;
+	}
+	case kind::map: {
+		const std::size_t n = v.size();
+		enc.map(n);
+		for (std::size_t i = 0; i < n; ++i) {
+			if (auto r = unpack(v.key(i), enc, depth + 1);
+			    r != errc::ok)
+				return r;
+			if (auto r = unpack(v.val(i), enc, depth + 1);
+			    r != errc::ok)
+				return r;
+		}
+		break;
+	}
+	case kind::tag:
+		enc.tag(v.tag_number());
+		return unpack(v.tagged(), enc, depth + 1);
+	default:
+		enc.raw(v.raw());
+		break;
+	}
+	return enc.status();
+}
+
+}
+
+/*
+ * Write v with all references resolved. Strings and containers are written
+ * with definite length. A shared item is written out again wherever it is
+ * referenced, so a small hostile message can unpack to a very large item;
+ * bound the output with the sink if the input is not trusted.
+ */
+template<typename Sink>
+inline errc
+unpack(const packed_value &v, encoder<Sink> &enc)
+{
+	return detail::unpack(v, enc, 0);
+}
+
+}
@@ -0,0 +1,256 @@
+#pragma once
+
+/*
+ * Path queries over encoded CBOR.
+ *
+ * A path is compiled once from an expression in the style of JSON Pointer
+ * (RFC 6901) and then matched against input with a cursor. Containers off
+ * the path are skipped without being decoded and nothing is allocated, so
+ * picking a few fields out of a message costs little more than scanning it.
+ * Each match is reported as the span of its encoded bytes, which can be
+ * passed on unchanged or decoded with cursor, codec or document.
+ *
+ * Syntax:
+ *
+ *	""		the item itself
+ *	"/name"		map value with text key "name"
+ *	"/3"		array item 3, or map value with key 3 or "3"
+ *	"/-2"		map value with key -2 or "-2"
+ *	"/" "*"		every array item or map value
+ *	"~0" "~1" "~2"	"~", "/" and a literal "*" within a segment
+ *
+ * Tags on containers along the path are looked through. Map keys which are
+ * not text or integers never match a named segment.
+ *
+ * Example:
+ *
+ *	cbor::path p;
+ *	p.compile("/users/" "*" "/id");
+ *	p.match(msg, [&](std::span<const std::byte> id) {
+ *		route(id);
+ *	});
+ */
+
+#include "cursor.h"
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace cbor {
+
+class path {
+public:
+	/*
+	 * Replace the path with expr. On error the path is left empty.
+	 */
+	errc compile(std::string_view expr);
+
+	/*
+	 * Number of segments.
+	 */
+	std::size_t size() const noexcept
+	{
+		return segs_.size();
+	}
+
+	/*
+	 * Call f(std::span<const std::byte>) for every item in input that the
+	 * path selects, in input order. Input is walked as a CBOR sequence. If
+	 * f returns bool, returning false stops the walk. See cursor for the
+	 * meaning of trusted.
+	 *
+	 * Input is only checked as far as it is read, so an error is returned
+	 * for malformed input only if it lies on the path or before the last
+	 * item visited; items already reported remain valid.
+	 */
+	template<typename F>
+	errc match(std::span<const std::byte> input, F &&f,
+	    bool trusted = false) const;
+
+private:
+	struct segment {
+		std::string key;		/* text key, unescaped */
+		std::uint64_t index = 0;	/* array index or integer key */
+		bool any = false;		/* wildcard */
+		bool numeric = false;		/* index is valid */
+		bool negative = false;		/* integer key is -1 - index */
+	};
+
+	template<typename F>
+	errc visit(cursor &c, std::size_t level, F &f, bool &stop) const;
+
+	static errc key_matches(cursor &c, const segment &s, bool &hit);
+
+	std::vector<segment> segs_;
+};
+
+inline errc
+path::compile(std::string_view expr)
+{
+	segs_.clear();
+	if (expr.empty())
+		return errc::ok;
+	if (expr.front() != '/')
+		return errc::invalid_path;
+	std::size_t i = 1;
+	for (;;) {
+		const std::size_t e = std::min(expr.find('/', i), expr.size());
+		const std::string_view raw = expr.substr(i, e - i);
+		segment s;
+		if (raw == "*")
+			s.any = true;
+		for (std::size_t j = 0; !s.any && j < raw.size(); ++j) {
+			if (raw[j] != '~') {
+				s.key += raw[j];
+				continue;
+			}
+			if (++j == raw.size() || raw[j] < '0' || raw[j] > '2') {
+				segs_.clear();
+				return errc::invalid_path;
+			}
+			s.key += "~/*"[raw[j] - '0'];
+		}
+
+		/* decimal integer without leading zeros */
+		std::string_view d = raw;
+		s.negative = !d.empty() && d.front() == '-';
+		if (s.negative)
+			d.remove_prefix(1);
+		s.numeric = !d.empty() && d.size() <= 20 &&
+		    (d.size() == 1 || d.front() != '0');
+		for (std::size_t j = 0; s.numeric && j < d.size(); ++j) {
+			const unsigned digit = d[j] - '0';
+			if (digit > 9 || s.index > (UINT64_MAX - digit) / 10)
+				s.numeric = false;
+			else
+				s.index = s.index * 10 + digit;
+		}
+		if (s.negative) {
+			if (s.numeric && !s.index)
+				s.numeric = false;
+			--s.index;
+		}
+
+		segs_.push_back(std::move(s));
+		if (segs_.size() > max_depth) {
+			segs_.clear();
+			return errc::invalid_path;
+		}
+		if (e == expr.size())
+			return errc::ok;
+		i = e + 1;
+	}
+}
+
+/*
+ * Consume the map key at c and decide whether it matches s.
+ */
+inline errc
+path::key_matches(cursor &c, const segment &s, bool &hit)
+{
+	event k;
+	if (auto r = c.next(k); r != errc::ok)
+		return r;
+	hit = s.any;
+	switch (k.type) {
+	case token::text:
+		hit |= k.text() == s.key;
+		return errc::ok;
+	case token::uint:
+		hit |= s.numeric && !s.negative && k.value == s.index;
+		return errc::ok;
+	case token::nint:
+		hit |= s.numeric && s.negative && k.value == s.index;
+		return errc::ok;
+	case token::text_begin: {
+		/* compare chunk by chunk */
+		std::size_t pos = 0;
+		bool eq = true;
+		for (;;) {
+			if (auto r = c.next(k); r != errc::ok)
+				return r;
+			if (k.type == token::text_end)
+				break;
+			eq = eq && k.value <= s.key.size() - pos &&
+			    !std::memcmp(s.key.data() + pos, k.data, k.value);
+			pos += eq ? k.value : 0;
+		}
+		hit |= eq && pos == s.key.size();
+		return errc::ok;
+	}
+	default:
+		return detail::skip_rest(c, k);
+	}
+}
+
+template<typename F>
+inline errc
+path::visit(cursor &c, std::size_t level, F &f, bool &stop) const
+{
+	const std::span<const std::byte> in = c.input();
+	const std::size_t start = c.offset();
+
+	if (level == segs_.size()) {
+		if (auto r = c.skip(); r != errc::ok)
+			return r;
+		const auto item = in.subspan(start, c.offset() - start);
+		if constexpr (std::is_same_v<std::invoke_result_t<F &,
+		    std::span<const std::byte>>, bool>)
+			stop = !f(item);
+		else
+			f(item);
+		return errc::ok;
+	}
+
+	event ev;
+	do {
+		if (auto r = c.next(ev); r != errc::ok)
+			return r;
+	} while (ev.type == token::tag);
+	if (ev.type == token::eof)
+		return errc::ok;
+	if (ev.type != token::array_begin && ev.type != token::map_begin)
+		return detail::skip_rest(c, ev);
+
+	const segment &s = segs_[level];
+	const bool map = ev.type == token::map_begin;
+	const bool indef = ev.is_indefinite();
+	const std::uint64_t n = ev.value;
+	for (std::uint64_t i = 0; !stop; ++i) {
+		if (indef ? c.offset() < in.size() &&
+		    in[c.offset()] == std::byte{0xff} : i == n)
+			break;
+		bool hit;
+		if (map) {
+			if (auto r = key_matches(c, s, hit); r != errc::ok)
+				return r;
+		} else
+			hit = s.any || (s.numeric && !s.negative && i == s.index);
+		if (auto r = hit ? visit(c, level + 1, f, stop) : c.skip();
+		    r != errc::ok)
+			return r;
+		/* named segments match at most once */
+		if (hit && !s.any)
+			break;
+	}
+	if (stop)
+		return errc::ok;
+	return c.leave(ev);
+}
+
+template<typename F>
+inline errc
+path::match(std::span<const std::byte> input, F &&f, bool trusted) const
+{
+	cursor c{input, trusted};
+	bool stop = false;
+	while (!stop && c.offset() < input.size())
+		if (auto r = visit(c, 0, f, stop); r != errc::ok)
+			return r;
+	return errc::ok;
+}
+
+}
@@ -0,0 +1,378 @@
+#pragma once
+
+/*
+ * Encoding and decoding of aggregates described by field lists.
+ *
+ * Describe a type once by specialising cbor::reflect with a tuple of
+ * fields. Keys are either integers or text:
+ *
+ *	template<>
+ *	struct cbor::reflect<reading> {
+ *		static constexpr auto fields = std::make_tuple(
+ *			cbor::field(1, &reading::sensor),
+ *			cbor::field(2, &reading::value));
+ *	};
+ *
+ * or, for text keys named after the members, use CBOR_REFLECT at global
+ * scope:
+ *
+ *	CBOR_REFLECT(reading, sensor, value)
+ *
+ * The type is then encoded as a map and decoded from one with a codec
+ * generated from the field list, without an intermediate document. Unknown
+ * keys are skipped when decoding and absent fields are left untouched.
+ */
+
+#include "codec.h"
+
+#include <bit>
+#include <tuple>
+#include <utility>
+
+namespace cbor {
+
+template<typename T>
+struct reflect;
+
+namespace detail {
+
+template<typename K, typename C, typename M>
+struct field_desc {
+	using key_type = K;
+	using type = M;
+
+	K key;
+	M C::*member;
+};
+
+}
+
+template<typename C, typename M>
+constexpr auto
+field(std::int64_t key, M C::*member) noexcept
+{
+	return detail::field_desc<std::int64_t, C, M>{key, member};
+}
+
+template<typename C, typename M>
+constexpr auto
+field(std::string_view key, M C::*member) noexcept
+{
+	return detail::field_desc<std::string_view, C, M>{key, member};
+}
+
+template<typename T>
+concept reflected = requires { reflect<T>::fields; };
+
+namespace detail {
+
+template<typename Sink>
+inline void
+encode_key(encoder<Sink> &enc, std::int64_t key)
+{
+	enc.integer(key);
+}
+
+template<typename Sink>
+inline void
+encode_key(encoder<Sink> &enc, std::string_view key)
+{
+	enc.text(key);
+}
+
+constexpr bool
+key_matches(std::int64_t key, const event &ev) noexcept
+{
+	if (key >= 0)
+		return ev.type == token::uint &&
+		    ev.value == static_cast<std::uint64_t>(key);
+	return ev.type == token::nint &&
+	    ev.value == static_cast<std::uint64_t>(-1 - key);
+}
+
+constexpr bool
+key_matches(std::string_view key, const event &ev) noexcept
+{
+	return ev.type == token::text && ev.text() == key;
+}
+
+/*
+ * String hash used for text key lookup. Usable at compile time; at run time
+ * the byte assembly compiles to plain loads.
+ */
+constexpr std::uint64_t
+key_load(std::string_view s, std::size_t i, std::size_t n) noexcept
+{
+	std::uint64_t v = 0;
+	for (std::size_t j = 0; j < n; ++j)
+		v |= static_cast<std::uint64_t>(
+		    static_cast<unsigned char>(s[i + j])) << (8 * j);
+	return v;
+}
+
+constexpr std::uint64_t
+key_mix(std::uint64_t h) noexcept
+{
+	h ^= h >> 32;
+	h *= 0xd6e8feb86659fd93;
+	h ^= h >> 32;
+	return h;
+}
+
+constexpr std::uint64_t
+key_hash(std::string_view s) noexcept
+{
+	std::uint64_t h = 0x9e3779b97f4a7c15 ^ s.size();
+	std::size_t i = 0;
+	for (; i + 8 <= s.size(); i += 8) {
+		h = (h ^ key_load(s, i, 8)) * 0xbf58476d1ce4e5b9;
+		h ^= h >> 31;
+	}
+	if (i < s.size())
+		h = (h ^ key_load(s, i, s.size() - i)) * 0x94d049bb133111eb;
+	return key_mix(h);
+}
+
+/*
+ * Perfect hash over the text keys of a field list, built at compile time
+ * with hash and displace: keys are split into buckets by the top bits of
+ * their hash and each bucket gets a displacement which sends all of its
+ * keys to free slots. A lookup is one string hash, two table reads and a
+ * single comparison to reject unknown keys.
+ */
+template<std::size_t N>
+struct key_table {
+	static constexpr std::size_t slot_count = std::bit_ceil(2 * N + 1);
+	static constexpr std::size_t bucket_bits =
+	    std::bit_width(std::bit_ceil(N / 2 + 1)) - 1;
+	static constexpr std::size_t bucket_count = std::size_t{1} << bucket_bits;
+	static constexpr std::size_t npos = SIZE_MAX;
+
+	std::string_view names[N + 1]{};
+	std::uint16_t fields[N + 1]{};		/* field index of names[i] */
+	std::uint16_t slots[slot_count]{};	/* 1 + index into names */
+	std::uint16_t disp[bucket_count]{};
+
+	static constexpr std::size_t bucket(std::uint64_t h) noexcept
+	{
+		return bucket_bits ? h >> (64 - bucket_bits) : 0;
+	}
+
+	static constexpr std::size_t slot(std::uint64_t h,
+	    std::uint16_t d) noexcept
+	{
+		return key_mix(h ^ (d * 0x9e3779b97f4a7c15)) & (slot_count - 1);
+	}
+
+	constexpr void build()
+	{
+		std::uint64_t hash[N + 1]{};
+		std::size_t order[N + 1]{};	/* keys sorted by bucket size */
+		std::size_t size[bucket_count]{};
+		for (std::size_t i = 0; i < N; ++i) {
+			hash[i] = key_hash(names[i]);
+			for (std::size_t j = 0; j < i; ++j)
+				if (hash[j] == hash[i])
+					throw "duplicate or colliding field key";
+			++size[bucket(hash[i])];
+		}
+
+		/* group keys by bucket, largest buckets first */
+		std::size_t n = 0;
+		while (n < N) {
+			std::size_t b = 0;
+			for (std::size_t i = 1; i < bucket_count; ++i)
+				if (size[i] > size[b])
+					b = i;
+			for (std::size_t i = 0; i < N; ++i)
+				if (bucket(hash[i]) == b)
+					order[n++] = i;
+			size[b] = 0;
+		}
+
+		for (std::size_t i = 0; i < N;) {
+			const std::size_t b = bucket(hash[order[i]]);
+			std::size_t e = i + 1;
+			while (e < N && bucket(hash[order[e]]) == b)
+				++e;
+			for (std::uint16_t d = 0;; ++d) {
+				if (d == UINT16_MAX)
+					throw "no perfect hash for field keys";
+				if (try_place(hash, order + i, e - i, d)) {
+					disp[b] = d;
+					break;
+				}
+			}
+			i = e;
+		}
+	}
+
+	constexpr bool try_place(const std::uint64_t *hash,
+	    const std::size_t *keys, std::size_t n, std::uint16_t d)
+	{
+		for (std::size_t i = 0; i < n; ++i) {
+			const std::size_t s = slot(hash[keys[i]], d);
+			if (slots[s])
+				return false;
+			for (std::size_t j = 0; j < i; ++j)
+				if (slot(hash[keys[j]], d) == s)
+					return false;
+		}
+		for (std::size_t i = 0; i < n; ++i)
+			slots[slot(hash[keys[i]], d)] =
+			    static_cast<std::uint16_t>(keys[i] + 1);
+		return true;
+	}
+
+	/*
+	 * Field index for key, or npos.
+	 */
+	constexpr std::size_t find(std::string_view key) const noexcept
+	{
+		if constexpr (N == 0)
+			return npos;
+		const std::uint64_t h = key_hash(key);
+		const std::size_t i = slots[slot(h, disp[bucket(h)])];
+		if (!i || names[i - 1] != key)
+			return npos;
+		return fields[i - 1];
+	}
+};
+
+template<typename T>
+using fields_t = std::remove_cvref_t<decltype(reflect<T>::fields)>;
+
+template<typename T, std::size_t I>
+inline constexpr bool text_key = std::is_same_v<typename
+    std::tuple_element_t<I, fields_t<T>>::key_type, std::string_view>;
+
+template<typename T, std::size_t... I>
+consteval auto
+make_key_table(std::index_sequence<I...>)
+{
+	constexpr std::size_t n = (std::size_t{0} + ... + text_key<T, I>);
+	static_assert(n < UINT16_MAX, "too many fields");
+	key_table<n> t;
+	std::size_t i = 0;
+	const auto add = [&]<std::size_t J>(
+	    std::integral_constant<std::size_t, J>) {
+		if constexpr (text_key<T, J>) {
+			t.names[i] = std::get<J>(reflect<T>::fields).key;
+			t.fields[i++] = J;
+		}
+	};
+	(add(std::integral_constant<std::size_t, I>{}), ...);
+	t.build();
+	return t;
+}
+
+/*
+ * Index of the field matching key, or the field count if there is none.
+ *
+ * Text keys are looked up in the perfect hash table; integer keys are
+ * matched by a fold the compiler turns into a comparison tree.
+ */
+template<typename T, std::size_t... I>
+inline std::size_t
+find_field(const event &key, std::index_sequence<I...> seq) noexcept
+{
+	constexpr auto &fields = reflect<T>::fields;
+	if (key.type == token::text) {
+		static constexpr auto table = make_key_table<T>(seq);
+		const std::size_t i = table.find(key.text());
+		return i == table.npos ? sizeof...(I) : i;
+	}
+	std::size_t i = sizeof...(I);
+	(void)((!text_key<T, I> && key_matches(std::get<I>(fields).key, key)
+	    ? (i = I, true) : false) || ...);
+	return i;
+}
+
+template<typename T, std::size_t... I>
+inline errc
+decode_field(cursor &c, T &v, std::size_t i, std::index_sequence<I...>)
+{
+	constexpr auto &fields = reflect<T>::fields;
+	errc r = errc::ok;
+	(void)((i == I ? (r = cbor::decode(c, v.*std::get<I>(fields).member),
+	    true) : false) || ...);
+	return r;
+}
+
+}
+
+template<reflected T>
+struct codec<T> {
+	static constexpr auto &fields = reflect<T>::fields;
+	static constexpr std::size_t size = std::tuple_size_v<
+	    std::remove_cvref_t<decltype(fields)>>;
+	using indices = std::make_index_sequence<size>;
+
+	template<typename Sink>
+	static void encode(encoder<Sink> &enc, const T &v)
+	{
+		enc.map(size);
+		std::apply([&](const auto &...f) {
+			((detail::encode_key(enc, f.key),
+			    codec<typename std::remove_cvref_t<
+			    decltype(f)>::type>::encode(enc, v.*f.member)), ...);
+		}, fields);
+	}
+
+	static errc decode(cursor &c, const event &ev, T &v)
+	{
+		if (ev.type != token::map_begin)
+			return errc::type_mismatch;
+		event key;
+		for (;;) {
+			if (auto r = c.next(key); r != errc::ok)
+				return r;
+			if (key.type == token::map_end)
+				return errc::ok;
+			const std::size_t i = detail::find_field<T>(key,
+			    indices{});
+			if (auto r = detail::skip_rest(c, key); r != errc::ok)
+				return r;
+			const errc r = i < size
+			    ? detail::decode_field(c, v, i, indices{}) : c.skip();
+			if (r != errc::ok)
+				return r;
+		}
+	}
+};
+
+}
+
+/*
+ * CBOR_REFLECT(type, member...)
+ *
+ * Specialise cbor::reflect for type with text keys named after each member.
+ * Must be used at global scope.
+ */
+#define CBOR_REFLECT(T, ...) \
+	template<> \
+	struct cbor::reflect<T> { \
+		static constexpr auto fields = std::make_tuple( \
+		    CBOR_DETAIL_FOR_EACH(T, __VA_ARGS__)); \
+	};
+
+#define CBOR_DETAIL_PARENS ()
+#define CBOR_DETAIL_EXPAND(...) \
+	CBOR_DETAIL_EXPAND4(CBOR_DETAIL_EXPAND4(CBOR_DETAIL_EXPAND4( \
+	    CBOR_DETAIL_EXPAND4(__VA_ARGS__))))
+#define CBOR_DETAIL_EXPAND4(...) \
+	CBOR_DETAIL_EXPAND3(CBOR_DETAIL_EXPAND3(CBOR_DETAIL_EXPAND3( \
+	    CBOR_DETAIL_EXPAND3(__VA_ARGS__))))
+#define CBOR_DETAIL_EXPAND3(...) \
+	CBOR_DETAIL_EXPAND2(CBOR_DETAIL_EXPAND2(CBOR_DETAIL_EXPAND2( \
+	    CBOR_DETAIL_EXPAND2(__VA_ARGS__))))
+#define CBOR_DETAIL_EXPAND2(...) \
+	CBOR_DETAIL_EXPAND1(CBOR_DETAIL_EXPAND1(CBOR_DETAIL_EXPAND1( \
+	    CBOR_DETAIL_EXPAND1(__VA_ARGS__))))
+#define CBOR_DETAIL_EXPAND1(...) __VA_ARGS__
+#define CBOR_DETAIL_FOR_EACH(T, ...) \
+	__VA_OPT__(CBOR_DETAIL_EXPAND(CBOR_DETAIL_FOR_EACH_1(T, __VA_ARGS__)))
+#define CBOR_DETAIL_FOR_EACH_1(T, m, ...) \
+	::cbor::field(#m, &T::m) \
+	__VA_OPT__(, CBOR_DETAIL_FOR_EACH_AGAIN CBOR_DETAIL_PARENS (T, __VA_ARGS__))
+#define CBOR_DETAIL_FOR_EACH_AGAIN() CBOR_DETAIL_FOR_EACH_1
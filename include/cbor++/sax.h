@@ -0,0 +1,213 @@
+#pragma once
+
+/*
+ * Event driven decoder with compile time handler dispatch.
+ *
+ * sax_decode walks the input and calls member functions on a user supplied
+ * handler. Handlers are resolved statically so the decode loop inlines into
+ * the handler; any callback the handler does not declare is skipped.
+ *
+ * Callbacks may return void or cbor::action. Returning action::skip from a
+ * *_begin or tag callback skips the rest of that item without further
+ * callbacks, which is useful for projecting a few fields out of a large
+ * document. Returning action::stop ends decoding.
+ *
+ * Callbacks:
+ *
+ *	on_uint(std::uint64_t v)
+ *	on_nint(std::uint64_t v)		value is -1 - v
+ *	on_bytes(std::span<const std::byte>)	also called for each chunk
+ *	on_text(std::string_view)		also called for each chunk
+ *	on_key(std::string_view)		definite text map key; if not
+ *						declared on_text is called
+ *	on_bytes_begin(), on_bytes_end()	indefinite length byte string
+ *	on_text_begin(), on_text_end()		indefinite length text string
+ *	on_array_begin(std::uint64_t size)	size may be cbor::indefinite
+ *	on_array_end()
+ *	on_map_begin(std::uint64_t size)	size may be cbor::indefinite
+ *	on_map_end()
+ *	on_tag(std::uint64_t tag)
+ *	on_simple(std::uint8_t v)
+ *	on_bool(bool v)
+ *	on_null()
+ *	on_undefined()
+ *	on_float(double v)
+ */
+
+#include "cursor.h"
+
+#include <type_traits>
+
+namespace cbor {
+
+enum class action {
+	proceed,
+	skip,
+	stop,
+};
+
+namespace detail {
+
+template<typename F>
+inline action
+sax_invoke(F &&f)
+{
+	using R = decltype(f());
+	static_assert(std::is_void_v<R> || std::is_same_v<R, action>,
+	    "sax handler callbacks must return void or cbor::action");
+	if constexpr (std::is_void_v<R>) {
+		f();
+		return action::proceed;
+	} else
+		return f();
+}
+
+}
+
+/*
+ * Decode all items in input, calling handler for each event.
+ *
+ * Returns errc::ok if the input was consumed or the handler stopped the
+ * decode. See cursor for the meaning of trusted.
+ */
+template<typename Handler>
+inline errc
+sax_decode(std::span<const std::byte> input, Handler &&h, bool trusted = false)
+{
+	cursor c{input, trusted};
+	event ev;
+	for (;;) {
+		const bool key = c.at_key();
+		if (auto r = c.next(ev); r != errc::ok)
+			return r;
+		action act = action::proceed;
+		switch (ev.type) {
+		case token::eof:
+			return errc::ok;
+		case token::uint:
+			if constexpr (requires { h.on_uint(ev.value); })
+				act = detail::sax_invoke([&] {
+					return h.on_uint(ev.value);
+				});
+			break;
+		case token::nint:
+			if constexpr (requires { h.on_nint(ev.value); })
+				act = detail::sax_invoke([&] {
+					return h.on_nint(ev.value);
+				});
+			break;
+		case token::bytes:
+			if constexpr (requires { h.on_bytes(ev.bytes()); })
+				act = detail::sax_invoke([&] {
+					return h.on_bytes(ev.bytes());
+				});
+			break;
+		case token::text:
+			if constexpr (requires { h.on_key(ev.text()); }) {
+				if (key) {
+					act = detail::sax_invoke([&] {
+						return h.on_key(ev.text());
+					});
+					break;
+				}
+			}
+			if constexpr (requires { h.on_text(ev.text()); })
+				act = detail::sax_invoke([&] {
+					return h.on_text(ev.text());
+				});
+			break;
+		case token::bytes_begin:
+			if constexpr (requires { h.on_bytes_begin(); })
+				act = detail::sax_invoke([&] {
+					return h.on_bytes_begin();
+				});
+			break;
+		case token::text_begin:
+			if constexpr (requires { h.on_text_begin(); })
+				act = detail::sax_invoke([&] {
+					return h.on_text_begin();
+				});
+			break;
+		case token::bytes_end:
+			if constexpr (requires { h.on_bytes_end(); })
+				act = detail::sax_invoke([&] {
+					return h.on_bytes_end();
+				});
+			break;
+		case token::text_end:
+			if constexpr (requires { h.on_text_end(); })
+				act = detail::sax_invoke([&] {
+					return h.on_text_end();
+				});
+			break;
+		case token::array_begin:
+			if constexpr (requires { h.on_array_begin(ev.value); })
+				act = detail::sax_invoke([&] {
+					return h.on_array_begin(ev.value);
+				});
+			break;
+		case token::map_begin:
+			if constexpr (requires { h.on_map_begin(ev.value); })
+				act = detail::sax_invoke([&] {
+					return h.on_map_begin(ev.value);
+				});
+			break;
+		case token::array_end:
+			if constexpr (requires { h.on_array_end(); })
+				act = detail::sax_invoke([&] {
+					return h.on_array_end();
+				});
+			break;
+		case token::map_end:
+			if constexpr (requires { h.on_map_end(); })
+				act = detail::sax_invoke([&] {
+					return h.on_map_end();
+				});
+			break;
+		case token::tag:
+			if constexpr (requires { h.on_tag(ev.value); })
+				act = detail::sax_invoke([&] {
+					return h.on_tag(ev.value);
+				});
+			break;
+		case token::simple:
+			if constexpr (requires { h.on_simple(std::uint8_t{}); })
+				act = detail::sax_invoke([&] {
+					return h.on_simple(
+					    static_cast<std::uint8_t>(ev.value));
+				});
+			break;
+		case token::boolean:
+			if constexpr (requires { h.on_bool(bool{}); })
+				act = detail::sax_invoke([&] {
+					return h.on_bool(ev.value != 0);
+				});
+			break;
+		case token::null:
+			if constexpr (requires { h.on_null(); })
+				act = detail::sax_invoke([&] {
+					return h.on_null();
+				});
+			break;
+		case token::undefined:
+			if constexpr (requires { h.on_undefined(); })
+				act = detail::sax_invoke([&] {
+					return h.on_undefined();
+				});
+			break;
+		case token::floating:
+			if constexpr (requires { h.on_float(double{}); })
+				act = detail::sax_invoke([&] {
+					return h.on_float(ev.floating());
+				});
+			break;
+		}
+		if (act == action::stop)
+			return errc::ok;
+		if (act == action::skip)
+			if (auto r = detail::skip_rest(c, ev); r != errc::ok)
+				return r;
+	}
+}
+
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+/*
+ * Parallel decoding of CBOR sequences (RFC 8742).
+ *
+ * decode_sequence splits a sequence into items with the validate scan and
+ * hands batches of items to a pool of threads. Each item is decoded on a
+ * worker by decode(std::span<const std::byte>), which must be safe to call
+ * concurrently, and the results are passed to consume on the calling thread
+ * in input order. Scanning, decoding and consuming overlap, and at most a
+ * few batches per thread are in flight, so memory use does not grow with
+ * the input.
+ *
+ * Example:
+ *
+ *	std::size_t end;
+ *	auto r = cbor::decode_sequence(log,
+ *	    [](std::span<const std::byte> item) {
+ *		record rec;
+ *		cbor::decode(item, rec);
+ *		return rec;
+ *	    },
+ *	    [&](record &&rec) {
+ *		store(rec);
+ *	    }, end);
+ */
+
+#include "mapped_file.h"
+#include "validate.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace cbor {
+
+struct sequence_options {
+	unsigned threads = 0;			/* 0: one per hardware thread */
+	std::size_t batch_size = 1 << 20;	/* bytes of items per batch, >= 1 */
+	bool trusted = false;			/* see cursor */
+};
+
+namespace detail {
+
+template<typename R>
+struct sequence_batch {
+	std::size_t begin;
+	std::vector<std::size_t> ends;	/* end offset of each item */
+	std::vector<R> results;
+	bool done = false;
+};
+
+}
+
+/*
+ * Decode every item of the sequence in.
+ *
+ * On success end is set to in.size(). If the sequence is not well-formed
+ * all items before the fault are consumed, end is set to the offset of the
+ * fault and its error is returned. An exception thrown by decode or consume
+ * stops decoding and is rethrown.
+ */
+template<typename Decode, typename Consume>
+inline errc
+decode_sequence(std::span<const std::byte> in, Decode &&decode,
+    Consume &&consume, std::size_t &end, const sequence_options &opt = {})
+{
+	using result = std::invoke_result_t<Decode &, std::span<const std::byte>>;
+	using batch = detail::sequence_batch<result>;
+
+	std::size_t pos = 0;
+	errc err = errc::ok;
+	const std::size_t batch_size = std::max<std::size_t>(1, opt.batch_size);
+
+	/* scan up to one batch of items */
+	const auto scan = [&](batch &b) {
+		b.begin = pos;
+		while (pos < in.size() && pos - b.begin < batch_size) {
+			std::size_t len;
+			err = validate(in.subspan(pos), len, opt.trusted);
+			if (err != errc::ok) {
+				end = pos + len;
+				return;
+			}
+			pos += len;
+			b.ends.push_back(pos);
+		}
+	};
+
+	const auto run = [&](batch &b) {
+		b.results.reserve(b.ends.size());
+		std::size_t p = b.begin;
+		for (std::size_t e : b.ends) {
+			b.results.push_back(decode(in.subspan(p, e - p)));
+			p = e;
+		}
+	};
+
+	unsigned threads = opt.threads;
+	if (!threads)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
+	end = in.size();
+	if (threads == 1) {
+		while (pos < in.size() && err == errc::ok) {
+			batch b;
+			scan(b);
+			run(b);
+			for (auto &r : b.results)
+				consume(std::move(r));
+		}
+		return err;
+	}
+
+	std::mutex m;
+	std::condition_variable work_cv;
+	std::condition_variable done_cv;
+	std::deque<batch *> queue;
+	std::deque<std::unique_ptr<batch>> inflight;	/* outlives workers */
+	std::exception_ptr failure;
+	bool quit = false;
+
+	const auto worker = [&] {
+		std::unique_lock lk{m};
+		for (;;) {
+			work_cv.wait(lk, [&] { return quit || !queue.empty(); });
+			if (quit)
+				return;
+			batch *b = queue.front();
+			queue.pop_front();
+			lk.unlock();
+			try {
+				run(*b);
+			} catch (...) {
+				lk.lock();
+				if (!failure)
+					failure = std::current_exception();
+				done_cv.notify_all();
+				continue;
+			}
+			lk.lock();
+			b->done = true;
+			done_cv.notify_all();
+		}
+	};
+
+	/* stops and joins the workers on every exit path */
+	struct pool {
+		std::mutex &m;
+		std::condition_variable &cv;
+		bool &quit;
+		std::vector<std::thread> threads;
+
+		~pool()
+		{
+			{
+				std::lock_guard lk{m};
+				quit = true;
+			}
+			cv.notify_all();
+			for (auto &t : threads)
+				t.join();
+		}
+	} workers{m, work_cv, quit, {}};
+	for (unsigned i = 0; i < threads; ++i)
+		workers.threads.emplace_back(worker);
+
+	const std::size_t window = 2 * threads;
+	for (;;) {
+		while (pos < in.size() && err == errc::ok &&
+		    inflight.size() < window) {
+			auto b = std::make_unique<batch>();
+			scan(*b);
+			if (b->ends.empty())
+				break;
+			{
+				std::lock_guard lk{m};
+				queue.push_back(b.get());
+			}
+			work_cv.notify_one();
+			inflight.push_back(std::move(b));
+		}
+		if (inflight.empty())
+			return err;
+
+		{
+			std::unique_lock lk{m};
+			done_cv.wait(lk, [&] {
+				return failure || inflight.front()->done;
+			});
+			if (failure)
+				std::rethrow_exception(failure);
+		}
+		const auto b = std::move(inflight.front());
+		inflight.pop_front();
+		for (auto &r : b->results)
+			consume(std::move(r));
+	}
+}
+
+#if __has_include(<sys/mman.h>)
+/*
+ * Decode every item of the sequence in the file at path. See
+ * decode_sequence.
+ */
+template<typename Decode, typename Consume>
+inline std::error_code
+decode_sequence_file(const char *path, Decode &&decode, Consume &&consume,
+    std::size_t &end, const sequence_options &opt = {})
+{
+	mapped_file f;
+	if (auto ec = f.open(path, access::sequential))
+		return ec;
+	return make_error_code(decode_sequence(f.data(),
+	    std::forward<Decode>(decode), std::forward<Consume>(consume), end,
+	    opt));
+}
+#endif
+
+}
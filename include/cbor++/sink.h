@@ -0,0 +1,275 @@
+#pragma once
+
+/*
+ * Output sinks for the encoder.
+ *
+ * A sink must provide:
+ *
+ *	std::byte *prepare(std::size_t n)
+ *		Return room for n contiguous bytes, or nullptr if there is no
+ *		space.
+ *	void commit(std::size_t n)
+ *		n bytes of the prepared room were written.
+ *
+ * and may provide:
+ *
+ *	bool write(std::span<const std::byte> s)
+ *		Append s. Used for string payloads so sinks can avoid a copy.
+ *	void reserve(std::size_t n)
+ *		Hint that at least n more bytes will be written.
+ *	static constexpr std::size_t capacity
+ *		Largest n prepare can ever succeed for.
+ */
+
+#include "core.h"
+
+#include <algorithm>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+#if __has_include(<sys/uio.h>)
+#include <sys/uio.h>
+#endif
+
+namespace cbor {
+
+/*
+ * Sink writing to a fixed buffer.
+ */
+class span_sink {
+public:
+	explicit span_sink(std::span<std::byte> buf) noexcept
+	: buf_{buf}
+	{ }
+
+	std::byte *prepare(std::size_t n) noexcept
+	{
+		return n <= buf_.size() - len_ ? buf_.data() + len_ : nullptr;
+	}
+
+	void commit(std::size_t n) noexcept
+	{
+		len_ += n;
+	}
+
+	/* bytes written so far */
+	std::span<std::byte> data() const noexcept
+	{
+		return buf_.first(len_);
+	}
+
+	std::size_t size() const noexcept
+	{
+		return len_;
+	}
+
+	void clear() noexcept
+	{
+		len_ = 0;
+	}
+
+private:
+	std::span<std::byte> buf_;
+	std::size_t len_ = 0;
+};
+
+/*
+ * Sink appending to a std::vector.
+ *
+ * The vector is grown geometrically while encoding and trimmed to the
+ * encoded size by finish() or on destruction.
+ */
+class vector_sink {
+public:
+	explicit vector_sink(std::vector<std::byte> &v) noexcept
+	: v_{v}
+	, len_{v.size()}
+	{ }
+
+	vector_sink(const vector_sink &) = delete;
+	vector_sink &operator=(const vector_sink &) = delete;
+
+	~vector_sink()
+	{
+		finish();
+	}
+
+	std::byte *prepare(std::size_t n)
+	{
+		if (n > v_.size() - len_)
+			v_.resize(std::max(len_ + n, v_.size() * 2));
+		return v_.data() + len_;
+	}
+
+	void commit(std::size_t n) noexcept
+	{
+		len_ += n;
+	}
+
+	void reserve(std::size_t n)
+	{
+		if (n > v_.size() - len_)
+			v_.resize(len_ + n);
+	}
+
+	/* bytes written so far, including any present before */
+	std::span<std::byte> data() const noexcept
+	{
+		return {v_.data(), len_};
+	}
+
+	std::size_t size() const noexcept
+	{
+		return len_;
+	}
+
+	void finish()
+	{
+		v_.resize(len_);
+	}
+
+private:
+	std::vector<std::byte> &v_;
+	std::size_t len_;
+};
+
+#if __has_include(<sys/uio.h>)
+/*
+ * Sink producing an iovec list for writev.
+ *
+ * Heads and small payloads are copied into internal staging blocks while
+ * payloads of at least ref_threshold bytes are referenced in place and must
+ * remain valid until the iovec list has been written.
+ */
+class iovec_sink {
+public:
+	static constexpr std::size_t block_size = 4096;
+	static constexpr std::size_t ref_threshold = 256;
+
+	std::byte *prepare(std::size_t n)
+	{
+		if (n > cap_ - used_) {
+			cap_ = std::max(n, block_size);
+			blocks_.push_back(
+			    std::make_unique_for_overwrite<std::byte[]>(cap_));
+			used_ = 0;
+		}
+		return blocks_.back().get() + used_;
+	}
+
+	void commit(std::size_t n)
+	{
+		std::byte *p = blocks_.back().get() + used_;
+		used_ += n;
+		if (staged_) {
+			iovec &last = iov_.back();
+			if (static_cast<std::byte *>(last.iov_base) +
+			    last.iov_len == p) {
+				last.iov_len += n;
+				return;
+			}
+		}
+		iov_.push_back({p, n});
+		staged_ = true;
+	}
+
+	bool write(std::span<const std::byte> s)
+	{
+		if (s.empty())
+			return true;
+		if (s.size() < ref_threshold) {
+			std::byte *p = prepare(s.size());
+			std::memcpy(p, s.data(), s.size());
+			commit(s.size());
+			return true;
+		}
+		iov_.push_back({const_cast<std::byte *>(s.data()), s.size()});
+		staged_ = false;
+		return true;
+	}
+
+	std::span<const iovec> iov() const noexcept
+	{
+		return iov_;
+	}
+
+	void clear() noexcept
+	{
+		iov_.clear();
+		blocks_.clear();
+		cap_ = used_ = 0;
+		staged_ = false;
+	}
+
+private:
+	std::vector<iovec> iov_;
+	std::vector<std::unique_ptr<std::byte[]>> blocks_;
+	std::size_t cap_ = 0;		/* size of current staging block */
+	std::size_t used_ = 0;
+	bool staged_ = false;	/* last iovec refers to a staging block */
+};
+#endif
+
+/*
+ * Sink passing output to a callback through a fixed buffer.
+ *
+ * The callback is invoked as fn(std::span<const std::byte>) and returns
+ * false on failure. Payloads larger than the buffer are passed to the
+ * callback directly. flush() must be called once encoding is complete.
+ */
+template<typename Fn, std::size_t N = 4096>
+class callback_sink {
+public:
+	static_assert(N >= 9, "the buffer must hold the longest item head");
+	static constexpr std::size_t capacity = N;
+
+	explicit callback_sink(Fn fn)
+	: fn_{std::move(fn)}
+	{ }
+
+	std::byte *prepare(std::size_t n)
+	{
+		if (n > N - len_ && !flush())
+			return nullptr;
+		return n <= N ? buf_ + len_ : nullptr;
+	}
+
+	void commit(std::size_t n) noexcept
+	{
+		len_ += n;
+	}
+
+	bool write(std::span<const std::byte> s)
+	{
+		if (s.size() <= N - len_) {
+			std::memcpy(buf_ + len_, s.data(), s.size());
+			len_ += s.size();
+			return true;
+		}
+		if (!flush())
+			return false;
+		if (s.size() < N) {
+			std::memcpy(buf_, s.data(), s.size());
+			len_ = s.size();
+			return true;
+		}
+		return fn_(s);
+	}
+
+	bool flush()
+	{
+		if (!len_)
+			return true;
+		const std::size_t n = std::exchange(len_, 0);
+		return fn_(std::span<const std::byte>{buf_, n});
+	}
+
+private:
+	Fn fn_;
+	std::size_t len_ = 0;
+	std::byte buf_[N];
+};
+
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+/*
+ * Stringref: references to repeated strings (tags 25 and 256).
+ *
+ * Inside the item following tag 256 (a namespace), every definite length
+ * string long enough to be worth referring to is entered in a table, and
+ * tag 25 followed by an index stands for an entry of that table. See
+ * http://cbor.schmorp.de/stringref. Records which repeat the same keys and
+ * enumeration strings shrink considerably.
+ *
+ * The encoder writes namespaces with stringrefs_begin and stringrefs_end
+ * (see encoder.h) and replaces repeated strings automatically.
+ * stringref_cursor reads them: it works like a cursor but consumes tags 25
+ * and 256 itself and reports a reference as the string it refers to, with
+ * data pointing at its first occurrence in the input. No string is copied,
+ * and equal strings within a namespace share a pointer, so they can be
+ * compared or interned by address.
+ *
+ * Example:
+ *
+ *	enc.stringrefs_begin();
+ *	enc.array(records.size());
+ *	for (const auto &r : records)
+ *		cbor::encode(enc, r);
+ *	enc.stringrefs_end();
+ *
+ *	cbor::stringref_cursor c{msg};
+ *	cbor::event ev;
+ *	while (c.next(ev) == cbor::errc::ok && ev.type != cbor::token::eof)
+ *		...
+ */
+
+#include "cursor.h"
+#include "encoder.h"
+
+#include <vector>
+
+namespace cbor {
+
+class stringref_cursor {
+public:
+	static constexpr unsigned max_depth = cbor::max_depth;
+
+	stringref_cursor() noexcept = default;
+
+	/*
+	 * See cursor for the meaning of trusted.
+	 */
+	explicit stringref_cursor(std::span<const std::byte> in,
+	    bool trusted = false) noexcept
+	: c_{in, trusted}
+	{ }
+
+	/*
+	 * Decode the next token into ev, as cursor::next does. Tag 256 is not
+	 * reported and tag 25 with its index is reported as the referenced
+	 * string. A reference outside a namespace or past the end of its
+	 * table is errc::invalid_stringref.
+	 */
+	errc next(event &ev);
+
+	unsigned depth() const noexcept
+	{
+		return c_.depth();
+	}
+
+	bool at_key() const noexcept
+	{
+		return c_.at_key();
+	}
+
+	std::size_t offset() const noexcept
+	{
+		return c_.offset();
+	}
+
+	std::span<const std::byte> input() const noexcept
+	{
+		return c_.input();
+	}
+
+private:
+	struct entry {
+		const std::byte *data;
+		std::uint64_t len;
+		bool text;
+	};
+
+	struct space {
+		unsigned depth;		/* depth of the tagged item */
+		std::size_t first;	/* first entry in strings_ */
+	};
+
+	cursor c_;
+	bool chunked_ = false;		/* inside an indefinite length string */
+	std::vector<entry> strings_;
+	std::vector<space> spaces_;
+};
+
+inline errc
+stringref_cursor::next(event &ev)
+{
+	bool ref = false;
+	for (;;) {
+		if (auto r = c_.next(ev); r != errc::ok)
+			return r;
+		if (ev.type != token::tag)
+			break;
+		if (ev.value == 256) {
+			spaces_.push_back({c_.depth(), strings_.size()});
+			continue;
+		}
+		if (ev.value != 25)
+			break;
+
+		const std::size_t offset = ev.offset;
+		if (auto r = c_.next(ev); r != errc::ok)
+			return r;
+		if (ev.type != token::uint || spaces_.empty() ||
+		    ev.value >= strings_.size() - spaces_.back().first)
+			return errc::invalid_stringref;
+		const entry &s = strings_[spaces_.back().first + ev.value];
+		ev.type = s.text ? token::text : token::bytes;
+		ev.value = s.len;
+		ev.data = s.data;
+		ev.offset = offset;
+		ref = true;
+		break;
+	}
+
+	switch (ev.type) {
+	case token::bytes_begin:
+	case token::text_begin:
+		chunked_ = true;
+		break;
+	case token::bytes_end:
+	case token::text_end:
+		chunked_ = false;
+		break;
+	case token::bytes:
+	case token::text:
+		if (!spaces_.empty() && !chunked_ && !ref &&
+		    ev.value >= detail::stringref_min_length(
+		    strings_.size() - spaces_.back().first))
+			strings_.push_back({ev.data, ev.value,
+			    ev.type == token::text});
+		break;
+	default:
+		break;
+	}
+
+	/* a namespace ends with the item it tags */
+	if (ev.type != token::tag)
+		while (!spaces_.empty() && c_.depth() == spaces_.back().depth) {
+			strings_.resize(spaces_.back().first);
+			spaces_.pop_back();
+		}
+	return errc::ok;
+}
+
+}
@@ -0,0 +1,393 @@
+#pragma once
+
+/*
+ * Typed arrays (RFC 8746 section 2).
+ *
+ * Tags 64 to 87 mark a byte string as a packed array of integers or
+ * floating point numbers of a given width and byte order. A typed_array<T>
+ * refers to the byte string directly when its byte order is the host's and
+ * it is suitably aligned, and otherwise holds a converted copy made with
+ * vector byte swap kernels (AVX2 or SSSE3 chosen at run time on x86, NEON on
+ * AArch64).
+ *
+ * Elements may be any fixed width integer, float or double. Tags for
+ * binary16 and binary128 elements are recognised by typed_array_info but
+ * have no element type here.
+ *
+ * Example:
+ *
+ *	cbor::encode_typed_array(enc, std::span<const float>{samples});
+ *
+ *	cbor::typed_array<float> a;
+ *	if (cbor::decode_typed_array(c, a) == cbor::errc::ok)
+ *		process(a.data());
+ */
+
+#include "codec.h"
+
+#include <bit>
+#include <concepts>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace cbor {
+
+static_assert(std::endian::native == std::endian::big ||
+    std::endian::native == std::endian::little);
+
+/*
+ * Element description of a typed array tag.
+ */
+struct typed_array_type {
+	std::uint8_t size;	/* element size in bytes */
+	bool floating;
+	bool is_signed;
+	bool clamped;		/* tag 68: uint8 with clamped arithmetic */
+	std::endian order;
+};
+
+/*
+ * Describe tag, returning false if it is not a typed array tag.
+ */
+constexpr bool
+typed_array_info(std::uint64_t tag, typed_array_type &t) noexcept
+{
+	/* 0b010fsell */
+	if (tag < 64 || tag > 87 || tag == 76)
+		return false;
+	const unsigned f = (tag >> 4) & 1;
+	const unsigned s = (tag >> 3) & 1;
+	const unsigned e = (tag >> 2) & 1;
+	const unsigned ll = tag & 3;
+	t.floating = f;
+	t.is_signed = f || s;
+	t.size = f ? 2 << ll : 1 << ll;
+	t.clamped = tag == 68;
+	t.order = e && t.size > 1 ? std::endian::little : std::endian::big;
+	return true;
+}
+
+namespace detail {
+
+template<typename T>
+concept typed_array_element = std::same_as<T, float> ||
+    std::same_as<T, double> ||
+    (std::integral<T> && !std::same_as<T, bool> &&
+    (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8));
+
+inline void
+swap_bytes_scalar(std::byte *dst, const std::byte *src, std::size_t n,
+    unsigned width) noexcept
+{
+	const auto each = [&]<typename U>(U) {
+		for (std::size_t i = 0; i + sizeof(U) <= n; i += sizeof(U)) {
+			U v;
+			std::memcpy(&v, src + i, sizeof v);
+			if constexpr (sizeof(U) == 2)
+				v = __builtin_bswap16(v);
+			else if constexpr (sizeof(U) == 4)
+				v = __builtin_bswap32(v);
+			else
+				v = __builtin_bswap64(v);
+			std::memcpy(dst + i, &v, sizeof v);
+		}
+	};
+	switch (width) {
+	case 2:
+		each(std::uint16_t{});
+		break;
+	case 4:
+		each(std::uint32_t{});
+		break;
+	case 8:
+		each(std::uint64_t{});
+		break;
+	case 16:
+		for (std::size_t i = 0; i + 16 <= n; i += 16) {
+			std::uint64_t lo, hi;
+			std::memcpy(&lo, src + i, 8);
+			std::memcpy(&hi, src + i + 8, 8);
+			lo = __builtin_bswap64(lo);
+			hi = __builtin_bswap64(hi);
+			std::memcpy(dst + i, &hi, 8);
+			std::memcpy(dst + i + 8, &lo, 8);
+		}
+		break;
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/* pshufb masks reversing each element, for widths 2, 4, 8 and 16 */
+alignas(16) constexpr std::uint8_t swap_masks[4][16] = {
+	{1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14},
+	{3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+	{7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8},
+	{15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0},
+};
+
+__attribute__((target("ssse3")))
+inline void
+swap_bytes_ssse3(std::byte *dst, const std::byte *src, std::size_t n,
+    unsigned width) noexcept
+{
+	const __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i *>(
+	    swap_masks[std::countr_zero(width) - 1]));
+	std::size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		const __m128i v = _mm_loadu_si128(
+		    reinterpret_cast<const __m128i *>(src + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+		    _mm_shuffle_epi8(v, mask));
+	}
+	swap_bytes_scalar(dst + i, src + i, n - i, width);
+}
+
+__attribute__((target("avx2")))
+inline void
+swap_bytes_avx2(std::byte *dst, const std::byte *src, std::size_t n,
+    unsigned width) noexcept
+{
+	const __m256i mask = _mm256_broadcastsi128_si256(_mm_load_si128(
+	    reinterpret_cast<const __m128i *>(
+	    swap_masks[std::countr_zero(width) - 1])));
+	std::size_t i = 0;
+	for (; i + 64 <= n; i += 64) {
+		const __m256i a = _mm256_loadu_si256(
+		    reinterpret_cast<const __m256i *>(src + i));
+		const __m256i b = _mm256_loadu_si256(
+		    reinterpret_cast<const __m256i *>(src + i + 32));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+		    _mm256_shuffle_epi8(a, mask));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i + 32),
+		    _mm256_shuffle_epi8(b, mask));
+	}
+	for (; i + 32 <= n; i += 32) {
+		const __m256i a = _mm256_loadu_si256(
+		    reinterpret_cast<const __m256i *>(src + i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+		    _mm256_shuffle_epi8(a, mask));
+	}
+	swap_bytes_scalar(dst + i, src + i, n - i, width);
+}
+
+using swap_bytes_fn = void (*)(std::byte *, const std::byte *, std::size_t,
+    unsigned) noexcept;
+
+inline swap_bytes_fn
+swap_bytes_select() noexcept
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return swap_bytes_avx2;
+	if (__builtin_cpu_supports("ssse3"))
+		return swap_bytes_ssse3;
+	return swap_bytes_scalar;
+}
+
+/*
+ * Reverse the bytes of each width byte element of src into dst. n is a
+ * multiple of width.
+ */
+inline void
+swap_bytes(std::byte *dst, const std::byte *src, std::size_t n,
+    unsigned width) noexcept
+{
+	static const swap_bytes_fn fn = swap_bytes_select();
+	fn(dst, src, n, width);
+}
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+inline void
+swap_bytes(std::byte *dst, const std::byte *src, std::size_t n,
+    unsigned width) noexcept
+{
+	const auto *s = reinterpret_cast<const std::uint8_t *>(src);
+	auto *d = reinterpret_cast<std::uint8_t *>(dst);
+	std::size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		const uint8x16_t v = vld1q_u8(s + i);
+		uint8x16_t r;
+		switch (width) {
+		case 2:
+			r = vrev16q_u8(v);
+			break;
+		case 4:
+			r = vrev32q_u8(v);
+			break;
+		case 8:
+			r = vrev64q_u8(v);
+			break;
+		default:
+			r = vrev64q_u8(v);
+			r = vextq_u8(r, r, 8);
+			break;
+		}
+		vst1q_u8(d + i, r);
+	}
+	swap_bytes_scalar(dst + i, src + i, n - i, width);
+}
+#else
+inline void
+swap_bytes(std::byte *dst, const std::byte *src, std::size_t n,
+    unsigned width) noexcept
+{
+	swap_bytes_scalar(dst, src, n, width);
+}
+#endif
+
+}
+
+/*
+ * Typed array tag for elements of type T in the given byte order.
+ */
+template<detail::typed_array_element T>
+constexpr std::uint64_t
+typed_array_tag(std::endian order = std::endian::native) noexcept
+{
+	const unsigned e = sizeof(T) > 1 && order == std::endian::little;
+	if constexpr (std::floating_point<T>)
+		return 80 | e << 2 | (sizeof(T) == 4 ? 1 : 2);
+	else
+		return 64 | std::signed_integral<T> << 3 | e << 2 |
+		    std::countr_zero(sizeof(T));
+}
+
+/*
+ * Elements of a typed array, either referring to the encoded byte string or
+ * converted into owned storage.
+ */
+template<detail::typed_array_element T>
+class typed_array {
+public:
+	/*
+	 * Set from a typed array tag and its byte string payload. The payload
+	 * is used in place if its byte order is the host's, it is aligned for
+	 * T and copy is not set, and must then outlive the array; otherwise it
+	 * is copied and converted. Returns errc::type_mismatch if the tag does
+	 * not describe elements of type T or the payload is not a whole number
+	 * of them.
+	 */
+	errc assign(std::uint64_t tag, std::span<const std::byte> payload,
+	    bool copy = false)
+	{
+		typed_array_type t;
+		if (!typed_array_info(tag, t) || t.size != sizeof(T) ||
+		    t.floating != std::floating_point<T> ||
+		    (!t.floating && t.is_signed != std::signed_integral<T>) ||
+		    payload.size() % sizeof(T))
+			return errc::type_mismatch;
+
+		const std::size_t n = payload.size() / sizeof(T);
+		const bool aligned = !(reinterpret_cast<std::uintptr_t>(
+		    payload.data()) % alignof(T));
+		if (t.order == std::endian::native && aligned && !copy) {
+			view_ = {reinterpret_cast<const T *>(payload.data()), n};
+			owned_ = false;
+			return errc::ok;
+		}
+		own_.resize(n);
+		owned_ = true;
+		auto *dst = reinterpret_cast<std::byte *>(own_.data());
+		if (!n)
+			return errc::ok;
+		if (t.order == std::endian::native || sizeof(T) == 1)
+			std::memcpy(dst, payload.data(), payload.size());
+		else
+			detail::swap_bytes(dst, payload.data(), payload.size(),
+			    sizeof(T));
+		return errc::ok;
+	}
+
+	std::span<const T> data() const noexcept
+	{
+		return owned_ ? std::span<const T>{own_} : view_;
+	}
+
+	std::size_t size() const noexcept
+	{
+		return data().size();
+	}
+
+	const T &operator[](std::size_t i) const noexcept
+	{
+		return data()[i];
+	}
+
+	auto begin() const noexcept
+	{
+		return data().begin();
+	}
+
+	auto end() const noexcept
+	{
+		return data().end();
+	}
+
+	/* true if the elements refer to the encoded input */
+	bool borrowed() const noexcept
+	{
+		return !owned_;
+	}
+
+private:
+	std::span<const T> view_;
+	std::vector<T> own_;
+	bool owned_ = false;
+};
+
+/*
+ * Encode v as a typed array in the given byte order. Elements are copied
+ * straight from v in host order and byte swapped in place otherwise.
+ */
+template<typename Sink, detail::typed_array_element T>
+inline void
+encode_typed_array(encoder<Sink> &enc, std::span<const T> v,
+    std::endian order = std::endian::native)
+{
+	enc.tag(typed_array_tag<T>(order));
+	const auto src = std::as_bytes(v);
+	if (order == std::endian::native || sizeof(T) == 1) {
+		enc.bytes(src);
+		return;
+	}
+	std::size_t off = 0;
+	enc.bytes(src.size(), [&](std::span<std::byte> dst) {
+		detail::swap_bytes(dst.data(), src.data() + off, dst.size(),
+		    sizeof(T));
+		off += dst.size();
+	});
+}
+
+/*
+ * Decode a tagged typed array. A payload in indefinite length chunks is
+ * gathered into owned storage.
+ */
+template<detail::typed_array_element T>
+inline errc
+decode_typed_array(cursor &c, typed_array<T> &a)
+{
+	event ev;
+	if (auto r = c.next(ev); r != errc::ok)
+		return r;
+	if (ev.type != token::tag)
+		return ev.type == token::eof ? errc::truncated
+		    : errc::type_mismatch;
+	const std::uint64_t tag = ev.value;
+	if (auto r = c.next(ev); r != errc::ok)
+		return r;
+	if (ev.type == token::bytes)
+		return a.assign(tag, ev.bytes());
+	if (ev.type != token::bytes_begin)
+		return errc::type_mismatch;
+	std::vector<std::byte> buf;
+	if (auto r = detail::decode_string(c, ev, token::bytes, buf);
+	    r != errc::ok)
+		return r;
+	return a.assign(tag, buf, true);
+}
+
+}
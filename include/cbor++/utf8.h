@@ -0,0 +1,470 @@
+#pragma once
+
+/*
+ * UTF-8 validation for text strings (RFC 8949 section 3.1, major type 3).
+ *
+ * Long strings are checked 16 or 32 bytes at a time using the lookup
+ * algorithm of Keiser and Lemire ("Validating UTF-8 In Less Than One
+ * Instruction Per Byte", 2021) with AVX2 or SSSE3 selected at run time on
+ * x86, or NEON on AArch64. Short strings and other targets use a scalar
+ * validator with an ASCII fast path.
+ */
+
+#include "core.h"
+
+#include <algorithm>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CBOR_UTF8_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define CBOR_UTF8_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace cbor {
+
+namespace detail {
+
+inline bool
+utf8_valid_scalar(const std::uint8_t *p, std::size_t n) noexcept
+{
+	std::size_t i = 0;
+	while (i < n) {
+		if (i + 8 <= n) {
+			std::uint64_t v;
+			std::memcpy(&v, p + i, 8);
+			if (!(v & 0x8080808080808080)) {
+				i += 8;
+				continue;
+			}
+		}
+		const std::uint8_t c = p[i];
+		if (c < 0x80) {
+			++i;
+			continue;
+		}
+		const auto cont = [&](std::size_t j, std::uint8_t lo = 0x80,
+		    std::uint8_t hi = 0xbf) {
+			return i + j < n && p[i + j] >= lo && p[i + j] <= hi;
+		};
+		if (c < 0xc2)
+			return false;
+		if (c < 0xe0) {
+			if (!cont(1))
+				return false;
+			i += 2;
+		} else if (c < 0xf0) {
+			const std::uint8_t lo = c == 0xe0 ? 0xa0 : 0x80;
+			const std::uint8_t hi = c == 0xed ? 0x9f : 0xbf;
+			if (!cont(1, lo, hi) || !cont(2))
+				return false;
+			i += 3;
+		} else if (c < 0xf5) {
+			const std::uint8_t lo = c == 0xf0 ? 0x90 : 0x80;
+			const std::uint8_t hi = c == 0xf4 ? 0x8f : 0xbf;
+			if (!cont(1, lo, hi) || !cont(2) || !cont(3))
+				return false;
+			i += 4;
+		} else
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Error classes for the lookup algorithm. Each table maps a nibble to the
+ * set of errors it could take part in; a byte pair is invalid if all three
+ * lookups agree on some error.
+ */
+namespace utf8_lookup {
+
+constexpr std::uint8_t too_short = 1 << 0;	/* 11______ 0_______ */
+						/* 11______ 11______ */
+constexpr std::uint8_t too_long = 1 << 1;	/* 0_______ 10______ */
+constexpr std::uint8_t overlong_3 = 1 << 2;	/* 11100000 100_____ */
+constexpr std::uint8_t too_large = 1 << 3;	/* 11110100 1001____ */
+						/* 11110100 101_____ */
+						/* 11110101 1001____ ... */
+constexpr std::uint8_t surrogate = 1 << 4;	/* 11101101 101_____ */
+constexpr std::uint8_t overlong_2 = 1 << 5;	/* 1100000_ 10______ */
+constexpr std::uint8_t too_large_1000 = 1 << 6;	/* 11110101 1000____ ... */
+constexpr std::uint8_t overlong_4 = 1 << 6;	/* 11110000 1000____ */
+constexpr std::uint8_t two_conts = 1 << 7;	/* 10______ 10______ */
+constexpr std::uint8_t carry = too_short | too_long | two_conts;
+
+/* high nibble of first byte */
+alignas(16) constexpr std::uint8_t byte_1_high[16] = {
+	too_long, too_long, too_long, too_long,
+	too_long, too_long, too_long, too_long,
+	two_conts, two_conts, two_conts, two_conts,
+	too_short | overlong_2,
+	too_short,
+	too_short | overlong_3 | surrogate,
+	too_short | too_large | too_large_1000 | overlong_4,
+};
+
+/* low nibble of first byte */
+alignas(16) constexpr std::uint8_t byte_1_low[16] = {
+	carry | overlong_3 | overlong_2 | overlong_4,
+	carry | overlong_2,
+	carry,
+	carry,
+	carry | too_large,
+	carry | too_large | too_large_1000,
+	carry | too_large | too_large_1000,
+	carry | too_large | too_large_1000,
+	carry | too_large | too_large_1000,
+	carry | too_large | too_large_1000,
+	carry | too_large | too_large_1000,
+	carry | too_large | too_large_1000,
+	carry | too_large | too_large_1000,
+	carry | too_large | too_large_1000 | surrogate,
+	carry | too_large | too_large_1000,
+	carry | too_large | too_large_1000,
+};
+
+/* high nibble of second byte */
+alignas(16) constexpr std::uint8_t byte_2_high[16] = {
+	too_short, too_short, too_short, too_short,
+	too_short, too_short, too_short, too_short,
+	too_long | overlong_2 | two_conts | overlong_3 | too_large_1000 |
+	    overlong_4,
+	too_long | overlong_2 | two_conts | overlong_3 | too_large,
+	too_long | overlong_2 | two_conts | surrogate | too_large,
+	too_long | overlong_2 | two_conts | surrogate | too_large,
+	too_short, too_short, too_short, too_short,
+};
+
+/* bytes at the end of a block which start an incomplete sequence */
+alignas(32) constexpr std::uint8_t incomplete[32] = {
+	255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 0xf0 - 1, 0xe0 - 1, 0xc0 - 1,
+};
+
+}
+
+#if defined(CBOR_UTF8_X86)
+__attribute__((target("ssse3")))
+inline bool
+utf8_valid_ssse3(const std::uint8_t *p, std::size_t n) noexcept
+{
+	namespace L = utf8_lookup;
+	const __m128i t1h = _mm_load_si128(
+	    reinterpret_cast<const __m128i *>(L::byte_1_high));
+	const __m128i t1l = _mm_load_si128(
+	    reinterpret_cast<const __m128i *>(L::byte_1_low));
+	const __m128i t2h = _mm_load_si128(
+	    reinterpret_cast<const __m128i *>(L::byte_2_high));
+	const __m128i max = _mm_loadu_si128(
+	    reinterpret_cast<const __m128i *>(L::incomplete + 16));
+	const __m128i nib = _mm_set1_epi8(0x0f);
+	__m128i prev = _mm_setzero_si128();
+	__m128i prev_incomplete = _mm_setzero_si128();
+	__m128i error = _mm_setzero_si128();
+
+	const auto check = [&](__m128i in) __attribute__((target("ssse3"))) {
+		if (!_mm_movemask_epi8(in)) {
+			error = _mm_or_si128(error, prev_incomplete);
+			prev_incomplete = _mm_setzero_si128();
+			prev = in;
+			return;
+		}
+		const __m128i prev1 = _mm_alignr_epi8(in, prev, 15);
+		const __m128i b1h = _mm_shuffle_epi8(t1h,
+		    _mm_and_si128(_mm_srli_epi16(prev1, 4), nib));
+		const __m128i b1l = _mm_shuffle_epi8(t1l,
+		    _mm_and_si128(prev1, nib));
+		const __m128i b2h = _mm_shuffle_epi8(t2h,
+		    _mm_and_si128(_mm_srli_epi16(in, 4), nib));
+		const __m128i sc = _mm_and_si128(_mm_and_si128(b1h, b1l), b2h);
+		const __m128i prev2 = _mm_alignr_epi8(in, prev, 14);
+		const __m128i prev3 = _mm_alignr_epi8(in, prev, 13);
+		const __m128i third = _mm_subs_epu8(prev2,
+		    _mm_set1_epi8(static_cast<char>(0xe0 - 0x80)));
+		const __m128i fourth = _mm_subs_epu8(prev3,
+		    _mm_set1_epi8(static_cast<char>(0xf0 - 0x80)));
+		const __m128i must23 = _mm_and_si128(
+		    _mm_or_si128(third, fourth),
+		    _mm_set1_epi8(static_cast<char>(0x80)));
+		error = _mm_or_si128(error, _mm_xor_si128(must23, sc));
+		prev_incomplete = _mm_subs_epu8(in, max);
+		prev = in;
+	};
+
+	std::size_t i = 0;
+	for (; i + 16 <= n; i += 16)
+		check(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i)));
+	if (i < n) {
+		alignas(16) std::uint8_t tail[16] = {};
+		std::memcpy(tail, p + i, n - i);
+		check(_mm_load_si128(reinterpret_cast<const __m128i *>(tail)));
+	}
+	error = _mm_or_si128(error, prev_incomplete);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) ==
+	    0xffff;
+}
+
+__attribute__((target("avx2")))
+inline bool
+utf8_valid_avx2(const std::uint8_t *p, std::size_t n) noexcept
+{
+	namespace L = utf8_lookup;
+	const __m256i t1h = _mm256_broadcastsi128_si256(_mm_load_si128(
+	    reinterpret_cast<const __m128i *>(L::byte_1_high)));
+	const __m256i t1l = _mm256_broadcastsi128_si256(_mm_load_si128(
+	    reinterpret_cast<const __m128i *>(L::byte_1_low)));
+	const __m256i t2h = _mm256_broadcastsi128_si256(_mm_load_si128(
+	    reinterpret_cast<const __m128i *>(L::byte_2_high)));
+	const __m256i max = _mm256_load_si256(
+	    reinterpret_cast<const __m256i *>(L::incomplete));
+	const __m256i nib = _mm256_set1_epi8(0x0f);
+	__m256i prev = _mm256_setzero_si256();
+	__m256i prev_incomplete = _mm256_setzero_si256();
+	__m256i error = _mm256_setzero_si256();
+
+	const auto check = [&](__m256i in) __attribute__((target("avx2"))) {
+		if (!_mm256_movemask_epi8(in)) {
+			error = _mm256_or_si256(error, prev_incomplete);
+			prev_incomplete = _mm256_setzero_si256();
+			prev = in;
+			return;
+		}
+		/* in shifted right by N bytes with prev shifted in */
+		const __m256i carried = _mm256_permute2x128_si256(prev, in,
+		    0x21);
+		const __m256i prev1 = _mm256_alignr_epi8(in, carried, 15);
+		const __m256i prev2 = _mm256_alignr_epi8(in, carried, 14);
+		const __m256i prev3 = _mm256_alignr_epi8(in, carried, 13);
+		const __m256i b1h = _mm256_shuffle_epi8(t1h,
+		    _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nib));
+		const __m256i b1l = _mm256_shuffle_epi8(t1l,
+		    _mm256_and_si256(prev1, nib));
+		const __m256i b2h = _mm256_shuffle_epi8(t2h,
+		    _mm256_and_si256(_mm256_srli_epi16(in, 4), nib));
+		const __m256i sc = _mm256_and_si256(_mm256_and_si256(b1h, b1l),
+		    b2h);
+		const __m256i third = _mm256_subs_epu8(prev2,
+		    _mm256_set1_epi8(static_cast<char>(0xe0 - 0x80)));
+		const __m256i fourth = _mm256_subs_epu8(prev3,
+		    _mm256_set1_epi8(static_cast<char>(0xf0 - 0x80)));
+		const __m256i must23 = _mm256_and_si256(
+		    _mm256_or_si256(third, fourth),
+		    _mm256_set1_epi8(static_cast<char>(0x80)));
+		error = _mm256_or_si256(error, _mm256_xor_si256(must23, sc));
+		prev_incomplete = _mm256_subs_epu8(in, max);
+		prev = in;
+	};
+
+	std::size_t i = 0;
+	for (; i + 32 <= n; i += 32)
+		check(_mm256_loadu_si256(
+		    reinterpret_cast<const __m256i *>(p + i)));
+	if (i < n) {
+		alignas(32) std::uint8_t tail[32] = {};
+		std::memcpy(tail, p + i, n - i);
+		check(_mm256_load_si256(
+		    reinterpret_cast<const __m256i *>(tail)));
+	}
+	error = _mm256_or_si256(error, prev_incomplete);
+	return _mm256_testz_si256(error, error);
+}
+
+using utf8_fn = bool (*)(const std::uint8_t *, std::size_t) noexcept;
+
+inline utf8_fn
+utf8_select() noexcept
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return utf8_valid_avx2;
+	if (__builtin_cpu_supports("ssse3"))
+		return utf8_valid_ssse3;
+	return utf8_valid_scalar;
+}
+
+inline bool
+utf8_valid_simd(const std::uint8_t *p, std::size_t n) noexcept
+{
+	static const utf8_fn fn = utf8_select();
+	return fn(p, n);
+}
+#elif defined(CBOR_UTF8_NEON)
+inline bool
+utf8_valid_simd(const std::uint8_t *p, std::size_t n) noexcept
+{
+	namespace L = utf8_lookup;
+	const uint8x16_t t1h = vld1q_u8(L::byte_1_high);
+	const uint8x16_t t1l = vld1q_u8(L::byte_1_low);
+	const uint8x16_t t2h = vld1q_u8(L::byte_2_high);
+	const uint8x16_t max = vld1q_u8(L::incomplete + 16);
+	const uint8x16_t nib = vdupq_n_u8(0x0f);
+	uint8x16_t prev = vdupq_n_u8(0);
+	uint8x16_t prev_incomplete = vdupq_n_u8(0);
+	uint8x16_t error = vdupq_n_u8(0);
+
+	const auto check = [&](uint8x16_t in) {
+		if (vmaxvq_u8(in) < 0x80) {
+			error = vorrq_u8(error, prev_incomplete);
+			prev_incomplete = vdupq_n_u8(0);
+			prev = in;
+			return;
+		}
+		const uint8x16_t prev1 = vextq_u8(prev, in, 15);
+		const uint8x16_t prev2 = vextq_u8(prev, in, 14);
+		const uint8x16_t prev3 = vextq_u8(prev, in, 13);
+		const uint8x16_t b1h = vqtbl1q_u8(t1h, vshrq_n_u8(prev1, 4));
+		const uint8x16_t b1l = vqtbl1q_u8(t1l, vandq_u8(prev1, nib));
+		const uint8x16_t b2h = vqtbl1q_u8(t2h, vshrq_n_u8(in, 4));
+		const uint8x16_t sc = vandq_u8(vandq_u8(b1h, b1l), b2h);
+		const uint8x16_t third = vqsubq_u8(prev2,
+		    vdupq_n_u8(0xe0 - 0x80));
+		const uint8x16_t fourth = vqsubq_u8(prev3,
+		    vdupq_n_u8(0xf0 - 0x80));
+		const uint8x16_t must23 = vandq_u8(vorrq_u8(third, fourth),
+		    vdupq_n_u8(0x80));
+		error = vorrq_u8(error, veorq_u8(must23, sc));
+		prev_incomplete = vqsubq_u8(in, max);
+		prev = in;
+	};
+
+	std::size_t i = 0;
+	for (; i + 16 <= n; i += 16)
+		check(vld1q_u8(p + i));
+	if (i < n) {
+		std::uint8_t tail[16] = {};
+		std::memcpy(tail, p + i, n - i);
+		check(vld1q_u8(tail));
+	}
+	error = vorrq_u8(error, prev_incomplete);
+	return vmaxvq_u8(error) == 0;
+}
+#else
+inline bool
+utf8_valid_simd(const std::uint8_t *p, std::size_t n) noexcept
+{
+	return utf8_valid_scalar(p, n);
+}
+#endif
+
+/* below this length the scalar validator wins */
+inline constexpr std::size_t utf8_simd_threshold = 64;
+
+/* true if the n < utf8_simd_threshold bytes at p are all ASCII */
+inline bool
+ascii_short(const std::uint8_t *p, std::size_t n) noexcept
+{
+	std::uint64_t acc = 0;
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		std::uint64_t v;
+		std::memcpy(&v, p + i, 8);
+		acc |= v;
+	}
+	if (n - i >= 4) {
+		std::uint32_t v;
+		std::memcpy(&v, p + i, 4);
+		acc |= v;
+		std::memcpy(&v, p + n - 4, 4);
+		acc |= v;
+	} else
+		for (; i < n; ++i)
+			acc |= p[i];
+	return !(acc & 0x8080808080808080);
+}
+
+}
+
+/*
+ * Returns true if s is valid UTF-8.
+ */
+inline bool
+utf8_valid(const void *s, std::size_t n) noexcept
+{
+	const auto *p = static_cast<const std::uint8_t *>(s);
+	if (n < detail::utf8_simd_threshold)
+		return detail::ascii_short(p, n) ||
+		    detail::utf8_valid_scalar(p, n);
+	return detail::utf8_valid_simd(p, n);
+}
+
+inline bool
+utf8_valid(std::string_view s) noexcept
+{
+	return utf8_valid(s.data(), s.size());
+}
+
+inline bool
+utf8_valid(std::span<const std::byte> s) noexcept
+{
+	return utf8_valid(s.data(), s.size());
+}
+
+/*
+ * Validator for text delivered in fragments which may split a code point.
+ */
+class utf8_stream {
+public:
+	/*
+	 * Validate the next fragment. Returns false if the text seen so far
+	 * cannot be valid UTF-8.
+	 */
+	bool feed(const void *s, std::size_t n) noexcept
+	{
+		auto *p = static_cast<const std::uint8_t *>(s);
+
+		/* complete a code point split by the previous fragment */
+		if (len_) {
+			const std::size_t want = seq_length(buf_[0]);
+			const std::size_t k = std::min(want - len_, n);
+			std::memcpy(buf_ + len_, p, k);
+			len_ += k;
+			p += k;
+			n -= k;
+			if (len_ < want)
+				return true;
+			len_ = 0;
+			if (!detail::utf8_valid_scalar(buf_, want))
+				return false;
+		}
+
+		/* hold back a trailing incomplete code point */
+		std::size_t tail = 0;
+		for (std::size_t k = 1; k <= std::min<std::size_t>(3, n); ++k) {
+			const std::uint8_t c = p[n - k];
+			if ((c & 0xc0) == 0x80)
+				continue;
+			if (c >= 0xc0 && seq_length(c) > k)
+				tail = k;
+			break;
+		}
+		std::memcpy(buf_, p + n - tail, tail);
+		len_ = tail;
+		return utf8_valid(p, n - tail);
+	}
+
+	/*
+	 * Returns true if the text ended on a code point boundary.
+	 */
+	bool finish() noexcept
+	{
+		return std::exchange(len_, 0) == 0;
+	}
+
+private:
+	static std::size_t seq_length(std::uint8_t lead) noexcept
+	{
+		return lead < 0xe0 ? 2 : lead < 0xf0 ? 3 : 4;
+	}
+
+	std::uint8_t buf_[4];
+	std::size_t len_ = 0;
+};
+
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+/*
+ * Well-formedness check without decoding.
+ *
+ * validate walks one item checking heads, lengths, nesting and indefinite
+ * length terminators, and reports where the item ends. Nothing is decoded
+ * and no tokens are produced; the only state is one remaining-item count
+ * per open container. It accepts exactly the input a cursor accepts and
+ * reports the same errors, so it can gate untrusted input before it is
+ * queued for a full decode.
+ *
+ * Example:
+ *
+ *	std::size_t end;
+ *	if (cbor::validate(msg, end) != cbor::errc::ok || end != msg.size())
+ *		reject(msg);
+ */
+
+#include "core.h"
+#include "utf8.h"
+
+#include <span>
+
+namespace cbor {
+
+namespace detail {
+
+/*
+ * Remaining-item counts for indefinite length containers start high enough
+ * that they can never reach a definite count, which is bounded by the input
+ * size. Maps start at an even count so a break after a key is detected by
+ * parity.
+ */
+inline constexpr std::uint64_t scan_indef_min = std::uint64_t{1} << 61;
+inline constexpr std::uint64_t scan_indef_array = std::uint64_t{1} << 62;
+inline constexpr std::uint64_t scan_indef_map = std::uint64_t{1} << 63;
+
+/*
+ * Check the item at p, opening at most limit levels of nesting. On success
+ * p is advanced past the item, otherwise it is set to the head at fault.
+ */
+inline errc
+scan(const std::byte *&p, const std::byte *e, unsigned limit,
+    bool trusted) noexcept
+{
+	const std::byte *at = p;	/* head being checked */
+	std::uint64_t stack[max_depth];
+	unsigned depth = 0;
+	std::uint64_t left = 1;		/* items left in current container */
+	bool tagged = false;
+
+	const auto fail = [&](errc r) {
+		p = at;
+		return r;
+	};
+
+	for (;;) {
+		while (!left) {
+			if (!depth)
+				return errc::ok;
+			left = stack[--depth];
+		}
+
+		at = p;
+		head h;
+		if (auto r = read_head(p, e, h); r != errc::ok)
+			return fail(r);
+
+		switch (h.type) {
+		case major::uint:
+		case major::nint:
+			break;
+		case major::bytes:
+		case major::text:
+			if (h.ai != ai_indefinite) {
+				if (h.arg > static_cast<std::uint64_t>(e - p))
+					return fail(errc::truncated);
+				if (h.type == major::text && !trusted &&
+				    !utf8_valid(p, h.arg))
+					return fail(errc::invalid_utf8);
+				p += h.arg;
+				break;
+			}
+			if (depth == limit)
+				return fail(errc::depth_exceeded);
+			for (;;) {
+				at = p;
+				head c;
+				if (auto r = read_head(p, e, c); r != errc::ok)
+					return fail(r);
+				if (c.type == major::simple &&
+				    c.ai == ai_indefinite)
+					break;
+				if (c.type != h.type || c.ai == ai_indefinite)
+					return fail(errc::invalid_chunk);
+				if (c.arg > static_cast<std::uint64_t>(e - p))
+					return fail(errc::truncated);
+				if (c.type == major::text && !trusted &&
+				    !utf8_valid(p, c.arg))
+					return fail(errc::invalid_utf8);
+				p += c.arg;
+			}
+			break;
+		case major::array:
+		case major::map: {
+			std::uint64_t n;
+			if (h.ai == ai_indefinite)
+				n = h.type == major::array
+				    ? scan_indef_array : scan_indef_map;
+			else {
+				/* every item occupies at least one byte */
+				const std::uint64_t avail = e - p;
+				if (h.arg > avail ||
+				    (h.type == major::map && h.arg > avail / 2))
+					return fail(errc::truncated);
+				n = h.type == major::map ? h.arg * 2 : h.arg;
+			}
+			if (depth == limit)
+				return fail(errc::depth_exceeded);
+			stack[depth++] = left - 1;
+			left = n;
+			tagged = false;
+			continue;
+		}
+		case major::tag:
+			tagged = true;
+			continue;
+		case major::simple:
+			if (h.ai == ai_indefinite) {
+				if (tagged || left <= scan_indef_min)
+					return fail(errc::unexpected_break);
+				if (left > scan_indef_array && (left & 1))
+					return fail(errc::malformed);
+				left = 0;
+				continue;
+			}
+			if (h.ai == ai_1byte && h.arg < 32)
+				return fail(errc::malformed);
+			break;
+		}
+		--left;
+		tagged = false;
+	}
+}
+
+}
+
+/*
+ * Check that input starts with a single well-formed item.
+ *
+ * On success end is set to the offset just past the item; input may
+ * continue after it. On failure end is set to the offset of the head at
+ * fault. See cursor for the meaning of trusted.
+ */
+inline errc
+validate(std::span<const std::byte> input, std::size_t &end,
+    bool trusted = false) noexcept
+{
+	const std::byte *p = input.data();
+	const errc r = detail::scan(p, p + input.size(), max_depth, trusted);
+	end = p - input.data();
+	return r;
+}
+
+}
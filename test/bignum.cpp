@@ -0,0 +1,262 @@
+/*
+ * Tests for bignum, decimal fraction and bigfloat conversions.
+ *
+ * Build and run from the top of the tree:
+ *
+ *	c++ -std=c++20 -Iinclude test/bignum.cpp -o test_bignum
+ *	./test_bignum
+ *
+ * Exits with status 1 and a message on the first failure.
+ */
+
+#include <cbor++/bignum.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr double inf = std::numeric_limits<double>::infinity();
+
+void
+check(bool ok, const char *what)
+{
+	if (!ok) {
+		std::fprintf(stderr, "FAIL: %s\n", what);
+		std::exit(1);
+	}
+}
+
+/* exact comparison which tells zeros of different sign apart */
+bool
+same(double a, double b)
+{
+	return a == b && std::signbit(a) == std::signbit(b);
+}
+
+/* bytes of a hex string */
+std::vector<std::byte>
+from_hex(std::string_view s)
+{
+	std::vector<std::byte> v;
+	for (std::size_t i = 0; i + 1 < s.size(); i += 2)
+		v.push_back(static_cast<std::byte>(std::stoul(
+		    std::string{s.substr(i, 2)}, nullptr, 16)));
+	return v;
+}
+
+/* big endian magnitude of 2^k, plus low if low is not 0 */
+std::vector<std::byte>
+pow2(unsigned k, std::uint8_t low = 0)
+{
+	std::vector<std::byte> v(k / 8 + 1);
+	v[0] = std::byte(1u << (k % 8));
+	v.back() |= std::byte{low};
+	return v;
+}
+
+cbor::decimal_view
+decimal(std::int64_t exponent, const std::vector<std::byte> &m,
+    bool negative = false, bool binary = false)
+{
+	return {exponent, {negative, m}, binary};
+}
+
+void
+to_int()
+{
+	std::int64_t v;
+	const auto max = from_hex("7fffffffffffffff");
+	const auto over = from_hex("8000000000000000");
+	check(cbor::integer_view{false, max}.to_int64(v) && v == INT64_MAX,
+	    "INT64_MAX");
+	check(!cbor::integer_view{false, over}.to_int64(v), "2^63");
+	check(cbor::integer_view{true, max}.to_int64(v) && v == INT64_MIN,
+	    "INT64_MIN");
+	check(!cbor::integer_view{true, over}.to_int64(v), "-1 - 2^63");
+	const auto padded = from_hex("00000000007fffffffffffffff");
+	check(cbor::integer_view{false, padded}.to_int64(v) && v == INT64_MAX,
+	    "leading zero bytes");
+	check(cbor::integer_view{}.to_int64(v) && v == 0, "empty magnitude");
+	check(cbor::integer_view{true, {}}.to_int64(v) && v == -1,
+	    "empty negative magnitude");
+
+#if defined(__SIZEOF_INT128__)
+	__int128 w;
+	const __int128 max128 = static_cast<__int128>(
+	    ~static_cast<unsigned __int128>(0) >> 1);
+	const auto max16 = from_hex("7fffffffffffffffffffffffffffffff");
+	const auto over16 = from_hex("80000000000000000000000000000000");
+	check(cbor::integer_view{false, max16}.to_int128(w) && w == max128,
+	    "int128 max");
+	check(!cbor::integer_view{false, over16}.to_int128(w), "2^127");
+	check(cbor::integer_view{true, max16}.to_int128(w) &&
+	    w == -1 - max128, "int128 min");
+	check(!cbor::integer_view{true, over16}.to_int128(w), "-1 - 2^127");
+	const auto wide = from_hex("00000000000000000001");
+	check(cbor::integer_view{true, wide}.to_int128(w) && w == -2,
+	    "int128 leading zero bytes");
+#endif
+}
+
+void
+integer_to_double()
+{
+	const auto to_double = [](std::string_view hex, bool negative) {
+		const auto m = from_hex(hex);
+		return cbor::integer_view{negative, m}.to_double();
+	};
+	check(same(to_double("20000000000001", false), 0x1p53),
+	    "2^53 + 1 ties to even");
+	check(same(to_double("20000000000003", false), 0x1p53 + 4),
+	    "2^53 + 3 ties to even");
+	check(same(to_double("ffffffffffffffff", true), -0x1p64), "-2^64");
+	check(same(to_double("010000000000000800", false), 0x1p64),
+	    "2^64 + 2^11 ties to even");
+	check(same(to_double("010000000000000801", false), 0x1p64 + 0x1p12),
+	    "2^64 + 2^11 + 1 rounds up by its last byte");
+	check(same(to_double("ffffffffffffffffff", true), -0x1p72),
+	    "-1 - (2^72 - 1) carries");
+
+	/* the largest double plus half an ulp rounds to even: infinity */
+	std::vector<std::byte> m(128);
+	for (int i = 0; i < 6; ++i)
+		m[i] = std::byte{0xff};
+	m[6] = std::byte{0xfc};
+	check(same(cbor::integer_view{false, m}.to_double(), inf),
+	    "2^1024 - 2^970");
+	check(same(cbor::integer_view{true, m}.to_double(), -inf),
+	    "-1 - (2^1024 - 2^970)");
+	m.back() = std::byte{1};
+	check(same(cbor::integer_view{false, m}.to_double(), inf),
+	    "2^1024 - 2^970 + 1");
+	const auto below = from_hex(
+	    "fffffffffffffbffffffffffffffffffffffffffffffffffffffffffffffffff"
+	    "ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff"
+	    "ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff"
+	    "ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
+	check(same(cbor::integer_view{false, below}.to_double(),
+	    std::numeric_limits<double>::max()), "just below the tie");
+}
+
+void
+decimal_to_double()
+{
+	const auto big = pow2(1600);
+	check(same(decimal(-400, big).to_double(), 4.446241647709404e+81),
+	    "2^1600 * 10^-400");
+	check(same(decimal(-300, big, true).to_double(),
+	    -4.4462416477094046e+181), "(-1 - 2^1600) * 10^-300");
+	check(same(decimal(-100000, big).to_double(), 0.0),
+	    "2^1600 * 10^-100000");
+	check(same(decimal(-100000, big, true).to_double(), -0.0),
+	    "(-1 - 2^1600) * 10^-100000");
+	check(same(decimal(100000, big).to_double(), inf),
+	    "2^1600 * 10^100000");
+	check(same(decimal(INT64_MIN, big).to_double(), 0.0),
+	    "2^1600 * 10^INT64_MIN");
+	check(same(decimal(INT64_MAX, big, true).to_double(), -inf),
+	    "(-1 - 2^1600) * 10^INT64_MAX");
+	/* from_chars fails for these, and the digit count decides */
+	check(same(decimal(-150, big).to_double(), inf), "2^1600 * 10^-150");
+	check(same(decimal(-900, big).to_double(), 0.0), "2^1600 * 10^-900");
+
+	/* past the exact conversion, in range and out of it */
+	const auto huge = pow2(8 * 2000);
+	const double v = decimal(-4800, huge).to_double();
+	check(std::abs(v / 3.0194693372392276e16 - 1) < 1e-9,
+	    "2^16000 * 10^-4800");
+	check(same(decimal(-4000, huge).to_double(), inf),
+	    "2^16000 * 10^-4000");
+	check(same(decimal(-6000, huge, true).to_double(), -0.0),
+	    "(-1 - 2^16000) * 10^-6000");
+}
+
+void
+bigfloat_to_double()
+{
+	const auto big = pow2(1600);
+	check(same(decimal(-1590, big, false, true).to_double(), 1024.0),
+	    "2^1600 * 2^-1590");
+	check(same(decimal(-2670, big, false, true).to_double(),
+	    std::ldexp(1.0, -1070)), "2^1600 * 2^-2670");
+	check(same(decimal(-2700, big, false, true).to_double(), 0.0),
+	    "2^1600 * 2^-2700");
+	check(same(decimal(-100000, big, false, true).to_double(), 0.0),
+	    "2^1600 * 2^-100000");
+	check(same(decimal(-500, big, true, true).to_double(), -inf),
+	    "(-1 - 2^1600) * 2^-500");
+
+	/* subnormal results round once, ties to even */
+	const auto tie = pow2(71);
+	const auto past = pow2(71, 1);
+	check(same(decimal(-1146, tie, false, true).to_double(), 0.0),
+	    "2^-1075 rounds to 0");
+	check(same(decimal(-1146, past, false, true).to_double(),
+	    std::ldexp(1.0, -1074)), "2^-1075 + 2^-1146 rounds up");
+	const std::vector<std::byte> three{std::byte{3}};
+	check(same(decimal(-1076, three, false, true).to_double(),
+	    std::ldexp(1.0, -1074)), "3 * 2^-1076 rounds up");
+}
+
+void
+to_fixed()
+{
+	const auto m = pow2(62);
+	std::int64_t units;
+	check(decimal(-60, m, false, true).to_fixed(units, 2) && units == 400,
+	    "2^62 * 2^-60 at scale 2");
+	const std::vector<std::byte> below{std::byte{0x3f}, std::byte{0xff},
+	    std::byte{0xff}, std::byte{0xff}, std::byte{0xff}, std::byte{0xff},
+	    std::byte{0xff}, std::byte{0xff}};
+	check(decimal(-62, below, true, true).to_fixed(units, 18) &&
+	    units == -1000000000000000000, "(-1 - (2^62 - 1)) * 2^-62");
+	check(!decimal(-1, m, false, true).to_fixed(units, 1),
+	    "2^61 * 10 does not fit");
+	const std::vector<std::byte> three{std::byte{3}};
+	check(!decimal(-1, three, false, true).to_fixed(units, 0),
+	    "3 * 2^-1 is not an integer");
+	check(decimal(-1, three, false, true).to_fixed(units, 1) &&
+	    units == 15, "3 * 2^-1 at scale 1");
+
+	/* decimal fractions */
+	const auto max = from_hex("7fffffffffffffff");
+	check(decimal(0, max).to_fixed(units, 0) && units == INT64_MAX,
+	    "INT64_MAX at scale 0");
+	check(!decimal(0, max).to_fixed(units, 1), "INT64_MAX at scale 1");
+	check(decimal(0, max, true).to_fixed(units, 0) && units == INT64_MIN,
+	    "INT64_MIN at scale 0");
+	const std::vector<std::byte> m123{std::byte{123}};
+	check(decimal(-2, m123).to_fixed(units, 2) && units == 123,
+	    "1.23 in cents");
+	check(decimal(-2, m123, true).to_fixed(units, 4) && units == -12400,
+	    "-1.24 at scale 4");
+	check(!decimal(-3, m123).to_fixed(units, 2), "0.123 in cents");
+	check(decimal(1, m123).to_fixed(units, 2) && units == 123000,
+	    "1230 in cents");
+	check(!decimal(-30, m123).to_fixed(units, 2), "tiny exponent");
+	check(!decimal(30, m123).to_fixed(units, 2), "huge exponent");
+	check(!decimal(0, m123).to_fixed(units, 19), "scale past 10^18");
+	const std::vector<std::byte> zero;
+	check(decimal(INT64_MAX, zero).to_fixed(units, 18) && units == 0,
+	    "zero with any exponent");
+	check(!decimal(0, pow2(64)).to_fixed(units, 0), "bignum mantissa");
+}
+
+}
+
+int
+main()
+{
+	to_int();
+	integer_to_double();
+	decimal_to_double();
+	bigfloat_to_double();
+	to_fixed();
+	std::puts("ok");
+	return 0;
+}
@@ -0,0 +1,259 @@
+/*
+ * Tests for date and time tags.
+ *
+ * Build and run from the top of the tree:
+ *
+ *	c++ -std=c++20 -Iinclude test/datetime.cpp -o test_datetime
+ *	./test_datetime
+ *
+ * Exits with status 1 and a message on the first failure.
+ */
+
+#include <cbor++/datetime.h>
+#include <cbor++/diag.h>
+#include <cbor++/sink.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace std::chrono;
+
+void
+check(bool ok, const char *what)
+{
+	if (!ok) {
+		std::fprintf(stderr, "FAIL: %s\n", what);
+		std::exit(1);
+	}
+}
+
+void
+check(bool ok, std::string_view what)
+{
+	check(ok, std::string{what}.c_str());
+}
+
+/* decode the time in diagnostic notation */
+template<typename Duration>
+cbor::errc
+decode(std::string_view diag, sys_time<Duration> &t)
+{
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	cbor::encoder enc{s};
+	check(cbor::from_diag(diag, enc) == cbor::errc::ok, diag);
+	s.finish();
+	cbor::cursor c{v};
+	return cbor::decode_time(c, t);
+}
+
+/* diagnostic notation of what write puts in an encoder */
+template<typename Write>
+std::string
+encoded(Write &&write)
+{
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	cbor::encoder enc{s};
+	write(enc);
+	s.finish();
+	std::vector<std::byte> d;
+	cbor::vector_sink ds{d};
+	check(cbor::to_diag(v, ds) == cbor::errc::ok, "to_diag");
+	ds.finish();
+	return {reinterpret_cast<const char *>(d.data()), d.size()};
+}
+
+constexpr std::int64_t t0 = 1363896240;	/* 2013-03-21T20:04:00Z */
+
+void
+rfc3339()
+{
+	sys_seconds s;
+	sys_time<milliseconds> ms;
+	sys_time<nanoseconds> ns;
+
+	check(decode(R"(0("2013-03-21T20:04:00Z"))", s) == cbor::errc::ok &&
+	    s.time_since_epoch().count() == t0, "UTC");
+	check(decode(R"(0("2013-03-21T20:04:00+01:30"))", s) ==
+	    cbor::errc::ok && s.time_since_epoch().count() == t0 - 5400,
+	    "positive offset");
+	check(decode(R"(0("2013-03-21T20:04:00-08:00"))", s) ==
+	    cbor::errc::ok && s.time_since_epoch().count() == t0 + 28800,
+	    "negative offset");
+	check(decode(R"(0("2013-03-21t20:04:00.5z"))", ms) == cbor::errc::ok &&
+	    ms.time_since_epoch().count() == t0 * 1000 + 500,
+	    "lowercase separators");
+	check(decode(R"(0((_ "2013-03-21T", "20:04:00Z")))", s) ==
+	    cbor::errc::ok && s.time_since_epoch().count() == t0,
+	    "indefinite length string");
+
+	/* fractions are floored to the duration */
+	check(decode(R"(0("2013-03-21T20:04:00.123456789123Z"))", ns) ==
+	    cbor::errc::ok &&
+	    ns.time_since_epoch().count() == t0 * 1000000000 + 123456789,
+	    "digits past nanoseconds");
+	check(decode(R"(0("2013-03-21T20:04:00.1Z"))", ns) ==
+	    cbor::errc::ok &&
+	    ns.time_since_epoch().count() == t0 * 1000000000 + 100000000,
+	    "one digit");
+	check(decode(R"(0("1969-12-31T23:59:59.999Z"))", s) ==
+	    cbor::errc::ok && s.time_since_epoch().count() == -1,
+	    "before the epoch");
+
+	/* a leap second is the first second of the next minute */
+	check(decode(R"(0("2016-12-31T23:59:60Z"))", s) == cbor::errc::ok &&
+	    s == sys_days{2017y / 1 / 1}, "leap second");
+
+	check(decode(R"(0("0000-01-01T00:00:00Z"))", s) == cbor::errc::ok &&
+	    s.time_since_epoch().count() == -62167219200, "year 0000");
+	check(decode(R"(0("9999-12-31T23:59:59Z"))", s) == cbor::errc::ok &&
+	    s.time_since_epoch().count() == 253402300799, "year 9999");
+
+	for (const char *bad : {
+		R"(0("2013-02-29T00:00:00Z"))",
+		R"(0("2013-03-21T24:00:00Z"))",
+		R"(0("2013-03-21T20:60:00Z"))",
+		R"(0("2013-03-21T20:04:00"))",
+		R"(0("2013-03-21T20:04:00.Z"))",
+		R"(0("2013-03-21T20:04:00+01:00x"))",
+		R"(0("2013-03-21 20:04:00Z"))",
+		R"(0("2013-3-21T20:04:00Z"))",
+		R"(0("2013-03-21T20:04:00+1:00"))",
+		R"(0("2013-03-21T20:04:00+24:00"))",
+	    })
+		check(decode(bad, s) == cbor::errc::invalid_datetime, bad);
+}
+
+void
+epoch()
+{
+	sys_seconds s;
+	sys_time<milliseconds> ms;
+	sys_time<nanoseconds> ns;
+
+	check(decode("1(1363896240)", s) == cbor::errc::ok &&
+	    s.time_since_epoch().count() == t0, "integer");
+	check(decode("1(-1)", s) == cbor::errc::ok &&
+	    s.time_since_epoch().count() == -1, "negative integer");
+	check(decode("1(1363896240.5)", ms) == cbor::errc::ok &&
+	    ms.time_since_epoch().count() == t0 * 1000 + 500, "float");
+	check(decode("1(-0.25)", ms) == cbor::errc::ok &&
+	    ms.time_since_epoch().count() == -250, "negative float");
+	check(decode("1(9223372036854775807)", ns) == cbor::errc::overflow,
+	    "past the range of the duration");
+	check(decode("1(Infinity)", s) == cbor::errc::overflow, "infinity");
+	check(decode("1(NaN)", s) != cbor::errc::ok, "NaN");
+	check(decode(R"(1("x"))", s) == cbor::errc::type_mismatch, "text");
+	check(decode("2(1)", s) == cbor::errc::type_mismatch, "other tag");
+}
+
+void
+extended()
+{
+	sys_seconds s;
+	sys_time<milliseconds> ms;
+	sys_time<nanoseconds> ns;
+
+	check(decode("1001({1: 1363896240, -9: 123456789})", ns) ==
+	    cbor::errc::ok &&
+	    ns.time_since_epoch().count() == t0 * 1000000000 + 123456789,
+	    "nanoseconds");
+	check(decode("1001({1: 1363896240, -3: 5})", ms) == cbor::errc::ok &&
+	    ms.time_since_epoch().count() == t0 * 1000 + 5, "milliseconds");
+	check(decode("1001({1: 1363896240, -18: 5})", ns) ==
+	    cbor::errc::ok && ns.time_since_epoch().count() == t0 * 1000000000,
+	    "attoseconds");
+	check(decode(R"(1001({_ "x": [1], 1: 1363896240, -3: 5, 4: 1}))",
+	    ms) == cbor::errc::ok &&
+	    ms.time_since_epoch().count() == t0 * 1000 + 5,
+	    "other keys are skipped");
+	check(decode("1001({1: 1.75, -3: 500})", ms) == cbor::errc::ok &&
+	    ms.time_since_epoch().count() == 2250, "float base");
+
+	for (const char *bad : {
+		"1001({1: 1363896240, -2: 1})",
+		"1001({1: 1363896240, -1: 1})",
+		"1001({1: 1363896240, -21: 1})",
+		"1001({1: 1363896240, -3: 1000})",
+		"1001({1: 1363896240, -18446744073709551616: 1})",
+		"1001({-9: 1})",
+	    })
+		check(decode(bad, s) == cbor::errc::type_mismatch, bad);
+}
+
+void
+encode()
+{
+	const sys_time<nanoseconds> t{nanoseconds{t0 * 1000000000 +
+	    123456789}};
+	const auto time = [](auto v) {
+		return encoded([&](auto &enc) { cbor::encode_time(enc, v); });
+	};
+	check(time(t) == R"(0("2013-03-21T20:04:00.123456789Z"))",
+	    "nanoseconds");
+	check(time(floor<milliseconds>(t)) ==
+	    R"(0("2013-03-21T20:04:00.123Z"))", "milliseconds");
+	check(time(floor<seconds>(t)) == R"(0("2013-03-21T20:04:00Z"))",
+	    "seconds");
+	check(time(floor<days>(t)) == R"(0("2013-03-21T00:00:00Z"))", "days");
+	check(time(sys_seconds{seconds{-1}}) == R"(0("1969-12-31T23:59:59Z"))",
+	    "before the epoch");
+
+	/* outside the years 0000 to 9999 */
+	check(time(sys_seconds{seconds{253402300800}}) == "1(253402300800)",
+	    "year 10000");
+	check(time(sys_seconds{seconds{-62167219201}}) == "1(-62167219201)",
+	    "year -1");
+	check(time(sys_time<milliseconds>{milliseconds{253402300800005}}) ==
+	    "1001({1: 253402300800, -3: 5})", "year 10000 with a fraction");
+
+	check(encoded([&](auto &enc) { cbor::encode_epoch(enc, t); }) ==
+	    "1(1363896240.1234567)", "epoch float");
+	check(encoded([&](auto &enc) {
+		cbor::encode_epoch(enc, floor<seconds>(t));
+	    }) == "1(1363896240)", "epoch integer");
+	check(encoded([&](auto &enc) {
+		cbor::encode_extended_time(enc, floor<microseconds>(t));
+	    }) == "1001({1: 1363896240, -6: 123456})", "extended");
+	check(encoded([&](auto &enc) {
+		cbor::encode_extended_time(enc, floor<seconds>(t));
+	    }) == "1001({1: 1363896240})", "extended whole seconds");
+}
+
+void
+round_trip()
+{
+	for (std::int64_t i = -62167219200; i < 253402300800;
+	    i += 7777777777 + i % 1000) {
+		const sys_time<microseconds> a{microseconds{i * 1000000 +
+		    (i & 0xfffff)}};
+		std::vector<std::byte> v;
+		cbor::vector_sink s{v};
+		cbor::encoder enc{s};
+		cbor::encode_time(enc, a);
+		s.finish();
+		cbor::cursor c{v};
+		sys_time<microseconds> b;
+		check(cbor::decode_time(c, b) == cbor::errc::ok && a == b,
+		    "tag 0 round trip");
+	}
+}
+
+}
+
+int
+main()
+{
+	rfc3339();
+	epoch();
+	extended();
+	encode();
+	round_trip();
+	std::puts("ok");
+	return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * Tests for diagnostic notation.
+ *
+ * Build and run from the top of the tree:
+ *
+ *	c++ -std=c++20 -Iinclude test/diag.cpp -o test_diag
+ *	./test_diag
+ *
+ * Exits with status 1 and a message on the first failure.
+ */
+
+#include <cbor++/diag.h>
+#include <cbor++/sink.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+void
+check(bool ok, const char *what)
+{
+	if (!ok) {
+		std::fprintf(stderr, "FAIL: %s\n", what);
+		std::exit(1);
+	}
+}
+
+std::vector<std::byte>
+from_hex(std::string_view s)
+{
+	std::vector<std::byte> v;
+	for (std::size_t i = 0; i + 1 < s.size(); i += 2)
+		v.push_back(static_cast<std::byte>(std::stoul(
+		    std::string{s.substr(i, 2)}, nullptr, 16)));
+	return v;
+}
+
+std::string
+diag_of(std::span<const std::byte> in)
+{
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	check(cbor::to_diag(in, s) == cbor::errc::ok, "to_diag");
+	s.finish();
+	return {reinterpret_cast<const char *>(v.data()), v.size()};
+}
+
+cbor::errc
+cbor_of(std::string_view diag, std::vector<std::byte> &v)
+{
+	v.clear();
+	cbor::vector_sink s{v};
+	cbor::encoder enc{s};
+	const auto r = cbor::from_diag(diag, enc);
+	s.finish();
+	return r;
+}
+
+/* hex prints as diag and reads back as the same bytes */
+void
+round_trip(std::string_view hex, std::string_view diag)
+{
+	const auto in = from_hex(hex);
+	check(diag_of(in) == diag, std::string{hex}.c_str());
+	std::vector<std::byte> back;
+	check(cbor_of(diag, back) == cbor::errc::ok && back == in,
+	    std::string{diag}.c_str());
+}
+
+void
+items()
+{
+	round_trip("00", "0");
+	round_trip("17", "23");
+	round_trip("1818", "24");
+	round_trip("1bffffffffffffffff", "18446744073709551615");
+	round_trip("20", "-1");
+	round_trip("3bffffffffffffffff", "-18446744073709551616");
+
+	round_trip("40", "h''");
+	round_trip("4401020304", "h'01020304'");
+	round_trip("60", R"("")");
+	round_trip("6161", R"("a")");
+	round_trip("62225c", R"("\"\\")");
+	round_trip("6101", R"("\u0001")");
+	round_trip("63e282ac", R"("€")");
+	round_trip("5f42010243030405ff", "(_ h'0102', h'030405')");
+	round_trip("7f61616162ff", R"((_ "a", "b"))");
+
+	round_trip("80", "[]");
+	round_trip("83010203", "[1, 2, 3]");
+	round_trip("9f0102ff", "[_ 1, 2]");
+	round_trip("9fff", "[_ ]");
+	round_trip("a0", "{}");
+	round_trip("a201020304", "{1: 2, 3: 4}");
+	round_trip("bf0102ff", "{_ 1: 2}");
+	round_trip("82a080", "[{}, []]");
+	round_trip("a1616181a1f6f7", R"({"a": [{null: undefined}]})");
+
+	round_trip("c074323031332d30332d32315432303a30343a30305a",
+	    R"(0("2013-03-21T20:04:00Z"))");
+	round_trip("d9d9f700", "55799(0)");
+	round_trip("c1c200", "1(2(0))");
+	round_trip("82c001c1a0", "[0(1), 1({})]");
+
+	round_trip("f4", "false");
+	round_trip("f5", "true");
+	round_trip("f6", "null");
+	round_trip("f7", "undefined");
+	round_trip("f0", "simple(16)");
+	round_trip("f8ff", "simple(255)");
+
+	std::vector<std::byte> v;
+	check(cbor_of("b64'AQI'", v) == cbor::errc::ok &&
+	    v == from_hex("420102"), "base64");
+	check(cbor_of("[1, 2", v) == cbor::errc::invalid_diag, "unclosed");
+	check(cbor_of("[1, 2] 3", v) == cbor::errc::trailing_data,
+	    "trailing text");
+
+	std::vector<std::byte> out;
+	cbor::vector_sink s{out};
+	check(cbor::to_diag(from_hex("8201"), s) == cbor::errc::truncated,
+	    "truncated input");
+	check(cbor::to_diag(from_hex("0000"), s) == cbor::errc::trailing_data,
+	    "trailing data");
+}
+
+/* a buffer too small holds a prefix of the text */
+void
+no_space()
+{
+	const auto in = from_hex("a2616183010203626263a1f5c11a514b67b0");
+	const auto full = diag_of(in);
+	check(full == R"({"a": [1, 2, 3], "bc": {true: 1(1363896240)}})",
+	    "full text");
+	std::vector<char> buf(full.size());
+	for (std::size_t n = 0; n <= full.size(); ++n) {
+		cbor::span_sink s{std::as_writable_bytes(std::span{buf}.first(n))};
+		const auto r = cbor::to_diag(in, s);
+		check(r == (n < full.size() ? cbor::errc::no_space
+		    : cbor::errc::ok), "status");
+		check(full.starts_with(std::string_view{buf.data(), s.size()}),
+		    "prefix");
+	}
+}
+
+void
+floats()
+{
+	/* preferred widths need no indicator */
+	round_trip("f93e00", "1.5");
+	round_trip("fa47c35000", "1e+05");
+	round_trip("fb3fb999999999999a", "0.1");
+	round_trip("f97c00", "Infinity");
+	round_trip("f97e00", "NaN");
+
+	/* wider than preferred */
+	round_trip("fa3fc00000", "1.5_2");
+	round_trip("fb3ff8000000000000", "1.5_3");
+	round_trip("fb8000000000000000", "-0.0_3");
+	round_trip("fbfff0000000000000", "-Infinity_3");
+	round_trip("fa7fc00000", "NaN_2");
+	round_trip("fb7ff8000000000000", "NaN_3");
+
+	/* NaNs with payloads or sign */
+	round_trip("f97e01", "float'7e01'");
+	round_trip("f9fe00", "float'fe00'");
+	round_trip("fa7f800001", "float'7f800001'");
+	round_trip("fb7ff8000000000001", "float'7ff8000000000001'");
+
+	std::vector<std::byte> v;
+	check(cbor_of("1.1_1", v) == cbor::errc::invalid_diag,
+	    "indicator too narrow for the value");
+	check(cbor_of("1_1", v) == cbor::errc::invalid_diag,
+	    "indicator on an integer");
+	check(cbor_of("float'7e00ff'", v) == cbor::errc::invalid_diag,
+	    "float of three bytes");
+}
+
+}
+
+int
+main()
+{
+	items();
+	no_space();
+	floats();
+	std::puts("ok");
+	return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * Regression tests for document memory use.
+ *
+ * Build and run from the top of the tree:
+ *
+ *	c++ -std=c++20 -Iinclude test/document.cpp -o test_document
+ *	./test_document
+ *
+ * Exits with status 1 and a message on the first failure.
+ */
+
+#include <cbor++/document.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+namespace {
+
+/* counts bytes requested from upstream */
+class counting_resource final : public std::pmr::memory_resource {
+public:
+	std::size_t allocated = 0;
+
+private:
+	void *do_allocate(std::size_t n, std::size_t align) override
+	{
+		allocated += n;
+		return std::pmr::new_delete_resource()->allocate(n, align);
+	}
+
+	void do_deallocate(void *p, std::size_t n, std::size_t align) override
+	{
+		std::pmr::new_delete_resource()->deallocate(p, n, align);
+	}
+
+	bool do_is_equal(const memory_resource &o) const noexcept override
+	{
+		return this == &o;
+	}
+};
+
+void
+check(bool ok, const char *what)
+{
+	if (!ok) {
+		std::fprintf(stderr, "FAIL: %s\n", what);
+		std::exit(1);
+	}
+}
+
+/* (_ "a", "a", ...) with n one byte chunks */
+std::vector<std::byte>
+chunked_text(std::size_t n)
+{
+	std::vector<std::byte> v{std::byte{0x7f}};
+	for (std::size_t i = 0; i < n; ++i) {
+		v.push_back(std::byte{0x61});
+		v.push_back(std::byte{'a'});
+	}
+	v.push_back(std::byte{0xff});
+	return v;
+}
+
+void
+many_small_chunks()
+{
+	constexpr std::size_t n = 20000;
+	const auto in = chunked_text(n);
+	counting_resource counter;
+	std::pmr::monotonic_buffer_resource arena{&counter};
+	cbor::document doc{&arena};
+	check(doc.parse(in) == cbor::errc::ok, "chunked string parses");
+	check(doc.root().as_text() == std::string(n, 'a'),
+	    "chunked string content");
+	/* a few times the string, not the square of it */
+	check(counter.allocated < 8 * n, "chunked string memory is linear");
+}
+
+}
+
+int
+main()
+{
+	many_small_chunks();
+	std::puts("ok");
+	return 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * Tests for deterministic encoding.
+ *
+ * Build and run from the top of the tree:
+ *
+ *	c++ -std=c++20 -Iinclude test/encoder.cpp -o test_encoder
+ *	./test_encoder
+ *
+ * Exits with status 1 and a message on the first failure.
+ */
+
+#include <cbor++/diag.h>
+#include <cbor++/encoder.h>
+#include <cbor++/sink.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+void
+check(bool ok, const char *what)
+{
+	if (!ok) {
+		std::fprintf(stderr, "FAIL: %s\n", what);
+		std::exit(1);
+	}
+}
+
+void
+check(bool ok, std::string_view what)
+{
+	check(ok, std::string{what}.c_str());
+}
+
+std::string
+diag_of(std::span<const std::byte> in)
+{
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	check(cbor::to_diag(in, s) == cbor::errc::ok, "to_diag");
+	s.finish();
+	return {reinterpret_cast<const char *>(v.data()), v.size()};
+}
+
+/* status of a deterministic encoder after write, and what it wrote */
+template<typename Write>
+cbor::errc
+written(Write &&write, std::string &out)
+{
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	cbor::encoder enc{s, cbor::deterministic};
+	write(enc);
+	s.finish();
+	if (enc.status() == cbor::errc::ok)
+		out = diag_of(v);
+	return enc.status();
+}
+
+/* diagnostic notation written through a deterministic encoder */
+cbor::errc
+deterministic(std::string_view diag, std::string &out)
+{
+	return written([&](auto &enc) {
+		check(cbor::from_diag(diag, enc) == cbor::errc::ok ||
+		    enc.status() != cbor::errc::ok, diag);
+	}, out);
+}
+
+/* diag comes out sorted as sorted */
+void
+sorts(std::string_view diag, std::string_view sorted)
+{
+	std::string out;
+	check(deterministic(diag, out) == cbor::errc::ok && out == sorted,
+	    diag);
+}
+
+void
+key_order()
+{
+	/* by the bytes of the encoded keys, so shorter heads first */
+	sorts(R"({"b": 1, "a": 2, 10: 3, -1: 4, 100: 5, "aa": 6})",
+	    R"({10: 3, 100: 5, -1: 4, "a": 2, "b": 1, "aa": 6})");
+	sorts(R"({h'02': 1, [1]: 2, false: 3, 1.5: 4, 1(0): 5, {}: 6})",
+	    R"({h'02': 1, [1]: 2, {}: 6, 1(0): 5, false: 3, 1.5: 4})");
+	sorts("{}", "{}");
+	sorts("{1: 2}", "{1: 2}");
+	sorts("{1: 2, 3: 4}", "{1: 2, 3: 4}");
+
+	/* keys equal in their first eight bytes */
+	sorts(R"({"abcdefghij2": 1, "abcdefghij1": 2, "abcdefg": 3})",
+	    R"({"abcdefg": 3, "abcdefghij1": 2, "abcdefghij2": 1})");
+
+	/* values move with their keys, and nested maps sort on their own */
+	sorts(R"([{"z": {"y": [1, 2], "x": h'00'}, )"
+	    R"("w": {3: 4, 2: {1: 0, 0: 1}}}, {2: 0, 1: 0}])",
+	    R"([{"w": {2: {0: 1, 1: 0}, 3: 4}, )"
+	    R"("z": {"x": h'00', "y": [1, 2]}}, {1: 0, 2: 0}])");
+
+	/* many entries in reverse, which sort by length, then text */
+	std::vector<std::string> keys;
+	for (int i = 0; i < 300; ++i)
+		keys.push_back(std::to_string(i));
+	std::string out;
+	check(written([&](auto &enc) {
+		enc.map(keys.size());
+		for (auto i = keys.size(); i-- > 0;) {
+			enc.text(keys[i]);
+			enc.uint(i);
+		}
+	}, out) == cbor::errc::ok, "300 entries");
+	std::sort(keys.begin(), keys.end(), [](const auto &a, const auto &b) {
+		return a.size() != b.size() ? a.size() < b.size() : a < b;
+	});
+	std::string sorted = "{";
+	for (const auto &k : keys)
+		sorted += (sorted.size() > 1 ? ", \"" : "\"") + k + "\": " +
+		    k;
+	check(out == sorted + "}", "300 entries sorted");
+}
+
+void
+errors()
+{
+	std::string out;
+	check(deterministic(R"({"a": 1, "a": 2})", out) ==
+	    cbor::errc::duplicate_key, "duplicate key");
+	check(deterministic(R"({"b": 0, "a": 1, "b": 2})", out) ==
+	    cbor::errc::duplicate_key, "duplicate key out of order");
+	check(deterministic("[0, {1: 1, 1: 1}]", out) ==
+	    cbor::errc::duplicate_key, "duplicate entry in a nested map");
+
+	check(deterministic("[_ 1]", out) == cbor::errc::not_deterministic,
+	    "indefinite array");
+	check(deterministic("{_ 1: 2}", out) == cbor::errc::not_deterministic,
+	    "indefinite map");
+	check(deterministic(R"((_ "a"))", out) ==
+	    cbor::errc::not_deterministic, "indefinite text");
+	check(written([](auto &enc) {
+		enc.stringrefs_begin();
+		enc.text("abc");
+		enc.stringrefs_end();
+	}, out) == cbor::errc::not_deterministic, "stringref namespace");
+
+	/* the first error sticks */
+	check(written([](auto &enc) {
+		enc.array(2);
+		enc.map(2);
+		enc.uint(1);
+		enc.uint(1);
+		enc.uint(1);
+		enc.uint(1);
+		enc.array();
+		enc.end();
+	}, out) == cbor::errc::duplicate_key, "first error is kept");
+}
+
+void
+values()
+{
+	std::string out;
+	check(written([](auto &enc) {
+		enc.array(4);
+		enc.floating(std::nan("1"));
+		enc.floating(-std::nan(""));
+		enc.floating(1.5);
+		enc.floating(0.1);
+	}, out) == cbor::errc::ok &&
+	    out == "[NaN, NaN, 1.5, 0.1]", "floats");
+
+	/* a plain encoder keeps the order it is given */
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	cbor::encoder plain{s};
+	check(cbor::from_diag(R"({"b": 1, "a": 2, "a": 3})", plain) ==
+	    cbor::errc::ok, "plain encoder");
+	s.finish();
+	check(diag_of(v) == R"({"b": 1, "a": 2, "a": 3})",
+	    "plain encoder keeps order");
+}
+
+}
+
+int
+main()
+{
+	key_order();
+	errors();
+	values();
+	std::puts("ok");
+	return 0;
+}
@@ -0,0 +1,250 @@
+/*
+ * Tests for the incremental decoder: input fed in fragments down to a byte
+ * at a time decodes to the same items as a cursor over the whole input.
+ *
+ * Build and run from the top of the tree:
+ *
+ *	c++ -std=c++20 -Iinclude test/incremental.cpp -o test_incremental
+ *	./test_incremental
+ *
+ * Exits with status 1 and a message on the first failure.
+ */
+
+#include <cbor++/diag.h>
+#include <cbor++/incremental.h>
+#include <cbor++/sink.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+void
+check(bool ok, const char *what)
+{
+	if (!ok) {
+		std::fprintf(stderr, "FAIL: %s\n", what);
+		std::exit(1);
+	}
+}
+
+void
+check(bool ok, std::string_view what)
+{
+	check(ok, std::string{what}.c_str());
+}
+
+std::vector<std::byte>
+cbor_of(std::string_view diag)
+{
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	cbor::encoder enc{s};
+	check(cbor::from_diag(diag, enc) == cbor::errc::ok, diag);
+	s.finish();
+	return v;
+}
+
+/*
+ * Events in a form which does not depend on how strings were split: each
+ * string, whether delivered whole, in chunks or in fragments, is one entry
+ * with its full content.
+ */
+class recorder {
+public:
+	void add(const cbor::event &ev)
+	{
+		switch (ev.type) {
+		case cbor::token::bytes_begin:
+		case cbor::token::text_begin:
+			if (!open_++)
+				start(ev);
+			return;
+		case cbor::token::bytes_end:
+		case cbor::token::text_end:
+			if (!--open_)
+				out += "\n";
+			return;
+		case cbor::token::bytes:
+		case cbor::token::text:
+			if (!open_)
+				start(ev);
+			out.append(reinterpret_cast<const char *>(ev.data),
+			    ev.value);
+			if (!open_)
+				out += "\n";
+			return;
+		default:
+			out += std::to_string(int(ev.type)) + " " +
+			    std::to_string(ev.value) + " @" +
+			    std::to_string(ev.offset) + "\n";
+		}
+	}
+
+	std::string out;
+
+private:
+	void start(const cbor::event &ev)
+	{
+		const bool text = ev.type == cbor::token::text ||
+		    ev.type == cbor::token::text_begin;
+		out += (text ? "text @" : "bytes @") + std::to_string(ev.offset) +
+		    ": ";
+	}
+
+	unsigned open_ = 0;
+};
+
+/* events of a cursor over in, and its final status */
+cbor::errc
+whole(std::span<const std::byte> in, std::string &out)
+{
+	recorder rec;
+	cbor::cursor c{in};
+	cbor::event ev;
+	cbor::errc r;
+	while ((r = c.next(ev)) == cbor::errc::ok &&
+	    ev.type != cbor::token::eof)
+		rec.add(ev);
+	out = rec.out;
+	return r;
+}
+
+/*
+ * Events of an incremental decoder given in step bytes at a time, and its
+ * final status: ok if it ended between items, truncated if it wanted more.
+ */
+cbor::errc
+pieces(std::span<const std::byte> in, std::size_t step, std::string &out)
+{
+	recorder rec;
+	cbor::incremental_decoder d;
+	std::vector<std::byte> pending;
+	cbor::errc r = cbor::errc::ok;
+	for (std::size_t i = 0; i < in.size(); i += step) {
+		const auto piece = in.subspan(i, std::min(step, in.size() - i));
+		pending.insert(pending.end(), piece.begin(), piece.end());
+		for (;;) {
+			std::size_t used;
+			cbor::event ev;
+			r = d.next(pending, used, ev);
+			if (r == cbor::errc::truncated) {
+				check(d.needed() > 0, "needed after truncated");
+				break;
+			}
+			if (r != cbor::errc::ok) {
+				out = rec.out;
+				return r;
+			}
+			if (ev.type == cbor::token::eof)
+				break;
+			rec.add(ev);
+			pending.erase(pending.begin(), pending.begin() + used);
+		}
+		check(pending.size() <= 8, "at most a head is left");
+	}
+	check(d.offset() + pending.size() == in.size(), "offset");
+	out = rec.out;
+	return r;
+}
+
+/* every way of feeding in agrees with the cursor */
+void
+agree(std::span<const std::byte> in, std::string_view what)
+{
+	std::string want;
+	const auto r = whole(in, want);
+	for (const std::size_t step : {1, 2, 3, 7, 64, 1 << 20}) {
+		std::string got;
+		const auto s = pieces(in, step, got);
+		/*
+		 * On an error either may have gone further: the decoder
+		 * delivers the fragments of a string before the one which
+		 * fails.
+		 */
+		if (r == cbor::errc::ok)
+			check(s == r && got == want, what);
+		else
+			check(s == r && (want.starts_with(got) ||
+			    got.starts_with(want)), what);
+	}
+}
+
+void
+items()
+{
+	const char *const docs[] = {
+		"0", "23", "24", "18446744073709551615", "-18446744073709551616",
+		"1.5", "0.1", "1e+300", "Infinity", "true", "null", "simple(16)",
+		R"("")", "h''", R"("a")", R"("a longer string of text, 36 bytes")",
+		R"("μετά €😀 and ASCII")",
+		R"((_ "abc", "", "de€"))", R"((_ h'0102', h'030405'))",
+		"[]", "{}", "[_ ]", "[1, [2, [3, [4]]], [_ 5, 6]]",
+		R"({"a": {"b": [h'00', {_ 1: "x"}]}, 2: -3})",
+		R"(0("2013-03-21T20:04:00Z"))", "1(2(3(4)))",
+		R"([1.5_3, float'7e01', "x"])",
+	};
+	for (const char *doc : docs)
+		agree(cbor_of(doc), doc);
+
+	/* a sequence of items, with strings longer than any piece */
+	std::vector<std::byte> seq;
+	for (const char *doc : docs) {
+		const auto v = cbor_of(doc);
+		seq.insert(seq.end(), v.begin(), v.end());
+	}
+	const std::string big(5000, 'z');
+	const auto v = cbor_of(R"({"big": [")" + big + R"(", (_ ")" + big +
+	    R"(")]})");
+	seq.insert(seq.end(), v.begin(), v.end());
+	agree(seq, "sequence");
+}
+
+void
+errors()
+{
+	/* text split inside a code point, valid and not */
+	agree(cbor_of(R"(["€€€€€€€€€€€€€€€€€€€€€€€€€€€€€€€€", "😀"])"),
+	    "split code points");
+	std::vector<std::byte> bad = cbor_of(R"(["abcdefgh€", 1])");
+	bad[bad.size() - 3] = std::byte{0x28};
+	agree(bad, "invalid text");
+	std::vector<std::byte> chunk = cbor_of(R"((_ "€€", "€"))");
+	chunk[4] = std::byte{0xff};
+	agree(chunk, "invalid chunk");
+
+	/* truncated input ends wanting more */
+	const auto in = cbor_of(R"([1, "abcdef", {2: h'0102'}])");
+	for (std::size_t n = 1; n < in.size(); ++n) {
+		std::string want;
+		std::string got;
+		check(whole(std::span{in}.first(n), want) ==
+		    cbor::errc::truncated, "cursor truncated");
+		for (const std::size_t step : {1, 3}) {
+			check(pieces(std::span{in}.first(n), step, got) ==
+			    cbor::errc::truncated && (want.starts_with(got) ||
+			    got.starts_with(want)), "incremental truncated");
+		}
+	}
+
+	/* reserved additional information */
+	std::vector<std::byte> reserved{std::byte{0x82}, std::byte{0x01},
+	    std::byte{0x1c}};
+	std::string out;
+	check(whole(reserved, out) == cbor::errc::malformed,
+	    "cursor malformed");
+	agree(reserved, "malformed");
+}
+
+}
+
+int
+main()
+{
+	items();
+	errors();
+	std::puts("ok");
+	return 0;
+}
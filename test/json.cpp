@@ -0,0 +1,233 @@
+/*
+ * Tests for conversion between CBOR and JSON.
+ *
+ * Build and run from the top of the tree:
+ *
+ *	c++ -std=c++20 -Iinclude test/json.cpp -o test_json
+ *	./test_json
+ *
+ * Exits with status 1 and a message on the first failure.
+ */
+
+#include <cbor++/diag.h>
+#include <cbor++/json.h>
+#include <cbor++/sink.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+void
+check(bool ok, const char *what)
+{
+	if (!ok) {
+		std::fprintf(stderr, "FAIL: %s\n", what);
+		std::exit(1);
+	}
+}
+
+void
+check(bool ok, std::string_view what)
+{
+	check(ok, std::string{what}.c_str());
+}
+
+std::vector<std::byte>
+from_hex(std::string_view s)
+{
+	std::vector<std::byte> v;
+	for (std::size_t i = 0; i + 1 < s.size(); i += 2)
+		v.push_back(static_cast<std::byte>(std::stoul(
+		    std::string{s.substr(i, 2)}, nullptr, 16)));
+	return v;
+}
+
+std::string
+text_of(const std::vector<std::byte> &v)
+{
+	return {reinterpret_cast<const char *>(v.data()), v.size()};
+}
+
+/* JSON for CBOR, or the error */
+cbor::errc
+json_of(std::span<const std::byte> in, std::string &out)
+{
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	const auto r = cbor::to_json(in, s);
+	s.finish();
+	out = text_of(v);
+	return r;
+}
+
+/* the JSON for hex is json */
+void
+to_json(std::string_view hex, std::string_view json)
+{
+	std::string out;
+	check(json_of(from_hex(hex), out) == cbor::errc::ok && out == json,
+	    hex);
+}
+
+/* diagnostic notation of the CBOR for JSON, or the error */
+cbor::errc
+diag_of(std::string_view json, std::string &out)
+{
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	cbor::encoder enc{s};
+	const auto r = cbor::from_json(json, enc);
+	s.finish();
+	if (r != cbor::errc::ok)
+		return r;
+	std::vector<std::byte> d;
+	cbor::vector_sink ds{d};
+	check(cbor::to_diag(v, ds) == cbor::errc::ok, "to_diag");
+	ds.finish();
+	out = text_of(d);
+	return r;
+}
+
+/* the CBOR for json reads as diag */
+void
+from_json(std::string_view json, std::string_view diag)
+{
+	std::string out;
+	check(diag_of(json, out) == cbor::errc::ok && out == diag, json);
+}
+
+void
+from_json(std::string_view json, cbor::errc e)
+{
+	std::string out;
+	check(diag_of(json, out) == e, json);
+}
+
+void
+escapes()
+{
+	to_json("6c61225c620a017f20c3a97e2f",
+	    R"("a\"\\b\n\u0001)" "\x7f" R"( é~/")");
+	from_json(R"("\"\\\/\b\f\n\r\t")", R"("\"\\/\b\f\n\r\t")");
+	from_json(R"("\u0041\u00e9\u20ac")", R"("Aé€")");
+
+	/* at every offset of strings longer than a block */
+	for (const char c : {'"', '\\', '\n', '\x1f'}) {
+		for (std::size_t i = 0; i < 48; ++i) {
+			std::string s(48, 'x');
+			s[i] = c;
+			std::vector<std::byte> in;
+			cbor::vector_sink sink{in};
+			cbor::encoder enc{sink};
+			enc.text(s);
+			sink.finish();
+			std::string json;
+			check(json_of(in, json) == cbor::errc::ok,
+			    "escape in a block");
+			const std::string esc = c == '"' ? R"(\")"
+			    : c == '\\' ? R"(\\)" : c == '\n' ? R"(\n)"
+			    : R"(\u001f)";
+			check(json == '"' + s.substr(0, i) + esc +
+			    s.substr(i + 1) + '"', "escape in a block");
+
+			/* and back */
+			std::vector<std::byte> back;
+			cbor::vector_sink bs{back};
+			cbor::encoder benc{bs};
+			check(cbor::from_json(json, benc) == cbor::errc::ok,
+			    "escaped string reads back");
+			bs.finish();
+			check(back == in, "escaped string reads back");
+		}
+	}
+}
+
+void
+surrogates()
+{
+	from_json(R"("\ud83d\ude00")", R"("😀")");
+	from_json(R"("\uD83D\uDE00x")", R"("😀x")");
+	from_json(R"("\udbff\udfff")", "\"\xf4\x8f\xbf\xbf\"");
+	from_json(R"("😀")", R"("😀")");
+
+	from_json(R"("\ud83d")", cbor::errc::invalid_utf8);
+	from_json(R"("\ud83dx")", cbor::errc::invalid_utf8);
+	from_json(R"("\ud83d\u0041")", cbor::errc::invalid_utf8);
+	from_json(R"("\ud83d\ud83d")", cbor::errc::invalid_utf8);
+	from_json(R"("\ude00")", cbor::errc::invalid_utf8);
+	from_json(R"("\ud83d\ude0")", cbor::errc::invalid_json);
+	from_json(R"("\u12g4")", cbor::errc::invalid_json);
+	from_json(R"("\u12")", cbor::errc::invalid_json);
+	from_json(R"("\x")", cbor::errc::invalid_json);
+
+	/* raw bytes are checked unless trusted */
+	from_json("\"\xff\"", cbor::errc::invalid_utf8);
+	std::string out;
+	check(diag_of("\"\xed\xa0\x80\"", out) == cbor::errc::invalid_utf8,
+	    "encoded surrogate");
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	cbor::encoder enc{s};
+	check(cbor::from_json("\"\xff\"", enc, true) == cbor::errc::ok,
+	    "trusted input is not checked");
+}
+
+void
+bignums()
+{
+	to_json("c249010000000000000000", R"("AQAAAAAAAAAA")");
+	to_json("c349010000000000000000", R"("~AQAAAAAAAAAA")");
+	to_json("c340", R"("~")");
+	to_json("82c2420102c3420102", R"(["AQI","~AQI"])");
+	to_json("3bffffffffffffffff", "-18446744073709551616");
+	to_json("1bffffffffffffffff", "18446744073709551615");
+}
+
+void
+values()
+{
+	to_json("4401020304", R"("AQIDBA")");
+	to_json("d64401020304", R"("AQIDBA==")");
+	to_json("d74401020304", R"("01020304")");
+	to_json("f93e00", "1.5");
+	to_json("fa3dcccccd", "0.1");
+	to_json("fb3fb999999999999a", "0.1");
+	to_json("f97c00", "null");
+	to_json("f97e00", "null");
+	to_json("84f4f5f6f7", "[false,true,null,null]");
+	to_json("f0", "null");
+	to_json("c11a514b67b0", "1363896240");
+	to_json("a20102616103", R"({"1":2,"a":3})");
+	to_json("a1f502", R"({"true":2})");
+	std::string out;
+	check(json_of(from_hex("a18001"), out) == cbor::errc::type_mismatch,
+	    "array as a key");
+
+	from_json("[1, -1, 18446744073709551615, 18446744073709551616, "
+	    "-18446744073709551616, 1.5, 1e2, -0]",
+	    "[_ 1, -1, 18446744073709551615, 18446744073709551616.0, "
+	    "-18446744073709551616, 1.5, 100.0, -0.0]");
+	from_json(R"([1,{"a":[]}])", R"([_ 1, {_ "a": [_ ]}])");
+	from_json(" true ", "true");
+	from_json("[true, false, null]", "[_ true, false, null]");
+	from_json("[1,]", cbor::errc::invalid_json);
+	from_json("01", cbor::errc::invalid_json);
+	from_json("1.", cbor::errc::invalid_json);
+	from_json(R"({"a" 1})", cbor::errc::invalid_json);
+}
+
+}
+
+int
+main()
+{
+	escapes();
+	surrogates();
+	bignums();
+	values();
+	std::puts("ok");
+	return 0;
+}
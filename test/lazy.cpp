@@ -0,0 +1,107 @@
+/*
+ * Regression tests for lazy document memory use.
+ *
+ * Build and run from the top of the tree:
+ *
+ *	c++ -std=c++20 -Iinclude test/lazy.cpp -o test_lazy
+ *	./test_lazy
+ *
+ * Exits with status 1 and a message on the first failure.
+ */
+
+#include <cbor++/encoder.h>
+#include <cbor++/lazy.h>
+#include <cbor++/sink.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory_resource>
+#include <vector>
+
+namespace {
+
+/* tracks bytes held from upstream */
+class counting_resource final : public std::pmr::memory_resource {
+public:
+	std::size_t held = 0;
+	std::size_t peak = 0;
+
+private:
+	void *do_allocate(std::size_t n, std::size_t align) override
+	{
+		held += n;
+		peak = std::max(peak, held);
+		return std::pmr::new_delete_resource()->allocate(n, align);
+	}
+
+	void do_deallocate(void *p, std::size_t n, std::size_t align) override
+	{
+		held -= n;
+		std::pmr::new_delete_resource()->deallocate(p, n, align);
+	}
+
+	bool do_is_equal(const memory_resource &o) const noexcept override
+	{
+		return this == &o;
+	}
+};
+
+void
+check(bool ok, const char *what)
+{
+	if (!ok) {
+		std::fprintf(stderr, "FAIL: %s\n", what);
+		std::exit(1);
+	}
+}
+
+/* [0, 1, ..., n - 1] */
+std::vector<std::byte>
+counting_array(unsigned n)
+{
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	cbor::encoder enc{s};
+	enc.array(n);
+	for (unsigned i = 0; i < n; ++i)
+		enc.uint(i);
+	s.finish();
+	return v;
+}
+
+void
+reparse_reclaims()
+{
+	constexpr unsigned n = 1000;
+	const auto in = counting_array(n);
+	counting_resource counter;
+	auto *const old = std::pmr::set_default_resource(&counter);
+	{
+		cbor::lazy_document doc;
+		const auto expand = [&] {
+			check(doc.parse(in) == cbor::errc::ok, "array parses");
+			const auto root = doc.root();
+			check(root.size() == n && root[n - 1].as_uint() == n - 1,
+			    "array content");
+		};
+		expand();
+		const std::size_t once = counter.peak;
+		check(once > 0, "expanding allocates");
+		for (int i = 0; i < 100; ++i)
+			expand();
+		/* the arena is reused rather than grown for every parse */
+		check(counter.peak < 4 * once, "reparse releases the arena");
+	}
+	std::pmr::set_default_resource(old);
+}
+
+}
+
+int
+main()
+{
+	reparse_reclaims();
+	std::puts("ok");
+	return 0;
+}
@@ -0,0 +1,217 @@
+/*
+ * Tests for packed CBOR.
+ *
+ * Build and run from the top of the tree:
+ *
+ *	c++ -std=c++20 -Iinclude test/packed.cpp -o test_packed
+ *	./test_packed
+ *
+ * Exits with status 1 and a message on the first failure.
+ */
+
+#include <cbor++/diag.h>
+#include <cbor++/packed.h>
+#include <cbor++/sink.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+void
+check(bool ok, const char *what)
+{
+	if (!ok) {
+		std::fprintf(stderr, "FAIL: %s\n", what);
+		std::exit(1);
+	}
+}
+
+/* CBOR for diagnostic notation */
+std::vector<std::byte>
+cbor_of(std::string_view diag)
+{
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	cbor::encoder enc{s};
+	check(cbor::from_diag(diag, enc) == cbor::errc::ok, "from_diag");
+	s.finish();
+	return v;
+}
+
+/* diagnostic notation for CBOR */
+std::string
+diag_of(std::span<const std::byte> in)
+{
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	check(cbor::to_diag(in, s) == cbor::errc::ok, "to_diag");
+	s.finish();
+	return {reinterpret_cast<const char *>(v.data()), v.size()};
+}
+
+/* unpack the packed message in diagnostic notation */
+cbor::errc
+unpack(std::string_view diag, std::string &out)
+{
+	const auto in = cbor_of(diag);
+	cbor::packed_document doc;
+	if (auto r = doc.parse(in); r != cbor::errc::ok)
+		return r;
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	cbor::encoder enc{s};
+	const auto r = cbor::unpack(doc.root(), enc);
+	s.finish();
+	if (r == cbor::errc::ok)
+		out = diag_of(v);
+	return r;
+}
+
+/* pack, then unpack and compare with the input */
+std::string
+round_trip(std::string_view diag)
+{
+	const auto in = cbor_of(diag);
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	cbor::encoder enc{s};
+	check(cbor::pack(in, enc) == cbor::errc::ok, "pack");
+	s.finish();
+	const auto packed = diag_of(v);
+	std::string out;
+	check(unpack(packed, out) == cbor::errc::ok && out == diag,
+	    "unpacks to the input");
+	return packed;
+}
+
+void
+round_trips()
+{
+	check(round_trip(R"([1, 1, 1, "abc", "abc", "abc", 1.5, 1.5])") ==
+	    R"(113([["abc", 1.5], [], [1, 1, 1, simple(0), simple(0), )"
+	    R"(simple(0), simple(1), simple(1)]]))", "repeated items shared");
+	check(round_trip(R"({"a": [true, null], "b": h'0102', "c": -7})") ==
+	    R"(113([[], [], {"a": [true, null], "b": h'0102', "c": -7}]))",
+	    "nothing repeated");
+	check(round_trip(R"(24(h'01'))") == R"(113([[], [], 24(h'01')]))",
+	    "tag");
+	check(round_trip("[]") == "113([[], [], []])", "empty array");
+
+	/* a batch of readings shares its keys, unit and URI prefix */
+	std::string batch = "[";
+	for (int i = 0; i < 6; ++i)
+		batch += std::string{i ? ", " : ""} +
+		    R"({"id": "urn:dev:ow:10e2073a01080063", "u": "Cel", )"
+		    R"("n": "coap://sensor.example/temp/)" + std::to_string(i) +
+		    R"(", "v": 23.5, "t": 1700000000})";
+	batch += "]";
+	const auto in = cbor_of(batch);
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	cbor::encoder enc{s};
+	check(cbor::pack(in, enc) == cbor::errc::ok, "pack batch");
+	s.finish();
+	check(v.size() < in.size() / 2, "batch packs to under half");
+	cbor::packed_document doc;
+	check(doc.parse(v) == cbor::errc::ok, "parse batch");
+	const auto r3 = doc.root()[3];
+	check(r3.find("n").as_text() == "coap://sensor.example/temp/3" &&
+	    r3.find("v").as_double() == 23.5 && r3.find("n").joined(),
+	    "read packed batch");
+	std::string out;
+	check(unpack(diag_of(v), out) == cbor::errc::ok && out == batch,
+	    "unpack batch");
+
+	/* tables built from samples pack later messages */
+	cbor::packer p;
+	check(p.add(in) == cbor::errc::ok, "add sample");
+	p.build();
+	check(p.shared_size() == 9 && p.prefix_size() == 1, "tables");
+	const auto later = cbor_of(R"({"u": "Cel", )"
+	    R"("n": "coap://sensor.example/temp/9", "v": 20.5})");
+	v.clear();
+	cbor::vector_sink ls{v};
+	cbor::encoder lenc{ls};
+	check(p.write(later, lenc) == cbor::errc::ok, "write later");
+	ls.finish();
+	check(unpack(diag_of(v), out) == cbor::errc::ok &&
+	    out == diag_of(later), "unpack later");
+}
+
+/* references written by hand */
+void
+joins()
+{
+	std::string out;
+	std::string shared;
+	for (int i = 0; i < 18; ++i)
+		shared += std::to_string(100 + i) + (i < 17 ? ", " : "");
+	check(unpack("113([[" + shared + "], [], [simple(15), 6(0), 6(-1)]])",
+	    out) == cbor::errc::ok && out == "[115, 116, 117]",
+	    "shared references");
+	check(unpack("113([[], [[1, 2]], 224([3])])", out) ==
+	    cbor::errc::ok && out == "[1, 2, 3]", "array prefix");
+	check(unpack("113([[], [[9]], 216([1])])", out) == cbor::errc::ok &&
+	    out == "[1, 9]", "array suffix");
+	check(unpack(R"(113([[], [{"a": 1}], 224({"b": 2})]))", out) ==
+	    cbor::errc::ok && out == R"({"a": 1, "b": 2})", "map merge");
+	check(unpack(R"(113([[], [h'01'], 224(h'02')]))", out) ==
+	    cbor::errc::ok && out == "h'0102'", "byte strings");
+	check(unpack(R"(113([["x"], [], simple(1)]))", out) ==
+	    cbor::errc::invalid_packed, "shared item past the table");
+	check(unpack(R"(113([[], [], 225("b")]))", out) ==
+	    cbor::errc::invalid_packed, "argument past the table");
+}
+
+void
+reference_ranges()
+{
+	std::string out;
+	check(unpack(R"(113([[], ["a/"], 224("b")]))", out) ==
+	    cbor::errc::ok && out == R"("a/b")", "one byte prefix");
+	check(unpack(R"(113([[], [".c"], 216("b")]))", out) ==
+	    cbor::errc::ok && out == R"("b.c")", "one byte suffix");
+
+	/* tag 28704 is argument 32 */
+	std::string args;
+	for (int i = 0; i < 32; ++i)
+		args += R"("-", )";
+	check(unpack(R"(113([[], [)" + args + R"("a/"], 28704("b")]))",
+	    out) == cbor::errc::ok && out == R"("a/b")",
+	    "two byte prefix, first");
+
+	/* unsupported references are errors, not unknown tags */
+	check(unpack(R"(113([[], [".c"], 27647("b")]))", out) ==
+	    cbor::errc::invalid_packed, "two byte suffix, first");
+	check(unpack(R"(113([[], [".c"], 28671("b")]))", out) ==
+	    cbor::errc::invalid_packed, "two byte suffix, last");
+	check(unpack(R"(113([[], [".c"], 1811940352("b")]))", out) ==
+	    cbor::errc::invalid_packed, "four byte suffix");
+	check(unpack(R"(113([[], ["a/"], 2147483647("b")]))", out) ==
+	    cbor::errc::invalid_packed, "four byte prefix");
+	check(unpack(R"(113([[], [], 27646("b")]))", out) ==
+	    cbor::errc::ok && out == R"(27646("b"))", "tag below the range");
+
+	/* and are not taken as plain tags by the packer */
+	const auto tagged = cbor_of(R"(28000("b"))");
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	cbor::encoder enc{s};
+	check(cbor::pack(tagged, enc) == cbor::errc::type_mismatch,
+	    "packer rejects reserved tags");
+}
+
+}
+
+int
+main()
+{
+	round_trips();
+	joins();
+	reference_ranges();
+	std::puts("ok");
+	return 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * Tests for output sinks.
+ *
+ * Build and run from the top of the tree:
+ *
+ *	c++ -std=c++20 -Iinclude test/sink.cpp -o test_sink
+ *	./test_sink
+ *
+ * Exits with status 1 and a message on the first failure.
+ */
+
+#include <cbor++/encoder.h>
+#include <cbor++/sink.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+void
+check(bool ok, const char *what)
+{
+	if (!ok) {
+		std::fprintf(stderr, "FAIL: %s\n", what);
+		std::exit(1);
+	}
+}
+
+/* a byte string filled in place through a sink smaller than a piece */
+template<std::size_t N>
+void
+small_callback_buffer()
+{
+	std::vector<std::byte> out;
+	const auto fn = [&](std::span<const std::byte> s) {
+		out.insert(out.end(), s.begin(), s.end());
+		return true;
+	};
+	cbor::callback_sink<decltype(fn), N> sink{fn};
+	cbor::encoder enc{sink};
+
+	constexpr std::size_t n = 10000;
+	std::size_t filled = 0;
+	enc.bytes(n, [&](std::span<std::byte> piece) {
+		for (auto &b : piece)
+			b = static_cast<std::byte>(filled++);
+	});
+	check(enc.status() == cbor::errc::ok, "in place bytes fit the buffer");
+	check(sink.flush(), "flush");
+	check(filled == n, "every byte is filled");
+	check(out.size() == 3 + n && out[0] == std::byte{0x59} &&
+	    out[1] == std::byte{n >> 8} && out[2] == std::byte{n & 0xff},
+	    "byte string head");
+	bool same = true;
+	for (std::size_t i = 0; i < n; ++i)
+		same &= out[3 + i] == static_cast<std::byte>(i);
+	check(same, "byte string content");
+}
+
+}
+
+int
+main()
+{
+	small_callback_buffer<16>();
+	small_callback_buffer<1000>();
+	small_callback_buffer<4096>();
+	small_callback_buffer<10000>();
+	std::puts("ok");
+	return 0;
+}
@@ -0,0 +1,245 @@
+/*
+ * Tests for stringref namespaces.
+ *
+ * Build and run from the top of the tree:
+ *
+ *	c++ -std=c++20 -Iinclude test/stringref.cpp -o test_stringref
+ *	./test_stringref
+ *
+ * Exits with status 1 and a message on the first failure.
+ */
+
+#include <cbor++/diag.h>
+#include <cbor++/sink.h>
+#include <cbor++/stringref.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+void
+check(bool ok, const char *what)
+{
+	if (!ok) {
+		std::fprintf(stderr, "FAIL: %s\n", what);
+		std::exit(1);
+	}
+}
+
+/* CBOR written by write */
+template<typename Write>
+std::vector<std::byte>
+encoded(Write &&write)
+{
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	cbor::encoder enc{s};
+	write(enc);
+	check(enc.status() == cbor::errc::ok, "encoder status");
+	s.finish();
+	return v;
+}
+
+std::vector<std::byte>
+cbor_of(std::string_view diag)
+{
+	return encoded([&](auto &enc) {
+		check(cbor::from_diag(diag, enc) == cbor::errc::ok, "from_diag");
+	});
+}
+
+std::string
+diag_of(std::span<const std::byte> in)
+{
+	std::vector<std::byte> v;
+	cbor::vector_sink s{v};
+	check(cbor::to_diag(in, s) == cbor::errc::ok, "to_diag");
+	s.finish();
+	return {reinterpret_cast<const char *>(v.data()), v.size()};
+}
+
+/* the strings a stringref_cursor reports for in, in order */
+cbor::errc
+strings(std::span<const std::byte> in, std::vector<std::string_view> &out)
+{
+	out.clear();
+	cbor::stringref_cursor c{in};
+	cbor::event ev;
+	for (;;) {
+		if (auto r = c.next(ev); r != cbor::errc::ok)
+			return r;
+		if (ev.type == cbor::token::eof)
+			return cbor::errc::ok;
+		if (ev.type == cbor::token::text || ev.type == cbor::token::bytes)
+			out.emplace_back(reinterpret_cast<const char *>(ev.data),
+			    ev.value);
+	}
+}
+
+void
+encode()
+{
+	const auto abc = std::as_bytes(std::span{"abc", 3});
+	check(diag_of(encoded([&](auto &enc) {
+		enc.stringrefs_begin();
+		enc.array(6);
+		enc.text("abc");
+		enc.text("abc");
+		enc.text("ab");
+		enc.text("ab");
+		enc.bytes(abc);
+		enc.text("abc");
+		enc.stringrefs_end();
+	    })) == R"(256(["abc", 25(0), "ab", "ab", h'616263', 25(0)]))",
+	    "short strings are not entered, text and bytes are apart");
+
+	check(diag_of(encoded([](auto &enc) {
+		enc.stringrefs_begin();
+		enc.array(3);
+		enc.text("outer");
+		enc.stringrefs_begin();
+		enc.array(2);
+		enc.text("inner");
+		enc.text("inner");
+		enc.stringrefs_end();
+		enc.text("outer");
+		enc.stringrefs_end();
+	    })) == R"(256(["outer", 256(["inner", 25(0)]), 25(0)]))",
+	    "nested namespaces have their own tables");
+
+	check(diag_of(encoded([](auto &enc) {
+		enc.array(2);
+		enc.text("abc");
+		enc.text("abc");
+	    })) == R"(["abc", "abc"])", "no references outside a namespace");
+
+	check(diag_of(encoded([](auto &enc) {
+		enc.stringrefs_begin();
+		enc.array(2);
+		enc.text_begin();
+		enc.text("abc");
+		enc.end();
+		enc.text("abc");
+		enc.stringrefs_end();
+	    })) == R"(256([(_ "abc"), "abc"]))", "chunks are not entered");
+}
+
+/* the shortest string entered grows with the table */
+void
+thresholds()
+{
+	struct {
+		unsigned entries;
+		std::size_t shortest;
+	} const cases[] = {{0, 3}, {23, 3}, {24, 4}, {255, 4}, {256, 5}};
+	for (const auto &t : cases) {
+		const auto in = encoded([&](auto &enc) {
+			enc.stringrefs_begin();
+			enc.array(t.entries + 4);
+			for (unsigned i = 0; i < t.entries; ++i)
+				enc.text("s" + std::to_string(100000 + i));
+			const std::string shorter(t.shortest - 1, 'x');
+			const std::string shortest(t.shortest, 'y');
+			enc.text(shorter);
+			enc.text(shorter);
+			enc.text(shortest);
+			enc.text(shortest);
+			enc.stringrefs_end();
+		});
+		const auto d = diag_of(in);
+		const std::string tail = "\"" +
+		    std::string(t.shortest - 1, 'x') + "\", \"" +
+		    std::string(t.shortest - 1, 'x') + "\", \"" +
+		    std::string(t.shortest, 'y') + "\", 25(" +
+		    std::to_string(t.entries) + ")])";
+		check(d.size() > tail.size() &&
+		    d.compare(d.size() - tail.size(), tail.size(), tail) == 0,
+		    "encoder threshold");
+
+		/* the decoder enters the same strings */
+		std::vector<std::string_view> s;
+		check(strings(in, s) == cbor::errc::ok &&
+		    s.size() == t.entries + 4 && s.back() == s[s.size() - 2] &&
+		    s.back().data() == s[s.size() - 2].data(),
+		    "decoder threshold");
+	}
+}
+
+void
+decode()
+{
+	std::vector<std::string_view> s;
+	const auto in = cbor_of(R"(256(["abc", 25(0), h'616263', 25(1), )"
+	    R"(256(["def", 25(0)]), 25(0)]))");
+	check(strings(in, s) == cbor::errc::ok && s.size() == 7,
+	    "nested namespaces decode");
+	check(s[1] == "abc" && s[1].data() == s[0].data(),
+	    "reference points at the first occurrence");
+	check(s[3].data() == s[2].data(), "bytes reference");
+	check(s[5] == "def" && s[5].data() == s[4].data(), "inner reference");
+	check(s[6].data() == s[0].data(), "outer reference after the inner");
+	/* the inner namespace's entry is gone, index 2 is out of range */
+	check(strings(cbor_of(
+	    R"(256([256(["def"]), "abc", 25(1)]))"), s) ==
+	    cbor::errc::invalid_stringref, "inner table ends with its item");
+	check(strings(cbor_of(
+	    R"(256([256(["def"]), "abc", 25(0)]))"), s) == cbor::errc::ok &&
+	    s.back() == "abc", "outer table continues after the inner one");
+
+	check(strings(cbor_of("25(0)"), s) == cbor::errc::invalid_stringref,
+	    "reference outside a namespace");
+	check(strings(cbor_of(R"(256(["ab", 25(0)]))"), s) ==
+	    cbor::errc::invalid_stringref, "short string was not entered");
+	check(strings(cbor_of(R"(256(["abc", 25(1)]))"), s) ==
+	    cbor::errc::invalid_stringref, "index past the table");
+	check(strings(cbor_of(R"(256(["abc", 25(-1)]))"), s) ==
+	    cbor::errc::invalid_stringref, "negative index");
+	check(strings(cbor_of(R"([256(["abc"]), 256([25(0)])])"), s) ==
+	    cbor::errc::invalid_stringref, "sibling namespaces");
+	check(strings(cbor_of(R"(256([(_ "abc"), 25(0)]))"), s) ==
+	    cbor::errc::invalid_stringref, "chunks were not entered");
+}
+
+/* what the encoder writes the decoder reads back */
+void
+round_trip()
+{
+	const char *const keys[] = {"temperature", "humidity", "pressure"};
+	const auto in = encoded([&](auto &enc) {
+		enc.stringrefs_begin();
+		enc.array(100);
+		for (int i = 0; i < 100; ++i) {
+			enc.map(1);
+			enc.text(keys[i % 3]);
+			enc.text("value " + std::to_string(i % 40));
+		}
+		enc.stringrefs_end();
+	});
+	std::vector<std::string_view> s;
+	check(strings(in, s) == cbor::errc::ok && s.size() == 200,
+	    "round trip");
+	for (int i = 0; i < 100; ++i) {
+		check(s[2 * i] == keys[i % 3] && s[2 * i + 1] ==
+		    "value " + std::to_string(i % 40), "round trip strings");
+		if (i >= 40)
+			check(s[2 * i].data() == s[2 * (i - 3)].data() &&
+			    s[2 * i + 1].data() == s[2 * (i - 40) + 1].data(),
+			    "equal strings share a pointer");
+	}
+}
+
+}
+
+int
+main()
+{
+	encode();
+	thresholds();
+	decode();
+	round_trip();
+	std::puts("ok");
+	return 0;
+}
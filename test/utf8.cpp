@@ -0,0 +1,211 @@
+/*
+ * Tests for UTF-8 validation: every validator agrees with a byte at a time
+ * reference, across the lengths where they switch strategy.
+ *
+ * Build and run from the top of the tree:
+ *
+ *	c++ -std=c++20 -Iinclude test/utf8.cpp -o test_utf8
+ *	./test_utf8
+ *
+ * Exits with status 1 and a message on the first failure.
+ */
+
+#include <cbor++/utf8.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+namespace {
+
+void
+check(bool ok, const char *what)
+{
+	if (!ok) {
+		std::fprintf(stderr, "FAIL: %s\n", what);
+		std::exit(1);
+	}
+}
+
+/* RFC 3629, one code point at a time */
+bool
+reference(const std::string &s)
+{
+	const auto *p = reinterpret_cast<const std::uint8_t *>(s.data());
+	const std::size_t n = s.size();
+	for (std::size_t i = 0; i < n;) {
+		const std::uint8_t c = p[i];
+		std::size_t len;
+		std::uint32_t cp;
+		if (c < 0x80) {
+			++i;
+			continue;
+		} else if (c >= 0xc2 && c < 0xe0) {
+			len = 2;
+			cp = c & 0x1f;
+		} else if (c >= 0xe0 && c < 0xf0) {
+			len = 3;
+			cp = c & 0x0f;
+		} else if (c >= 0xf0 && c < 0xf5) {
+			len = 4;
+			cp = c & 0x07;
+		} else
+			return false;
+		if (n - i < len)
+			return false;
+		for (std::size_t k = 1; k < len; ++k) {
+			if ((p[i + k] & 0xc0) != 0x80)
+				return false;
+			cp = cp << 6 | (p[i + k] & 0x3f);
+		}
+		if ((len == 3 && cp < 0x800) || (len == 4 && cp < 0x10000) ||
+		    (cp >= 0xd800 && cp < 0xe000) || cp > 0x10ffff)
+			return false;
+		i += len;
+	}
+	return true;
+}
+
+/* s fed to utf8_stream in pieces of step bytes */
+bool
+stream(const std::string &s, std::size_t step)
+{
+	cbor::utf8_stream v;
+	for (std::size_t i = 0; i < s.size(); i += step)
+		if (!v.feed(s.data() + i, std::min(step, s.size() - i)))
+			return false;
+	return v.finish();
+}
+
+/* every validator gives the reference answer for s */
+void
+agree(const std::string &s)
+{
+	const bool want = reference(s);
+	const auto *p = reinterpret_cast<const std::uint8_t *>(s.data());
+	const std::size_t n = s.size();
+	check(cbor::detail::utf8_valid_scalar(p, n) == want, "scalar");
+	check(cbor::detail::utf8_valid_simd(p, n) == want, "simd");
+	check(cbor::utf8_valid(s) == want, "utf8_valid");
+#if defined(CBOR_UTF8_X86)
+	if (__builtin_cpu_supports("ssse3"))
+		check(cbor::detail::utf8_valid_ssse3(p, n) == want, "ssse3");
+	if (__builtin_cpu_supports("avx2"))
+		check(cbor::detail::utf8_valid_avx2(p, n) == want, "avx2");
+#endif
+	for (const std::size_t step : {1, 2, 3, 5, 16, 33})
+		check(stream(s, step) == want, "utf8_stream");
+}
+
+/* the first eight are valid */
+const char *const sequences[] = {
+	"\xc2\x80", "\xdf\xbf", "\xe0\xa0\x80", "\xed\x9f\xbf", "\xee\x80\x80",
+	"\xef\xbf\xbf", "\xf0\x90\x80\x80", "\xf4\x8f\xbf\xbf",
+
+	/* overlong, surrogates, past U+10FFFF, stray and missing bytes */
+	"\xc0\x80", "\xc1\xbf", "\xe0\x9f\xbf", "\xf0\x8f\xbf\xbf",
+	"\xed\xa0\x80", "\xed\xbf\xbf", "\xf4\x90\x80\x80", "\xf5\x80\x80\x80",
+	"\x80", "\xbf", "\xc2", "\xe0\xa0", "\xf0\x90\x80", "\xff", "\xfe",
+	"\xc2\x80\x80",
+};
+
+/* each sequence at each offset of ASCII text of every length */
+void
+positions()
+{
+	for (std::size_t i = 0; i < std::size(sequences); ++i)
+		check(reference(sequences[i]) == (i < 8), sequences[i]);
+	for (std::size_t n = 0; n <= 200; ++n) {
+		for (const char *q : sequences) {
+			const std::string seq{q};
+			for (std::size_t i = 0; i + seq.size() <= n; ++i) {
+				std::string s(n, 'a');
+				s.replace(i, seq.size(), seq);
+				agree(s);
+			}
+		}
+	}
+	/* the tail of a block ends in the middle of a code point */
+	for (std::size_t n = 1; n <= 130; ++n)
+		for (std::size_t cut = 1; cut < 4; ++cut) {
+			std::string s;
+			while (s.size() < n + 4)
+				s += "\xf0\x9f\x98\x80";
+			s.resize(n);
+			agree(s);
+			s.resize(s.size() - std::min(s.size(), cut));
+			agree(s);
+		}
+}
+
+/* random valid text, then with one byte changed */
+void
+mutations()
+{
+	std::mt19937 rng{8};
+	const auto code_point = [&] {
+		switch (rng() % 4) {
+		case 0:
+			return std::uint32_t(rng() % 0x80);
+		case 1:
+			return std::uint32_t(0x80 + rng() % 0x780);
+		case 2: {
+			std::uint32_t cp;
+			do
+				cp = 0x800 + rng() % 0xf800;
+			while (cp >= 0xd800 && cp < 0xe000);
+			return cp;
+		}
+		default:
+			return std::uint32_t(0x10000 + rng() % 0x100000);
+		}
+	};
+	const auto append = [](std::string &s, std::uint32_t cp) {
+		if (cp < 0x80)
+			s += char(cp);
+		else if (cp < 0x800) {
+			s += char(0xc0 | cp >> 6);
+			s += char(0x80 | (cp & 0x3f));
+		} else if (cp < 0x10000) {
+			s += char(0xe0 | cp >> 12);
+			s += char(0x80 | (cp >> 6 & 0x3f));
+			s += char(0x80 | (cp & 0x3f));
+		} else {
+			s += char(0xf0 | cp >> 18);
+			s += char(0x80 | (cp >> 12 & 0x3f));
+			s += char(0x80 | (cp >> 6 & 0x3f));
+			s += char(0x80 | (cp & 0x3f));
+		}
+	};
+	const std::uint8_t bytes[] = {0x00, 0x7f, 0x80, 0xbf, 0xc0, 0xc1, 0xc2,
+	    0xdf, 0xe0, 0xed, 0xef, 0xf0, 0xf4, 0xf5, 0xff};
+	for (int round = 0; round < 3000; ++round) {
+		std::string s;
+		const std::size_t n = rng() % 300;
+		while (s.size() < n)
+			append(s, code_point());
+		check(reference(s), "generated text is valid");
+		agree(s);
+		if (s.empty())
+			continue;
+		for (int k = 0; k < 8; ++k) {
+			std::string t = s;
+			t[rng() % t.size()] = char(bytes[rng() % sizeof bytes]);
+			agree(t);
+		}
+		agree(s.substr(0, s.size() - 1));
+	}
+}
+
+}
+
+int
+main()
+{
+	positions();
+	mutations();
+	std::puts("ok");
+	return 0;
+}